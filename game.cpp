@@ -2,24 +2,249 @@
 #include <SFML/Window.hpp>
 #include <SFML/Graphics.hpp>
 #include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <chrono>
 #include <iostream>
 #include <string>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <coroutine>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 //-> Padding specify the min closeness between created entities.
 //   This value is used only in entity creation.
 #define PADDING 30
 //---
 
+//-> Pixels with a lower alpha (shadows, soft edges) are not collided.
+#define COLLISION_ALPHA 128
+//---
+
 //-> Cast to float macro
 #define CAST_FLOAT(x) static_cast<float>(x)
 //---
 
+//-> Capacity limits of the world snapshots. Snapshots are fixed size so they
+//   can be captured, encoded and decoded without any heap allocation. All
+//   bullets of the pools fit, so a snapshot is never a part of the world.
+#define SNAP_MAX_PLAYERS 16
+#define SNAP_MAX_BARRELS 256
+#define SNAP_MAX_BULLETS (SNAP_MAX_PLAYERS * BULLET_POOL_SIZE)
+//   Positions are quantized to 1/SNAP_POS_SCALE pixel on the wire.
+#define SNAP_POS_SCALE 4
+#define SNAP_POS_BITS 18
+//---
+
+//-> Interest management. Soldiers and bullets of a snapshot are indexed in cells of
+//   INTEREST_CELL_SIZE pixels, a client gets the ones within its view radius plus
+//   INTEREST_MARGIN, so an entity is sent a little before it is seen.
+#define INTEREST_CELL_SIZE 256
+#define INTEREST_MARGIN 64
+//---
+
+//-> Max alive bullets of a player. Bullets are taken from a pool of this size.
+#define BULLET_POOL_SIZE 256
+//---
+
+//-> Max number of ticks that can be re-simulated when a late input arrives.
+//   This bounds the network latency that rollback can hide.
+#define ROLLBACK_MAX_FRAMES 8
+//---
+
+//-> Input thread checks the keys every INPUT_POLL_US microseconds and puts the
+//   changes into a queue of INPUT_QUEUE_SIZE events (must be power of 2).
+#define INPUT_POLL_US 500
+#define INPUT_QUEUE_SIZE 256
+#define INPUT_MAX_KEYS 32
+//---
+
+//-> Telemetry records are queued in a ring of TELEMETRY_QUEUE_SIZE records (must
+//   be power of 2), the writer drains it in every TELEMETRY_FLUSH_US microseconds.
+//   A file is rotated after TELEMETRY_ROTATE_RECORDS records.
+#define TELEMETRY_QUEUE_SIZE 16384
+#define TELEMETRY_FLUSH_US 2000
+#define TELEMETRY_ROTATE_RECORDS 100000
+//---
+
+//-> Match recording, it is written with "--record <file>" and played with "--replay <file>".
+//   A keyframe (the whole world state) starts a block of at most RECORD_KEYFRAME_TICKS
+//   ticks, so a seek re-simulates less than RECORD_KEYFRAME_TICKS ticks. The viewer
+//   seeks RECORD_SEEK_SECONDS, speed is 2^shift between the min and max shifts.
+#define RECORD_MAGIC "SREC"
+#define RECORD_VERSION 4
+#define RECORD_KEYFRAME_TICKS 240
+#define RECORD_MAP_PATH_SIZE 256
+#define RECORD_SEEK_SECONDS 5
+#define RECORD_MIN_SPEED_SHIFT -2
+#define RECORD_MAX_SPEED_SHIFT 4
+//---
+
+//-> Scripts are coroutines resumed by the tick loop. Their frames are taken from
+//   a pool of SCRIPT_FRAME_SIZE byte slots, which grows by SCRIPT_POOL_CHUNK slots.
+//   A patrolling soldier is blocked after SCRIPT_BLOCKED_WALKS walks without a move,
+//   as a turn takes a few walks.
+#define SCRIPT_FRAME_SIZE 128
+#define SCRIPT_POOL_CHUNK 64
+#define SCRIPT_BLOCKED_WALKS 5
+//---
+
+//-> Asset archive, it is created with "./game --pack assets.pak".
+#define ASSET_ARCHIVE_PATH "assets.pak"
+#define ASSET_ARCHIVE_MAGIC "SPAK"
+#define ASSET_ARCHIVE_VERSION 1
+#define ASSET_ARCHIVE_ALIGN 4096
+#define SOLDIER_FRAMES 14
+#define SOLDIER_ATLAS_COLUMNS 4
+//   Decoded textures are uploaded in batches of ASSET_UPLOADS_PER_FRAME while the loading screen is shown.
+#define ASSET_UPLOADS_PER_FRAME 4
+//---
+
+//-> Map file, it is created with "--export-map <file>". Obstacles are indexed in
+//   cells of MAP_CELL_SIZE pixels, soldiers can spawn at every MAP_SPAWN_STEP pixels.
+#define MAP_MAGIC "SMAP"
+#define MAP_VERSION 1
+#define MAP_CELL_SIZE 128
+#define MAP_SPAWN_STEP 64
+#define MAP_MIN_SPAWNS (4 * SNAP_MAX_PLAYERS)
+//---
+
+//-> Frame arena holds the transient data of a tick, it is reset once per tick.
+//   Hits, the bullet quads and the bullet grid of every player are added to this size.
+#define FRAME_ARENA_SIZE (64 * 1024)
+//---
+
+//-> Glyphs of the scoreboard, digits 0-9 then space and dash. A score has at most 10 digits.
+#define SCOREBOARD_GLYPHS 12
+#define SCOREBOARD_SPACE 10
+#define SCOREBOARD_DASH 11
+#define SCOREBOARD_MAX_CHARS (SNAP_MAX_PLAYERS * 13)
+//---
+
+//-> Changed regions of a frame. If there are more, then the whole frame is redrawn.
+#define DIRTY_MAX_RECTS 32
+//---
+
+//-> Particles of the explosions and the hits. Pool has PARTICLE_CAPACITY slots,
+//   it is updated on the worker pool if it has at least PARTICLE_PARALLEL_MIN
+//   particles. Particles fade out in their last PARTICLE_FADE seconds.
+#define PARTICLE_CAPACITY (128 * 1024)
+#define PARTICLE_PARALLEL_MIN (32 * 1024)
+#define PARTICLE_SIZE 3
+#define PARTICLE_FADE 0.4f
+#define PARTICLE_DRAG 0.15f //Part of the speed which is left after a second.
+#define PARTICLE_GRAVITY 120.0f
+#define PARTICLE_EXPLOSION 300 //Particles of a destroyed barrel.
+#define PARTICLE_DEBRIS 120
+#define PARTICLE_HIT 150 //Particles of a hit player.
+//---
+
+//-> Line of sight grid. A ray walks the cells with DDA and only the obstacles of
+//   the cells on the ray are tested. Batches of at least RAYCAST_PARALLEL_MIN rays
+//   are split over the worker pool.
+#define RAYCAST_CELL_SIZE 64
+#define RAYCAST_PARALLEL_MIN 64
+//---
+
+//-> Frame budget governor of the windowed game. Cost of a tick (simulation and
+//   rendering) is averaged. If it is over GOVERNOR_HIGH of the tick time for
+//   GOVERNOR_PRESSURE_TICKS ticks, the game degrades one more level. If it is under
+//   GOVERNOR_LOW for GOVERNOR_RELIEF_TICKS ticks, it gets one level back.
+#define GOVERNOR_HIGH 0.8f
+#define GOVERNOR_LOW 0.4f
+#define GOVERNOR_PRESSURE_TICKS 30
+#define GOVERNOR_RELIEF_TICKS 120
+#define GOVERNOR_SMOOTHING 0.1f //Weight of the last tick in the average cost.
+#define GOVERNOR_RENDER_INTERVAL 2 //Ticks of a frame when the render rate is lowered.
+#define GOVERNOR_OVERLAY_INTERVAL 30 //Ticks between scoreboard updates when the overlay is reduced.
+#define GOVERNOR_BULLET_CAP 8 //Flying bullets of a player when new bullets are capped.
+//---
+
+//-> Candidate pairs of the broad phase in a tick, they are kept in the frame arena.
+//   Slots of the pairs are 16 bits.
+#define BROADPHASE_MAX_PAIRS 8192
+#define BROADPHASE_MAX_SLOTS 65536
+//---
+
+//-> Scenario defaults and limits. Fire and walk inputs are taken once in
+//   FIRE_TICKS and WALK_TICKS ticks, as the bullets are faster than the soldiers.
+#define TICK_RATE 60
+#define FIRE_TICKS 4
+#define WALK_TICKS 12
+#define BULLET_SPEED 18
+#define WIN_SCORE 10
+#define SCENARIO_MIN_SIZE 320
+#define SCENARIO_MAX_SIZE 32768
+#define SCENARIO_MAX_SANDBAGS 16384 //Sandbags are not in the snapshots, so they are limited only by the broad phase.
+#define SCENARIO_MAX_TICK_RATE 1000
+#define SCENARIO_MAX_BULLET_SPEED 48 //Faster bullets can jump over a soldier in a tick.
+#define SCENARIO_MAX_DENSITY 0.35 //Padded entities cover at most this part of the arena, otherwise placement may not end.
+//---
+
+//-> Positions of the simulation are fixed point, FIXED_ONE units are a pixel. They
+//   are converted to floats for the sprites, the snapshots and the float views of
+//   the positions, and the conversions are exact in arenas of SCENARIO_MAX_SIZE.
+#define FIXED_SHIFT 8
+#define FIXED_ONE (1 << FIXED_SHIFT)
+//---
+
 using namespace std;
 
 //-> Enum for movements.
 enum Direction {UP, DOWN, LEFT, RIGHT};
 //---
 
+//-> Broad phase of the bullet collisions. Brute force tests every bullet with every
+//   entity, sweep finds the candidates with the SweepAndPrune class.
+enum CollisionMode {COLLIDE_BRUTE, COLLIDE_SWEEP};
+//---
+
+//-> Behavior of the bots. None is the random walk of driveBots, others are scripts.
+enum BotScript {SCRIPT_NONE, SCRIPT_PATROL};
+//---
+
+//-> Degradation levels, in order. A level also keeps the degradations of the lower levels.
+enum LoadLevel { LOAD_NORMAL, LOAD_NO_EFFECTS, LOAD_LOW_RENDER_RATE, LOAD_SLOW_OVERLAY, LOAD_BULLET_CAP, NUM_LOAD_LEVELS };
+//---
+
+//-> Collision matrix. A row is a moving layer and its bits are the layers which
+//   it collides with. Team bits of a row are the layers whose objects of the
+//   mover's team are skipped, so friendly fire is also a rule of the matrix.
+//   Rules are resolved at compile time by PairHandler.
+enum CollisionLayer {LAYER_SOLDIER, LAYER_BULLET, LAYER_SANDBAG, LAYER_BARREL, NUM_LAYERS};
+#define LAYER_BIT(layer) (1u << (layer))
+constexpr unsigned int collisionRules[NUM_LAYERS] = {
+	LAYER_BIT(LAYER_SOLDIER) | LAYER_BIT(LAYER_SANDBAG) | LAYER_BIT(LAYER_BARREL), //Soldiers are blocked.
+	LAYER_BIT(LAYER_SOLDIER) | LAYER_BIT(LAYER_BULLET) | LAYER_BIT(LAYER_SANDBAG) | LAYER_BIT(LAYER_BARREL), //Bullets vs bullets is an option.
+	0, //Obstacles do not move.
+	0
+};
+constexpr unsigned int teamRules[NUM_LAYERS] = {
+	0, //Soldiers of a team block each other.
+	LAYER_BIT(LAYER_SOLDIER) | LAYER_BIT(LAYER_BULLET), //No friendly fire.
+	0,
+	0
+};
+constexpr bool layersCollide(const CollisionLayer mover, const CollisionLayer target) { return (collisionRules[mover] >> target) & 1; }
+constexpr bool teamFiltered(const CollisionLayer mover, const CollisionLayer target) { return (teamRules[mover] >> target) & 1; }
+//---
+
 //-> This array will be used in the collision check of entities.
 typedef struct _entityArray {
 	sf::Vector2f pos;
@@ -27,21 +252,824 @@ typedef struct _entityArray {
 } entityArray;
 //---
 
+//-> These structs hold the world state of a single tick. Bullets are stored
+//   as spawn data (spawn position, direction, speed) plus their age in ticks,
+//   because bullets move deterministically after they are fired.
+typedef struct _playerSnap {
+	sf::Vector2f pos;
+	int state;
+	int s;
+	int oldDir;
+	int score;
+	int deaths; //Reborns, the renderer spawns a hit effect for each new one.
+} playerSnap;
+
+typedef struct _bulletSnap {
+	unsigned int id;
+	int owner;
+	Direction dir;
+	float speed;
+	unsigned int age;
+	sf::Vector2f spawnPos;
+} bulletSnap;
+
+typedef struct _worldSnapshot {
+	unsigned int tick;
+	unsigned int rngState; //Not sent by the SnapshotCodec, used by rollback.
+	unsigned int nextBulletId; //Not sent by the SnapshotCodec, used by rollback.
+	int np;
+	int nb;
+	int nbul;
+	playerSnap players[SNAP_MAX_PLAYERS];
+	unsigned char barrelVisible[SNAP_MAX_BARRELS / 8]; //Bit-packed visibility of the barrels.
+	bulletSnap bullets[SNAP_MAX_BULLETS]; //Sorted by bullet id.
+} worldSnapshot;
+//---
+
+//-> Inputs of the players in a single tick. move is a Direction or -1. New bullets
+//   are capped in the tick if capBullets is set, the governor of the game which
+//   makes the input sets it, so every copy of the match gets the same cap.
+typedef struct _tickInput {
+	signed char move[2];
+	unsigned char fire[2];
+	unsigned char capBullets;
+} tickInput;
+//---
+
+//-> A player hit by a bullet in a tick. Hits are applied after all bullets are moved.
+typedef struct _hitEvent {
+	unsigned char target;
+	unsigned char shooter;
+} hitEvent;
+//---
+
+//-> How an entity was drawn in the last presented frame. Frame is the state of
+//   a player or the visibility of a barrel.
+typedef struct _drawRecord {
+	sf::FloatRect bounds;
+	int frame;
+	int deaths; //Reborns of a player, the hit effect is spawned for the new ones.
+} drawRecord;
+//---
+
+//-> A telemetry record. Player is the shooter of a shot or a hit, or the reborn
+//   player. Layer and index are the target of a hit. Value is the attempts of a
+//   respawn, microseconds of a tick or a frame, or the number of dropped records.
+enum TelemetryKind { TEL_SHOT, TEL_HIT, TEL_RESPAWN, TEL_TICK, TEL_FRAME, TEL_DROPPED, NUM_TELEMETRY_KINDS };
+typedef struct _telemetryRecord {
+	sf::Uint32 tick;
+	sf::Uint8 kind;
+	sf::Uint8 player;
+	sf::Uint8 layer;
+	sf::Int32 index;
+	sf::Int64 value;
+} telemetryRecord;
+//---
+
+//-> Recording file is the header, the blocks and then the index of the blocks with
+//   the trailer. A block is a keyframe, its np players, barrel bits and nbul bullets,
+//   then the input of every tick in the block. Ticks of a recording are counted
+//   from its start, ticks of the game start again after a reset.
+typedef struct _recordHeader {
+	char magic[4];
+	sf::Uint32 version;
+	sf::Uint32 keyframeTicks;
+	sf::Uint32 width;
+	sf::Uint32 height;
+	sf::Uint32 numBarrels;
+	sf::Uint32 numSandbags;
+	sf::Uint32 numHumans;
+	sf::Uint32 numBots;
+	sf::Uint32 tickRate;
+	float bulletSpeed;
+	sf::Uint32 seed;
+	sf::Uint32 collisionMode;
+	sf::Uint32 bulletCollisions;
+	sf::Uint32 numTeams;
+	char mapPath[RECORD_MAP_PATH_SIZE]; //Empty for a random layout.
+} recordHeader;
+
+typedef struct _recordKeyframe {
+	sf::Uint32 matchSeed; //Obstacles of the match are placed with it.
+	sf::Uint32 tick;
+	sf::Uint32 rngState;
+	sf::Uint32 nextBulletId;
+	sf::Uint16 np;
+	sf::Uint16 nb;
+	sf::Uint16 nbul;
+} recordKeyframe;
+
+typedef struct _recordInput {
+	sf::Uint32 hash; //Low bits of the world hash before the tick, the viewer checks it.
+	tickInput input;
+} recordInput;
+
+typedef struct _recordBlock {
+	sf::Uint64 offset;
+	sf::Uint32 tick; //First tick of the block.
+	sf::Uint32 numTicks;
+} recordBlock;
+
+typedef struct _recordTrailer {
+	sf::Uint64 indexOffset;
+	sf::Uint32 numBlocks;
+	char magic[4];
+} recordTrailer;
+//---
+
+//-> Key event captured by the input thread. Time is in microseconds, from the clock of the input thread.
+typedef struct _inputEvent {
+	sf::Int64 time;
+	sf::Keyboard::Key key;
+	bool pressed;
+} inputEvent;
+//---
+
+//-> Setup of a game, read from a config file and then from the command line.
+//   Players are the keyboard players and bots are the players driven by the
+//   simulation, so a game has numHumans + numBots soldiers.
+typedef struct _scenario {
+	int width;
+	int height;
+	int numBarrels;
+	int numSandbags;
+	int numHumans;
+	int numBots;
+	int tickRate; //Ticks per second.
+	float bulletSpeed; //Pixels per tick.
+	unsigned int seed; //0 means a seed from the clock.
+	bool headless; //No window, ticks are simulated as fast as possible.
+	unsigned int duration; //Number of ticks, 0 means until the window is closed.
+	CollisionMode collisionMode;
+	string textureDir;
+	string fontPath;
+	string archivePath;
+	bool bulletCollisions; //Bullets of different players cancel each other.
+	int numTeams; //Player i is in team i % numTeams, 0 means every player is alone. Teammates do not hit each other.
+	string mapPath; //Map file, its arena replaces the size and the obstacles above. Empty means a random layout.
+	string exportPath; //Random layout is saved as a map file there instead of playing.
+	string telemetryPath; //Records of the match are written there, ".csv" is CSV and others NDJSON. Empty means no telemetry.
+	string recordPath; //Match is recorded there. Empty means no recording.
+	string replayPath; //Recording which is played instead of a game, its scenario replaces the others.
+	BotScript botScript;
+	bool checkParallel; //Headless ticks with the parallel paths are compared with a serial copy of the game.
+} scenario;
+//---
+
+//-> Single producer single consumer lock-free ring. Producer only writes
+//   tail and consumer only writes head, so no lock is needed.
+template <typename T, unsigned int N>
+class SpscRing {
+	T items[N];
+	atomic<unsigned int> head; //Next item to pop.
+	atomic<unsigned int> tail; //Next free slot.
+public:
+	SpscRing();
+	bool push(const T &item); //Returns false if the ring is full.
+	bool peek(T &item);
+	bool pop(T &item);
+};
+//---
+
+//-> Keyboard is sampled in its own thread, so key presses are not delayed by
+//   rendering and each press/release is timestamped when it happens. Window
+//   events can only be read in the window thread, so sf::Keyboard::isKeyPressed is used.
+class InputThread {
+	SpscRing<inputEvent, INPUT_QUEUE_SIZE> queue;
+	thread worker;
+	atomic<bool> running;
+	atomic<bool> focused; //Keys are ignored while the window is not focused.
+	atomic<unsigned int> dropped;
+	sf::Clock clock;
+	sf::Keyboard::Key keys[INPUT_MAX_KEYS];
+	int numKeys;
+	void loop(void);
+public:
+	InputThread();
+	~InputThread();
+	void start(const sf::Keyboard::Key *const keys, const int &numKeys);
+	void stop(void);
+	void setFocused(const bool &focused);
+	//Pops the oldest event if it is captured before "until".
+	bool pop(inputEvent &event, const sf::Int64 &until);
+	sf::Int64 now(void);
+	unsigned int getDropped(void);
+};
+//---
+
+//-> Input to photon latency: time between the capture of a key event and the
+//   display of the first frame that is drawn after the tick which used it.
+class LatencyMeter {
+	sf::Int64 pendingSum; //Capture times of the used but not displayed events.
+	sf::Int64 pendingOldest;
+	unsigned int pendingCount;
+	sf::Int64 total;
+	sf::Int64 max;
+	unsigned int count;
+public:
+	LatencyMeter();
+	void consumed(const sf::Int64 &eventTime);
+	void presented(const sf::Int64 &presentTime);
+	void print(void);
+};
+//---
+
+//-> Sheds the rendering work when the ticks cost more than the tick time, so the
+//   simulation keeps its tick rate and inputs are used in their ticks. Effects are
+//   dropped first, then frames, then scoreboard updates, and at last new bullets
+//   are capped. The cap is asked in the tick input, the governor itself does not
+//   change the simulation. Every level change is logged and counted.
+class LoadGovernor {
+	sf::Int64 budget; //Microseconds of a tick.
+	float cost; //Average cost of the ticks, in microseconds.
+	int level;
+	unsigned int pressureTicks; //Ticks over the high mark in a row.
+	unsigned int reliefTicks; //Ticks under the low mark in a row.
+	unsigned int entered[NUM_LOAD_LEVELS]; //Times a level is entered.
+	unsigned long long ticksAt[NUM_LOAD_LEVELS];
+	static const char *const levelNames[NUM_LOAD_LEVELS];
+public:
+	LoadGovernor();
+	void init(const sf::Int64 &budget);
+	//Cost of a tick and of its frame, 0 if no frame is rendered. Returns true if the level is changed.
+	bool record(const unsigned int &tick, const sf::Int64 &tickCost, const sf::Int64 &renderCost);
+	int getLevel(void);
+	bool getEffects(void); //Particles are spawned and updated.
+	unsigned int getRenderInterval(void); //A frame is rendered in every n ticks.
+	unsigned int getOverlayInterval(void); //Scoreboard is updated in every n ticks.
+	bool getBulletCap(void); //New bullets should be capped, it is given to the simulation in the tick input.
+	unsigned int getEntered(const int &level);
+	void print(void);
+};
+//---
+
+//-> Records are pushed by the tick thread and written by a background thread, so
+//   the tick thread only copies a record into the ring. If the ring is full (the
+//   disk falls behind) the record is dropped and counted, and the writer adds a
+//   dropped record to the file. Files ending with ".csv" are CSV, others NDJSON.
+class TelemetrySink {
+	SpscRing<telemetryRecord, TELEMETRY_QUEUE_SIZE> queue;
+	thread writer;
+	atomic<bool> running;
+	atomic<unsigned int> dropped;
+	unsigned int tick; //Tick of the next records, set by the tick thread.
+	string path;
+	bool csv;
+	unsigned long long rotateRecords;
+	//-> Only the writer uses these while it runs.
+	ofstream file;
+	unsigned int numFiles;
+	unsigned long long fileRecords;
+	unsigned long long written;
+	unsigned int reportedDrops;
+	unsigned int lastTick;
+	//---
+	static const char *const kindNames[NUM_TELEMETRY_KINDS];
+	void loop(void);
+	bool rotate(void); //Opens the next file.
+	void write(const telemetryRecord &record);
+public:
+	TelemetrySink();
+	~TelemetrySink();
+	bool start(const string &path, const unsigned long long &rotateRecords = TELEMETRY_ROTATE_RECORDS);
+	void stop(void); //Queued records are written before it returns.
+	bool isRunning(void);
+	void setTick(const unsigned int &tick);
+	void record(const TelemetryKind &kind, const int &player, const int &layer, const int &index, const sf::Int64 &value);
+	string getPath(const unsigned int &i); //Files after the first have the number before the extension.
+	unsigned int getNumFiles(void);
+	unsigned long long getWritten(void);
+	unsigned int getDropped(void);
+	void print(void);
+};
+//---
+
+//-> Writes a match recording while the game is played. Blocks are written as the
+//   ticks come and the index is written by stop(), a file without the index can
+//   not be played.
+class MatchRecorder {
+	ofstream file;
+	string path;
+	vector<recordBlock> blocks;
+	unsigned int keyframeTicks;
+	unsigned int numTicks;
+	unsigned int nextGameTick; //Game tick which continues the current block.
+	unsigned long long bytes;
+	bool running;
+public:
+	MatchRecorder();
+	~MatchRecorder();
+	bool start(const string &path, const recordHeader &header);
+	void stop(void);
+	bool isRunning(void);
+	//A block is started after keyframeTicks ticks and when the game tick jumps, as after a reset.
+	bool needsKeyframe(const unsigned int &gameTick);
+	void writeKeyframe(const worldSnapshot &snap, const unsigned int &matchSeed);
+	void writeInput(const tickInput &input, const sf::Uint64 &hash);
+	unsigned int getNumTicks(void);
+	void print(void);
+};
+//---
+
+//-> Reads a recording for the viewer. Only the header and the index are read when
+//   it is opened, a block is read when a tick in it is needed.
+class RecordReader {
+	ifstream file;
+	recordHeader header;
+	vector<recordBlock> blocks;
+	vector<recordInput> inputs; //Inputs of the loaded block.
+	worldSnapshot *keyframe; //Keyframe of the loaded block.
+	unsigned int matchSeed;
+	unsigned int numTicks;
+	int block; //Loaded block, -1 if none is loaded.
+public:
+	RecordReader();
+	~RecordReader();
+	bool open(const string &path);
+	void getScenario(scenario &config); //Scenario of the recorded game, played in a window.
+	unsigned int getNumTicks(void);
+	unsigned int getKeyframeTicks(void);
+	int findBlock(const unsigned int &tick); //End of the recording is in the last block.
+	bool loadBlock(const int &block); //Returns false if the block is corrupted.
+	int getBlock(void);
+	unsigned int getBlockStart(void);
+	bool hasTick(const unsigned int &tick); //Tick is in the loaded block.
+	const worldSnapshot &getKeyframe(void);
+	unsigned int getMatchSeed(void);
+	const recordInput &getInput(const unsigned int &tick);
+};
+//---
+
+//-> Slots of the coroutine frames. Freed slots are kept in a list and reused, so
+//   a script which is started in a tick does not allocate after the pool is
+//   reserved. Larger frames are taken from the heap. It is used only by the tick thread.
+class ScriptPool {
+	static void *freeSlots; //A free slot keeps the next free slot in its first bytes.
+	static vector<char *> chunks;
+	static unsigned int numSlots;
+	static unsigned int usedSlots;
+	static unsigned int growths;
+	static unsigned int heapFrames;
+	static size_t largestFrame;
+	static void grow(const unsigned int &slots);
+public:
+	static void reserve(const unsigned int &slots); //At least this many slots are free after it.
+	static void *allocate(const size_t &size);
+	static void deallocate(void *const frame, const size_t &size);
+	static void release(void); //Chunks are freed if no slot is used.
+	static unsigned int getUsed(void);
+	static unsigned int getGrowths(void);
+	static unsigned int getHeapFrames(void);
+	static size_t getLargestFrame(void);
+};
+//---
+
+//-> Return type of the scripts. A script starts at the next run of the scheduler,
+//   and suspends with "co_await ScriptWait(ticks)". Parameters are copied into
+//   the frame, so a script should not take references to temporaries.
+class Script {
+public:
+	struct promise_type {
+		unsigned int tick; //Tick of the current run, set by the scheduler.
+		unsigned int wakeTick; //Script is resumed in the first run at or after it.
+		Script get_return_object(void);
+		suspend_always initial_suspend(void) noexcept;
+		suspend_always final_suspend(void) noexcept; //Finished scripts are destroyed by the scheduler.
+		void return_void(void);
+		void unhandled_exception(void);
+		static void *operator new(size_t size);
+		static void operator delete(void *frame, size_t size);
+	};
+	Script(const coroutine_handle<promise_type> &handle);
+	Script(Script &&other);
+	~Script();
+	coroutine_handle<promise_type> release(void); //Scheduler takes the frame.
+private:
+	coroutine_handle<promise_type> handle;
+};
+
+class ScriptWait {
+	unsigned int ticks; //0 does not suspend.
+public:
+	ScriptWait(const unsigned int &ticks);
+	bool await_ready(void) const noexcept;
+	void await_suspend(coroutine_handle<Script::promise_type> handle) const noexcept;
+	void await_resume(void) const noexcept;
+};
+//---
+
+//-> Scripts are resumed in the order they are started, so a tick with scripts
+//   is deterministic as the others.
+class ScriptScheduler {
+	vector<coroutine_handle<Script::promise_type> > scripts;
+	unsigned long long resumes;
+public:
+	ScriptScheduler();
+	~ScriptScheduler();
+	void reserve(const unsigned int &capacity); //Scripts and their frames, so starting them does not allocate.
+	void spawn(Script script, const unsigned int &tick); //Script runs first in the tick.
+	void run(const unsigned int &tick); //Scripts whose wait is over are resumed, finished ones are destroyed.
+	void clear(void);
+	unsigned int size(void);
+	unsigned long long getResumes(void);
+};
+//---
+
+//-> Game owned random number generator (xorshift32). rand() has a hidden global
+//   state, state of this one is saved and restored with the world.
+class Random {
+	unsigned int state;
+public:
+	Random();
+	void seed(const unsigned int &seed);
+	unsigned int next(void);
+	unsigned int getState(void);
+	void setState(const unsigned int &state);
+};
+//---
+
+//-> Allocation tracking, it is compiled only with -DALLOC_TRACKING (make ALLOC_TRACKING=1).
+//   Global new/delete count the allocations and the live bytes of the subsystem
+//   which is set for the current thread with an AllocScope.
+enum AllocTag { TAG_GENERAL, TAG_ASSETS, TAG_ENTITIES, TAG_SIMULATION, TAG_RENDER, TAG_INPUT, TAG_ROLLBACK, TAG_TELEMETRY, TAG_RECORDING, TAG_SCRIPTS, NUM_ALLOC_TAGS };
+
+class AllocTracker {
+	static const char *const tagNames[NUM_ALLOC_TAGS];
+public:
+	static bool enabled(void);
+	static unsigned long long getAllocations(void); //Number of allocations of all threads since the start.
+	static long long getLiveBytes(const AllocTag &tag);
+	//Live bytes and allocation counts of the subsystems. At exit, live bytes are reported as leaks.
+	static void report(const bool &atExit);
+#ifdef ALLOC_TRACKING
+	static atomic<unsigned long long> allocations[NUM_ALLOC_TAGS];
+	static atomic<unsigned long long> frees[NUM_ALLOC_TAGS];
+	static atomic<long long> liveBytes[NUM_ALLOC_TAGS];
+	static thread_local int currentTag;
+#endif
+};
+
+class AllocScope {
+	int oldTag;
+public:
+	AllocScope(const AllocTag &tag);
+	~AllocScope();
+};
+
+//Allocations of the ticks. A steady-state tick should not allocate.
+class TickAllocStats {
+	unsigned long long before;
+	unsigned long long ticks;
+	unsigned long long allocatingTicks;
+	unsigned long long maxPerTick;
+public:
+	TickAllocStats();
+	void begin(void);
+	void end(void);
+	unsigned long long getAllocatingTicks(void);
+	void print(void);
+};
+//---
+
+//-> Transient data of a tick (hit events, render batches) is taken
+//   from the frame arena. It is a single block which is allocated once, allocation
+//   only bumps a pointer and everything is released by reset() at the next tick.
+class FrameArena {
+	char *memory;
+	size_t capacity;
+	size_t used;
+	size_t highWater; //Maximum used bytes since init.
+	unsigned int overflows; //Allocations which did not fit, they get NULL.
+public:
+	FrameArena();
+	~FrameArena();
+	void init(const size_t &capacity);
+	void *alloc(const size_t &size, const size_t &align);
+	template <typename T>
+	T *allocArray(const size_t &count);
+	void reset(void);
+	//-> Allocations after a mark are released by release(mark), so a part of a tick
+	//   (e.g. rendering) can give back its memory before the reset.
+	size_t getMark(void);
+	void release(const size_t &mark);
+	//---
+	size_t getHighWater(void);
+	size_t getCapacity(void);
+	unsigned int getOverflows(void);
+	void print(void);
+};
+
+//-> Fixed capacity array in the frame arena. When the arena is full the array has
+//   no capacity and push() fails, the arena counts it as an overflow.
+template <typename T>
+class ArenaArray {
+	T *data;
+	size_t count;
+	size_t capacity;
+public:
+	ArenaArray(FrameArena &arena, const size_t &capacity);
+	bool push(const T &item);
+	T &operator[](const size_t &i);
+	size_t size(void);
+	size_t getFree(void);
+	T *begin(void);
+};
+//---
+
+//-> Sort and sweep broad phase over the x axis. Boxes are kept in slots and the
+//   order of the slots is kept between the ticks. Entities move a little in a
+//   tick, so the order is nearly sorted and insertion sort takes a few moves.
+//   Pairs are only between the dynamic slots (from firstDynamic) and the others.
+class SweepAndPrune {
+	sf::FloatRect *boxes;
+	unsigned int *stamps; //Tick in which the box of the slot is set, slots of older ticks are removed.
+	bool *inOrder;
+	int *order; //Slots sorted by the left of their boxes.
+	int numOrder;
+	int capacity;
+	unsigned int stamp;
+	unsigned long long moves; //Insertion sort moves since init.
+public:
+	SweepAndPrune();
+	~SweepAndPrune();
+	void init(const int &capacity);
+	void begin(void); //New tick, boxes of the alive slots should be set again.
+	void setBox(const int &slot, const sf::FloatRect &box);
+	//Writes the pairs as (dynamic << 16 | static), sorted. Returns false if pairs is full.
+	bool query(const int &firstDynamic, ArenaArray<sf::Uint32> &pairs);
+	unsigned long long getMoves(void);
+};
+//---
+
+//-> Fixed number of threads which run the submitted tasks in order. Result of a
+//   task is taken from its future. A batch of chunks is kept in the members and
+//   run by the workers and the caller, so it allocates no task or future.
+class WorkerPool {
+	vector<thread> workers;
+	deque< function<void()> > tasks;
+	mutex lock;
+	condition_variable ready;
+	bool stopping;
+	//-> Running batch of forChunks, it is guarded by lock.
+	void (*batchRun)(void *body, const size_t &begin, const size_t &end);
+	void *batchBody;
+	size_t batchSize;
+	size_t batchChunk;
+	size_t batchNext; //Begin of the first chunk which is not taken.
+	size_t batchLeft; //Chunks which are not finished.
+	condition_variable batchDone;
+	mutex batchOwner; //Batches of many callers run one by one.
+	//---
+	void loop(void);
+	bool takeChunk(size_t &begin, size_t &end); //Lock should be held.
+	void finishChunk(void);
+	void runChunks(const size_t &n, const size_t &chunk, void (*run)(void *, const size_t &, const size_t &), void *body);
+public:
+	WorkerPool();
+	~WorkerPool();
+	void start(unsigned int numThreads); //0 means one thread per core.
+	void stop(void); //Waits the queued tasks.
+	unsigned int size(void);
+	template <typename F>
+	future<typename result_of<F()>::type> submit(F task);
+	//Calls body(begin, end) for the chunks of [0, n) on the workers and in this thread, returns when all are done.
+	template <typename F>
+	void forChunks(const size_t &n, const size_t &chunk, F &body);
+};
+//---
+
+//-> Textures of the game. Soldier frames are packed into a single atlas
+//   texture, a frame is selected with its rect.
+enum AssetId { ASSET_GRASS, ASSET_BARREL, ASSET_BAGS, ASSET_BULLET, ASSET_SOLDIER, NUM_ASSETS };
+//---
+
+//-> Layout of the asset archive. Header, page table and rect table are followed
+//   by the RGBA pixels of the pages and the font file. Pixels and font start at
+//   ASSET_ARCHIVE_ALIGN aligned offsets, so they can be used from the mapping directly.
+typedef struct _archiveHeader {
+	char magic[4];
+	sf::Uint32 version;
+	sf::Uint32 numPages;
+	sf::Uint32 numRects;
+	sf::Uint32 fontOffset;
+	sf::Uint32 fontSize;
+} archiveHeader;
+
+typedef struct _archivePage {
+	sf::Uint32 width;
+	sf::Uint32 height;
+	sf::Uint32 offset;
+	sf::Uint32 repeated;
+} archivePage;
+
+typedef struct _archiveRect {
+	sf::Int32 left;
+	sf::Int32 top;
+	sf::Int32 width;
+	sf::Int32 height;
+} archiveRect;
+//---
+
+//-> Layout of the map file. Header is followed by the positions of the barrels
+//   and the sandbags, the spatial index, the spawn table and the navigation grid.
+//   Index is a start offset per cell (one more than the cells) and the obstacle
+//   slots of the cells, sandbags then barrels as in the broad phase, ascending in
+//   a cell. Navigation grid has 1 for the cells without obstacles. Mask sizes of
+//   the obstacles and the soldier are saved, the index is valid only for them.
+typedef struct _mapHeader {
+	char magic[4];
+	sf::Uint32 version;
+	sf::Uint32 width;
+	sf::Uint32 height;
+	sf::Uint32 numBarrels;
+	sf::Uint32 numSandbags;
+	sf::Uint32 cellSize;
+	sf::Uint32 columns;
+	sf::Uint32 rows;
+	sf::Uint32 numCellItems;
+	sf::Uint32 numSpawns;
+	sf::Uint32 maskSizes[6]; //Width and height of the barrel, sandbag and soldier masks.
+} mapHeader;
+
+typedef struct _mapPoint {
+	float x;
+	float y;
+} mapPoint;
+//---
+
+//-> Alpha bitmask of a sprite, it is built once when the texture is loaded.
+//   Rows are packed 64 pixels per word, bit x of a row is the pixel x. Opaque
+//   is the bounding box of the set bits, it is tested before the bits.
+class CollisionMask {
+	sf::Uint64 *bits;
+	int width;
+	int height;
+	int words; //Words per row.
+	sf::IntRect opaque;
+	//64 bits of the row starting from the pixel start, pixels out of the row are 0.
+	sf::Uint64 rowBits(const int &y, const int &start) const;
+public:
+	CollisionMask();
+	~CollisionMask();
+	//Rect of the RGBA pixels is rotated clockwise by 0, 90, 180 or 270 degrees, like the sprite.
+	void build(	const sf::Uint8 *const pixels,
+				const unsigned int &stride,
+				const sf::IntRect &rect,
+				const int &rotation);
+	sf::Vector2u getSize(void) const;
+	const sf::IntRect &getOpaque(void) const;
+	//Positions are the fixed point top-left corners of the masks, they are rounded to whole pixels.
+	static bool overlap(const CollisionMask &a,
+						const sf::Vector2i &posA,
+						const CollisionMask &b,
+						const sf::Vector2i &posB);
+};
+//---
+
+//-> Every texture and the font are loaded once here and shared by the entities.
+//   Assets are loaded from the packed archive if it exists, otherwise from the
+//   loose png and ttf files.
+class AssetStore {
+	sf::Texture textures[NUM_ASSETS];
+	sf::IntRect rects[NUM_ASSETS - 1 + SOLDIER_FRAMES];
+	CollisionMask masks[NUM_ASSETS - 1 + SOLDIER_FRAMES]; //Same order as rects.
+	CollisionMask bulletMasks[4]; //Rotated bullet masks, indexed by Direction.
+	sf::Font font;
+	void *mapping; //Archive mapping, font uses it while the store is alive.
+	size_t mappingSize;
+	static const char *const fileNames[ASSET_SOLDIER]; //Png files of the single frame assets.
+	static int firstRect(const AssetId &id);
+	//Decodes the png files, soldier frames are copied into an atlas image.
+	static bool decodeFiles(const string &textureDir, sf::Image *const images, sf::IntRect *const rects);
+	void unmap(void);
+	//Masks of the rects of an asset, from its RGBA pixels. Background has no mask.
+	void buildMasks(const AssetId &id, const sf::Uint8 *const pixels, const unsigned int &stride);
+	//-> Asynchronous loading of the loose files. Jobs are the single frame
+	//   assets, then the soldier frames, font file is read by its own job.
+	sf::Image *decoded;
+	future<bool> *decodeJobs;
+	future<bool> fontJob;
+	char *fontData; //sf::Font reads it while the store is alive.
+	sf::Uint32 fontDataSize;
+	int numPending;
+	bool failed;
+	bool headless; //Only rects and masks are loaded, so no GL context is needed.
+	bool uploadDecoded(const int &job);
+	void waitJobs(void);
+	static bool readFile(const string &path, char *&data, sf::Uint32 &size);
+	//---
+public:
+	AssetStore();
+	~AssetStore();
+	bool loadFiles(const string &textureDir, const string &fontPath);
+	bool loadArchive(const string &archivePath);
+	void setHeadless(const bool &headless);
+	//-> Png files are decoded by the pool. uploadReady() should be called by the
+	//   window thread until it returns 0, it uploads at most maxUploads decoded
+	//   textures in a call. It returns the number of assets which are not loaded yet,
+	//   or -1 if an asset can not be loaded.
+	void loadFilesAsync(WorkerPool &pool, const string &textureDir, const string &fontPath);
+	int uploadReady(const int &maxUploads);
+	float getProgress(void);
+	//---
+	//Offline packer, writes the decoded assets into an archive.
+	static bool pack(const string &textureDir, const string &fontPath, const string &archivePath);
+	const sf::Texture &getTexture(const AssetId &id);
+	const sf::IntRect &getRect(const AssetId &id, const int &frame);
+	const sf::IntRect *getRects(const AssetId &id);
+	const CollisionMask *getMasks(const AssetId &id);
+	const CollisionMask *getBulletMasks(void);
+	const sf::Font &getFont(void);
+};
+//---
+
+//-> Mover of a collision test. Self is never hit, it is the soldier itself or the
+//   owner of the bullet. Team is the team of the soldier or of the owner, -1 means
+//   no team.
+typedef struct _collider {
+	const CollisionMask *mask;
+	sf::Vector2i pos; //Fixed point top-left of the mask.
+	const void *self;
+	int team;
+} collider;
+//---
+
+//-> Arena which is loaded from a map file instead of placing the entities
+//   randomly. File is mapped and used in place, nothing is built while loading.
+//   Obstacle queries of the walks and the bullets go through the spatial index,
+//   spawns are taken from the table, so the number of obstacles does not slow
+//   down a tick.
+class Barrel;
+class Sandbag;
+class GameMap {
+	void *mapping;
+	size_t mappingSize;
+	const mapHeader *header;
+	const mapPoint *obstacles; //Barrels then sandbags.
+	const sf::Uint32 *cellStart;
+	const sf::Uint32 *cellItems;
+	const mapPoint *spawns;
+	const sf::Uint8 *navigation;
+	void unmap(void);
+	//Cells touched by the box, clamped to the grid. Range is left, top, right, bottom and inclusive.
+	static void cellRange(const sf::FloatRect &box, const int &columns, const int &rows, int *const range);
+public:
+	GameMap();
+	~GameMap();
+	bool load(const string &path);
+	bool isLoaded(void) const;
+	bool matches(AssetStore &assets) const; //Masks of the assets are the ones which the index is built for.
+	//Exporter, the placed obstacles are written with their index, navigation grid and spawn table.
+	static bool save(	const string &path,
+						const sf::Vector2u &worldSize,
+						Barrel *const barrels,
+						Sandbag *const sandbags,
+						const int &nb,
+						const int &ns,
+						AssetStore &assets);
+	sf::Vector2u getSize(void) const;
+	int getNumBarrels(void) const;
+	int getNumSandbags(void) const;
+	sf::Vector2f getBarrel(const int &i) const;
+	sf::Vector2f getSandbag(const int &i) const;
+	//First obstacle slot which the mover of layer A collides with, or -1. Pairs are tested by the layer rules.
+	template <CollisionLayer A>
+	int findObstacle(const collider &mover, Barrel *const barrels, Sandbag *const sandbags) const;
+	bool isWalkable(const sf::Vector2f &point) const; //Points out of the map are not walkable.
+	unsigned int getNumSpawns(void) const;
+	sf::Vector2f getSpawn(const unsigned int &i) const; //Soldier there touches no obstacle, even with PADDING.
+};
+//---
+
+//Resident memory of the process in KB, read from /proc/self/statm.
+long residentKB(void);
+
 class Object {
 protected:
-	sf::RenderWindow *window;
-	sf::Texture texture;
+	const sf::Vector2u *worldSize; //Size of the arena, shared by the game.
+	const sf::Texture *texture; //Shared texture from the AssetStore.
 	sf::Sprite sprite;
-	sf::Vector2u xy_offset; //This will be used to shrink textures.
+	const CollisionMask *mask; //Alpha mask of the current sprite, shared from the AssetStore.
+	sf::Vector2i fixedPos; //Position of the simulation, the sprite is placed there only for drawing.
+	sf::Vector2i maskOffset; //Fixed point, from the position to the top-left of the drawn sprite.
 public:
-	void init(	sf::RenderWindow *const window,
-				const string &texturePath,
+	void init(	const sf::Vector2u *const worldSize,
+				const sf::Texture &texture,
 				const sf::Vector2f &pos,
-				const sf::Vector2u &xy_offset);
-	sf::Vector2f getPosition();
-	sf::Vector2u getSize();
-	void setPosition(const sf::Vector2f &newPos);
-	void paint();
+				const CollisionMask &mask);
+	sf::Vector2f getPosition(); //Fixed point position in pixels.
+	sf::Vector2i getFixedPos(void);
+	sf::Vector2u getSize(); //Size of the mask, rotated like the sprite.
+	const CollisionMask &getMask(void);
+	sf::Vector2f getMaskPos(void); //Top-left of the drawn sprite.
+	sf::Vector2i getFixedMaskPos(void);
+	sf::FloatRect getOpaqueBox(void); //Opaque pixels of the mask in the window, 1 px larger for rounding.
+	void setPosition(const sf::Vector2f &newPos); //Rounded to the fixed point grid.
+	void setFixedPos(const sf::Vector2i &newPos);
+	sf::FloatRect getBounds(void); //Drawn area of the sprite.
+	void paint(sf::RenderTarget &target);
+	//Appends the transformed sprite as a quad to a batch which uses the same texture.
+	bool appendQuad(ArenaArray<sf::Vertex> &batch);
 };
 
 class Sandbag : public Object {
@@ -49,66 +1077,138 @@ class Sandbag : public Object {
 
 class Barrel : public Object {
 	bool isVisible;
+	sf::Uint64 *hiddenHash; //Hash of the hidden barrels of the game, NULL if it is not kept.
+	sf::Uint64 hashKey;
 public:
 	Barrel();
 	bool getVisible(void);
 	void setVisible(const bool &visible);
+	//Key of the barrel is toggled in the hash when the barrel is hidden or shown.
+	void setHash(sf::Uint64 *const hiddenHash, const int &index);
 	//Paint of this class different from the Object Class' paint() method. Apply additional isVisible check.
-	void paint();
+	void paint(sf::RenderTarget &target);
 };
 
 class Bullet : public Object {
-	sf::Vector2f speedVector;
+	sf::Vector2i speedVector; //Fixed point move of a tick.
+	//-> Spawn data of the bullet. Position of the bullet can be computed
+	//   from these values, so snapshots send only them.
+	unsigned int id;
+	unsigned int age; //Number of moves since the bullet is fired.
+	Direction dir;
+	float speed;
+	sf::Vector2i spawnPos; //Fixed point.
+	//---
+	//Term of the bullet in the hash of its list is hashKey + age * hashStep, both are from the spawn data.
+	sf::Uint64 hashKey;
+	sf::Uint64 hashStep;
 public:
 	Bullet *next;
 	Bullet *prev;
 	Bullet();
-	~Bullet();
 	//Init of this class different from the Object Class' init() method. Takes additional speed parameter.
-	void init(	sf::RenderWindow *const window,
-				const string &texturePath,
-				const sf::Vector2f &pos,
+	void init(	const sf::Vector2u *const worldSize,
+				const sf::Texture &texture,
+				const CollisionMask *const masks,
+				const sf::Vector2i &pos,
 				const Direction &dir,
-				const float &speed);
+				const float &speed,
+				const unsigned int &id);
 	void move(void);
+	void save(bulletSnap &snap, const int &owner);
+	void restore(const bulletSnap &snap);
+	unsigned int getId(void);
+	sf::Uint64 getHashTerm(void);
+	sf::Uint64 getHashStep(void);
 };
 
 class Player; //Added also here because of circular dependancy of BulletList and Player
 class BulletList {
-	sf::RenderWindow *window;
-	string texturePath;
+	const sf::Vector2u *worldSize;
+	const GameMap *map; //Index of the obstacles, NULL if the arena is not loaded from a map.
+	const sf::Texture *texture;
+	const CollisionMask *masks; //Bullet masks, indexed by Direction.
+	Bullet *pool; //Bullets are taken from the pool, nothing is allocated while playing.
+	Bullet *freeList; //Unused bullets of the pool, linked with next pointers.
 	Bullet *list; //Head of the linked list
+	Bullet *tail; //Last node of the linked list
 	Player *owner; //Owner of the fired bullets.
+	int count; //Flying bullets.
+	sf::Uint64 hash; //Sum of the hash terms of the flying bullets.
+	sf::Uint64 hashStep; //Sum of their steps, it is added to the hash when all bullets move.
+	TelemetrySink *telemetry; //Hits are recorded if it is not NULL.
+	unsigned int *nextId; //Counter of the game, bullet ids are unique between its lists.
 public:
 	BulletList();
 	~BulletList();
-	void init(	sf::RenderWindow *const window,
-				const string &texturePath,
-				Player *const owner);
-	void add(	const sf::Vector2f &pos,
+	void init(	const sf::Vector2u *const worldSize,
+				const GameMap *const map,
+				const sf::Texture &texture,
+				const CollisionMask *const masks,
+				Player *const owner,
+				unsigned int *const nextId);
+	//Returns false if no bullet is fired, the state has no direction or the pool is empty.
+	bool add(	const sf::Vector2i &pos,
 				const int &state,
-				const float &speed); 
+				const float &speed);
+	void setTelemetry(TelemetrySink *const telemetry);
 	void remove(Bullet *temp);
+	void clear(void);
+	int size(void);
+	Bullet *getHead(void);
+	sf::Uint64 getHash(void);
+	//Recreates a bullet from its snapshot. Bullet is moved as many times as its age.
+	void load(const bulletSnap &snap);
+	//-> Players hit by the bullets are added to hits, they are reborn by the caller.
+	//   Pairs are the candidates of the broad phase, bullet slots of this list start
+	//   from firstSlot. If pairs is NULL then all entities are tested.
 	void update(Player *const players,
 				Barrel *const barrels,
 				Sandbag *const sandbags,
 				const int &np,
 				const int &nb,
+				const int &ns,
+				ArenaArray<hitEvent> &hits,
+				const sf::Uint32 *const pairs,
+				const size_t &numPairs,
+				const int &firstSlot);
+	//---
+	int getPoolIndex(Bullet *const bullet); //Index of the bullet in the pool, it does not change while the bullet flies.
+	//Bullets are added to the batch as quads, the batch is drawn by the caller.
+	void paint(ArenaArray<sf::Vertex> &batch);
+private:
+	Bullet *append(void); //Takes a bullet from the pool and appends it to the list.
+	//Narrow phase, hidden barrels and the owner are not hit.
+	bool isHit(	Bullet *const bullet,
+				const int &slot,
+				Player *const players,
+				Barrel *const barrels,
+				Sandbag *const sandbags,
+				const int &nb,
 				const int &ns);
 };
 
 class Player : public Object {
-	sf::Texture *textures;
+	const GameMap *map; //Spawns and the index of the obstacles, NULL if the arena is not loaded from a map.
+	const sf::IntRect *frames; //Rects of the soldier states in the soldier atlas.
+	const CollisionMask *masks; //Masks of the soldier states.
+	Random *rng; //Random generator of the game, used by reborn.
 	int state;
 	int s;
 	int oldDir; //To decide opposite direction movements in walk according to old direction of soldier.
 	int score;
+	int deaths; //Reborns, the hit effects are spawned from it.
+	int team; //-1 means no team, it is set by the game.
+	TelemetrySink *telemetry; //Shots and respawns are recorded if it is not NULL.
+	int id; //Index of the player in the records.
 public:
-	void init(	sf::RenderWindow *const window,
-				const string &textBasePath,
-				const int &numTextures,
-				const sf::Vector2f &pos,
-				const sf::Vector2u &xy_offset);
+	void init(	const sf::Vector2u *const worldSize,
+				const GameMap *const map,
+				Random *const rng,
+				const sf::Texture &atlas,
+				const sf::IntRect *const frames,
+				const CollisionMask *const masks,
+				const sf::Vector2f &pos);
 	void walk(	const float speed,
 				const Direction &dir,
 				Player *const players,
@@ -117,7 +1217,6 @@ public:
 				const int &np,
 				const int &nb,
 				const int &ns);
-	sf::Vector2u getSize(void); //Get texture size. This is different from the Object Class' getSize() method.
 	//To fire bullets.
 	void fire(BulletList *const list, const float &speed);
 	//After being hit by a bullet, then soldier will reborn at rand coordinate.
@@ -127,58 +1226,546 @@ public:
 				const int &np,
 				const int &nb,
 				const int &ns);
+	void reset(void); //State of a new match, position is set by the caller.
 	void incrementScore(void);
 	int getScore(void);
-	void paint(void);
+	int getDeaths(void);
+	void setTeam(const int &team);
+	int getTeam(void);
+	void setTelemetry(TelemetrySink *const telemetry, const int &id);
+	int getFrame(void); //Current state, index of the frame in the soldier atlas.
+	void save(playerSnap &snap);
+	void load(const playerSnap &snap);
+private:
+	void setFrame(void); //Texture rect and mask of the current state.
 };
 
-class Game{
-	float speed;
-	int numBarrels;
+//-> Effects of the renderer, they are not a part of the world. Particles are
+//   kept as a struct of arrays, so the update is a few loops over floats which
+//   the compiler can vectorize, and they are drawn as a single batch of quads.
+//   Dead particles are replaced with the last ones, so the live ones are packed.
+class ParticleSystem {
+	float *posX;
+	float *posY;
+	float *velX;
+	float *velY;
+	float *life; //Seconds left.
+	sf::Color *colors;
+	sf::Vertex *vertices;
+	size_t capacity;
+	size_t count;
+	Random rng; //Game's generator is a part of the world, so it is not used.
+	sf::FloatRect bounds; //Area of the built vertices.
+	sf::Int64 updateTime; //Microseconds of the last update and draw.
+	sf::Int64 drawTime;
+	void integrate(const size_t &begin, const size_t &end, const float &dt);
+public:
+	ParticleSystem();
+	~ParticleSystem();
+	void init(const size_t &capacity);
+	//Particles fly out of the center, at most maxSpeed pixels per second.
+	void spawn(const sf::Vector2f &center, const int &amount, const sf::Color &color, const float &maxSpeed);
+	//Moves the particles and builds their vertices. Pool is used for large systems, it may be NULL.
+	void update(const float &dt, WorkerPool *const pool);
+	void paint(sf::RenderTarget &target);
+	void clear(void);
+	size_t size(void);
+	sf::FloatRect getBounds(void);
+	sf::Int64 getUpdateTime(void);
+	sf::Int64 getDrawTime(void);
+};
+//---
+
+//-> A ray is the segment from "from" to "to". Hit slots are the slots of the
+//   obstacles, sandbags then barrels, and -1 means the ray reaches "to". t is the
+//   part of the segment before the hit, so the hit point is from + t * (to - from).
+typedef struct _rayQuery {
+	sf::Vector2f from;
+	sf::Vector2f to;
+} rayQuery;
+
+typedef struct _rayHit {
+	int slot;
+	float t;
+} rayHit;
+//---
+
+//-> Opaque boxes of the obstacles in a uniform grid. Obstacles do not move, so the
+//   grid is built once. Destroyed barrels are not opaque, the cells of a barrel
+//   are updated by sync() when its visibility is changed, so a tick costs nothing
+//   when no barrel is destroyed. Queries only read the grid, so a batch can be
+//   cast from many threads.
+class RaycastGrid {
+	sf::FloatRect *boxes; //Sandbags then barrels.
+	bool *opaque; //Visibility of the slots in the last sync.
+	sf::Uint32 *cellStart; //Slots of cell c are cellItems[cellStart[c]] to cellItems[cellStart[c + 1]].
+	sf::Uint32 *cellItems;
+	sf::Uint16 *blockers; //Opaque slots of the cells, slots of an empty cell are not tested.
+	sf::Uint32 *cellFill; //Next free item of the cells while building.
+	size_t itemCapacity;
+	int columns;
+	int rows;
 	int numSandbags;
-	int numPlayers;
-	int width;
-	int height;
+	int numBarrels;
+	unsigned long long updatedCells; //Cells changed by sync() since init.
+	void cellRange(const sf::FloatRect &box, int *const range) const; //Left, top, right, bottom and inclusive.
+	void castRange(const rayQuery *const queries, rayHit *const hits, const size_t &begin, const size_t &end) const;
+public:
+	RaycastGrid();
+	~RaycastGrid();
+	void init(const sf::Vector2u &worldSize, Sandbag *const sandbags, const int &ns, Barrel *const barrels, const int &nb);
+	//Obstacles are moved, the grid is built again in the storage of init.
+	void build(Sandbag *const sandbags, Barrel *const barrels);
+	void sync(Barrel *const barrels); //Barrels which are destroyed or restored since the last sync are updated.
+	//First opaque obstacle on the ray, the one with the lower slot if two are hit at the same point.
+	rayHit cast(const sf::Vector2f &from, const sf::Vector2f &to) const;
+	bool canSee(const sf::Vector2f &from, const sf::Vector2f &to) const;
+	//Hit of queries[i] is written to hits[i]. Pool is used for large batches, it may be NULL.
+	void castBatch(	const rayQuery *const queries,
+					rayHit *const hits,
+					const size_t &n,
+					WorkerPool *const pool,
+					const size_t &minParallel = RAYCAST_PARALLEL_MIN) const;
+	unsigned long long getUpdatedCells(void) const;
+	//Part of the segment before it enters the box, 0 if it starts in the box. False if it misses the box.
+	static bool intersect(const sf::FloatRect &box, const sf::Vector2f &from, const sf::Vector2f &dir, float &t);
+};
+//---
+
+//-> Scores of the players, separated with " - ". Glyphs of the digits, space and dash
+//   are rasterized once, so a changed score is only a few quad writes. Scores are
+//   written from the last player to the first, as "Player 2 - Player 1".
+class ScoreBoard {
 	sf::RenderWindow *window;
-	sf::Texture bgTexture;
-	sf::Sprite bgSprite;
-	sf::Font *font;
-	sf::Text *text;
-	Barrel *barrels;
-	Sandbag *sandbags;
-	Player *players;
-	BulletList *bullets;
-	//-> These methods are used for place the entities at the begining.
-	bool entityCollisionCheck(entityArray *const entities, const unsigned int &lastEntIndex);
-	sf::Vector2f getRandCoord(const sf::Vector2u &textureSize);
-	//---
-	void initBackGround(void);
-	void initEntities(void);
-	void initFontAndText(const string &fontPath, const int textSize);
-	void initGameEnv(void);
-	void drawBackground(void);
-	void drawEntities(void);
-	void drawText(void);
-	void update(void);
+	const sf::Font *font;
+	unsigned int textSize;
+	sf::Glyph glyphs[SCOREBOARD_GLYPHS]; //Digits, then space and dash.
+	int scores[SNAP_MAX_PLAYERS]; //Scores of the current layout.
+	int numScores;
+	sf::Vertex vertices[4 * SCOREBOARD_MAX_CHARS];
+	int numVertices;
+	sf::FloatRect bounds; //Drawn area of the current layout.
+	float appendGlyph(const int &glyph, const float &x, const float &baseline);
+	void layout(void);
 public:
-	Game(const float &speed, const int &w, const int &h, const int &nb, const int &ns, const int &np);
-	~Game();
-	void run2player(void); //This method will be used to start the 2 player shooter game.
+	ScoreBoard();
+	void init(	sf::RenderWindow *const window,
+				const sf::Font &font,
+				const unsigned int &textSize,
+				const int &numPlayers);
+	//Layout is rebuilt only if a score is changed, returns true if it is rebuilt.
+	bool update(Player *const players);
+	sf::FloatRect getBounds(void);
+	void paint(sf::RenderTarget &target);
 };
+//---
 
-//-> This function is used by 3 class, so it is not a method of them.
-//   I tried to write it as if it is a macro. But I do not know what the compiler
-//   will do.
-inline bool isCollide(	const sf::Vector2f &pos1,
-						const sf::Vector2u &size1,
-						const sf::Vector2f &pos2,
-						const sf::Vector2u &size2)
-{
-	unsigned int x_limit, y_limit; //holds limits for the collision check
-	float x_diff, y_diff; //holds difference of two points for collision check
-	//-> x_limit is the width of the leftmost entity's texture size.
-	//   x_diff is the x coord of rightmost minus x coord of leftmost entity.
-	if (pos1.x <= pos2.x) {
+//-> Bit level writer and reader over a caller supplied buffer. Nothing is
+//   allocated, if the buffer is too small then ok() returns false.
+class BitWriter {
+	unsigned char *buf;
+	unsigned int capacity; //In bytes
+	unsigned int bitPos;
+	bool overflow;
+public:
+	BitWriter(unsigned char *const buf, const unsigned int &capacity);
+	void write(unsigned int value, const int &bits);
+	void writeVar(unsigned int value); //7 bits per group with a continue bit.
+	void writeSigned(const int &value, const int &bits);
+	unsigned int bytes(void);
+	bool ok(void);
+};
+
+class BitReader {
+	const unsigned char *buf;
+	unsigned int size; //In bytes
+	unsigned int bitPos;
+	bool overflow;
+public:
+	BitReader(const unsigned char *const buf, const unsigned int &size);
+	unsigned int read(const int &bits);
+	unsigned int readVar(void);
+	int readSigned(const int &bits);
+	bool ok(void);
+};
+//---
+
+//-> Encodes the world snapshots as a compact bit stream. If a baseline is given,
+//   then only the differences against the baseline are written. Baseline must be
+//   the last snapshot acknowledged by the receiver, receiver decodes with the same one.
+class SnapshotCodec {
+	static int quantize(const float &value);
+	static void encodePlayers(BitWriter &w, const worldSnapshot &cur, const worldSnapshot *const base);
+	static void encodeBullets(BitWriter &w, const worldSnapshot &cur, const worldSnapshot *const base);
+public:
+	//Returns the number of written bytes, 0 means the buffer is too small.
+	static unsigned int encode(	const worldSnapshot &cur,
+								const worldSnapshot *const base,
+								unsigned char *const out,
+								const unsigned int &capacity);
+	//Returns false if the data is corrupted or baseline does not match.
+	static bool decode(	const unsigned char *const in,
+						const unsigned int &size,
+						const worldSnapshot *const base,
+						worldSnapshot &out);
+	//Position of the bullet is computed from its spawn data.
+	static sf::Vector2f bulletPosition(const bulletSnap &bullet);
+};
+//---
+
+//-> An entity which enters or leaves the interest of a client. Id is the index of
+//   a soldier, or the id of a bullet in the snapshots of that client.
+typedef struct _interestEvent {
+	bool bullet;
+	bool entered;
+	unsigned int id;
+} interestEvent;
+
+typedef struct _interestBullet {
+	unsigned int worldId;
+	unsigned int clientId;
+} interestBullet;
+//---
+
+//-> Soldiers and bullets of a snapshot in a uniform grid. It is built once in a
+//   tick for all clients, then a query visits only the cells around a view, so
+//   its cost depends on the entities near the view and not on all entities.
+class InterestGrid {
+	sf::Vector2u worldSize;
+	int columns;
+	int rows;
+	vector<sf::Uint32> cellStart; //Items of the cell c are from cellStart[c] to cellStart[c + 1].
+	vector<sf::Uint16> cellItems; //Soldiers are 0 to np - 1, bullets are np + their index in the snapshot.
+	vector<sf::Vector2f> positions; //Of the items.
+	vector<sf::Uint32> itemCells;
+	int cellOf(const sf::Vector2f &pos); //Positions out of the world are in the border cells.
+public:
+	InterestGrid();
+	void init(const sf::Vector2u &worldSize);
+	void build(const worldSnapshot &world);
+	//Items within radius of the center, in ascending order, so soldiers come first and bullets are in id order.
+	void query(const sf::Vector2f &center, const float &radius, vector<sf::Uint16> &found);
+};
+//---
+
+//-> Replication state of a client. Soldiers out of the interest keep the state
+//   which is sent last, so they cost 3 bits in a delta. Bullets are numbered
+//   again in the order they enter the interest, a bullet which enters is newer
+//   than every bullet of the baseline, as the SnapshotCodec expects.
+class InterestClient {
+	sf::Vector2f center;
+	float radius;
+	worldSnapshot *baseline; //Last acknowledged snapshot of the client.
+	bool hasBaseline;
+	unsigned int playerMask; //Soldiers in the interest.
+	vector<interestBullet> bullets; //Bullets in the interest, sorted by world id.
+	vector<interestBullet> nextBullets;
+	vector<sf::Uint16> found;
+	vector<interestEvent> events; //Events of the last update.
+	unsigned int nextClientId;
+public:
+	InterestClient();
+	~InterestClient();
+	void init(const float &radius); //Radius of the view, the margin is added to it.
+	void setCenter(const sf::Vector2f &center);
+	void update(const worldSnapshot &world, InterestGrid &grid, worldSnapshot &out);
+	void acknowledge(const worldSnapshot &sent); //Sent snapshot is the baseline of the next delta.
+	const worldSnapshot *getBaseline(void);
+	const vector<interestEvent> &getEvents(void);
+	unsigned int getPlayerMask(void);
+};
+//---
+
+//-> Hash of the world state for the determinism checks. Bullets of a list and
+//   hidden barrels are sums of terms, so the lists and the barrels replace only
+//   the terms of the changed entities. A bullet term is key + age * step, so a
+//   move of all bullets of a list adds the sum of their steps. Floats are hashed
+//   by their bits. world() hashes a snapshot in the same way as Game::getHash().
+//   A bullet is hashed by its spawn data and its age, not by its simulated
+//   position, so the hash does not catch a desync in the move of a bullet. The
+//   move is fixed point and restore() rebuilds the position from the same data.
+class StateHash {
+public:
+	static sf::Uint64 mix(sf::Uint64 value);
+	static sf::Uint64 pair(const float &a, const float &b);
+	static sf::Uint64 pair(const unsigned int &a, const unsigned int &b);
+	static sf::Uint64 start(const unsigned int &tick, const unsigned int &rngState, const unsigned int &nextBulletId);
+	static sf::Uint64 add(const sf::Uint64 &hash, const sf::Uint64 &term);
+	static sf::Uint64 player(const playerSnap &snap);
+	static void bullet(	const unsigned int &id,
+						const Direction &dir,
+						const float &speed,
+						const sf::Vector2f &spawnPos,
+						sf::Uint64 &key,
+						sf::Uint64 &step);
+	static sf::Uint64 barrel(const int &index);
+	static sf::Uint64 world(const worldSnapshot &snap);
+};
+//---
+
+//-> A live bullet in the grid of the bullet-vs-bullet pass. Cell is the cell of
+//   the top-left of its opaque box.
+typedef struct _gridBullet {
+	Bullet *bullet;
+	sf::FloatRect box;
+	sf::Int32 cellX;
+	sf::Int32 cellY;
+	unsigned char owner;
+	int team; //Team of the owner.
+	bool dead;
+} gridBullet;
+//---
+
+//-> Config file has "key = value" lines and "#" comments, keys are the names of
+//   the command line options without "--". Options are "--key value" or
+//   "--key=value", "--headless" and "--check-parallel" need no value. Command line is applied after the
+//   file, so an option overrides the same key of the file.
+class ScenarioLoader {
+	static bool parseInt(const string &value, const long &min, const long &max, long &out);
+	static bool setOption(scenario &config, const string &key, const string &value);
+public:
+	static void setDefaults(scenario &config);
+	static bool loadFile(scenario &config, const string &path);
+	static bool loadArgs(scenario &config, int argc, char **argv);
+	//Limits which do not depend on the assets, placement is checked by the game.
+	static bool validate(const scenario &config);
+	//Defaults, then "--config <file>" if it is given, then the other options.
+	static bool load(scenario &config, int argc, char **argv);
+	static void print(const scenario &config);
+};
+//---
+
+class Game{
+	int numBarrels;
+	int numSandbags;
+	int numPlayers;
+	int numHumans; //Players from 0 to numHumans are driven by the keyboard, others are bots.
+	int width;
+	int height;
+	sf::Vector2u worldSize; //Entities stay inside it, it is the window size if there is a window.
+	int tickRate;
+	float bulletSpeed;
+	unsigned int duration;
+	bool headless;
+	string textureDir;
+	string fontPath;
+	string archivePath;
+	string mapPath;
+	string exportPath;
+	string telemetryPath;
+	string recordPath;
+	string replayPath;
+	GameMap map;
+	unsigned int tick; //Number of simulation steps, bullets move once in every tick.
+	Random rng;
+	unsigned int matchSeed; //Obstacles of the current match are placed with it.
+	sf::RenderWindow *window;
+	WorkerPool workers;
+	AssetStore assets;
+	sf::Sprite bgSprite;
+	sf::Text *text; //Win message.
+	bool showMessage; //Win message is drawn instead of the scoreboard.
+	ScoreBoard scoreBoard;
+	ParticleSystem particles;
+	sf::Int64 particleTime; //Update and draw of the particles, in microseconds, summed over the frames.
+	Barrel *barrels;
+	Sandbag *sandbags;
+	Player *players;
+	BulletList *bullets;
+	FrameArena frameArena; //Transient data of the current tick.
+	CollisionMode collisionMode;
+	bool bulletCollisions;
+	bool capBullets; //Cap of the tick input which is simulated.
+	int numTeams;
+	BotScript botScript;
+	ScriptScheduler scripts; //Scripts of the bots, they run before the random bots in a tick.
+	unsigned int cancelledBullets; //Bullets removed by the bullet-vs-bullet pass.
+	sf::Uint64 hiddenBarrels; //Hash of the hidden barrels, the barrels keep it.
+	size_t sightParallelMin; //Smallest batch of sight rays which is cast on the worker pool.
+	unsigned int nextBulletId; //Id of the next fired bullet, it is shared by the bullet lists.
+	SweepAndPrune broadPhase; //Slots are sandbags, barrels, players and then bullets of the lists.
+	RaycastGrid sight; //Line of sight of the bots.
+	LoadGovernor governor; //Only the windowed game records its costs, other runs stay at the normal level.
+	TelemetrySink telemetry;
+	MatchRecorder recorder;
+	worldSnapshot *keyframe; //State of the tick which starts a block of the recording.
+	//-> Renderer keeps the last presented frame. Only the regions which are changed
+	//   since then are redrawn, and if nothing is changed then nothing is presented.
+	sf::RenderTexture *frame;
+	sf::Sprite frameSprite;
+	drawRecord *records; //Barrels, then players, as they are drawn in the frame.
+	sf::FloatRect *bulletRects; //Bullets in the frame.
+	int numBulletRects;
+	sf::FloatRect dirty[DIRTY_MAX_RECTS];
+	int numDirty;
+	bool fullRedraw;
+	bool needPresent; //Frame is not changed, but the window lost its content.
+	unsigned int presentedFrames;
+	unsigned int skippedFrames;
+	double redrawnArea; //Sum of the redrawn areas, in window sizes.
+	//---
+	//-> These methods are used for place the entities at the begining.
+	bool entityCollisionCheck(entityArray *const entities, const unsigned int &lastEntIndex);
+	sf::Vector2f getRandCoord(const sf::Vector2u &textureSize);
+	//---
+	entityArray *placement; //Placed entities, kept for the placement of the next match.
+	void initBackGround(void);
+	void initEntities(void);
+	void placeEntities(void); //Random positions, or the obstacles and the spawns of the map.
+	bool fitsArena(void); //Padded entities do not cover more than SCENARIO_MAX_DENSITY of the arena.
+	//Removes the bullets which touch a bullet of another player, returns the number of removed bullets.
+	int cancelBullets(void);
+	//Sets the boxes of the broad phase and finds the candidate pairs, false if they do not fit.
+	bool findCandidates(ArenaArray<sf::Uint32> &pairs);
+	void initAssets(void);
+	void drawLoading(const float &progress);
+	void initFontAndText(const int textSize);
+	void initGameEnv(void);
+	void startRecording(void);
+	void recordTick(const tickInput &input); //Called before the tick is simulated.
+	//-> Viewer of the recordings. Position is the number of simulated ticks of the
+	//   recording. They return false if the recording is corrupted.
+	bool stepReplay(RecordReader &reader, unsigned int &position);
+	bool seekReplay(RecordReader &reader, unsigned int &position, const unsigned int &target);
+	void applyKeyframe(RecordReader &reader);
+	//---
+	void driveBots(void);
+	//-> Scripted bots. Script state is not in the snapshots, so scripted games are not recorded.
+	void spawnScripts(void);
+	bool scriptWalk(const int &player, const Direction &dir); //Returns true if the soldier is moved.
+	Script patrol(const int player);
+	//---
+	bool canFire(const int &player); //False if the bullets are capped by the input of the tick.
+	//Steps this game with its sight rays on the worker pool and the serial copy, false if their hashes differ.
+	bool stepChecked(Game &serial, const tickInput &input);
+	//A tick of the windowed game, frame is rendered if the governor allows. Returns true if it is rendered.
+	bool runTick(const tickInput &input);
+	void invalidate(void); //Whole frame will be redrawn.
+	void addDirty(const sf::FloatRect &rect);
+	void collectDirty(void);
+	void drawBackground(void);
+	void drawEntities(const sf::FloatRect *const region, ArenaArray<sf::Vertex> &batch);
+	void drawText(void);
+	void redraw(const sf::FloatRect *const region, ArenaArray<sf::Vertex> &batch);
+	void update(void);
+	friend int benchRollback(void);
+	friend int benchAssets(void);
+	friend int benchAlloc(void);
+	friend int benchRender(void);
+	friend int benchBroadphase(void);
+	friend int benchMap(void);
+	friend int benchBullets(void);
+	friend int benchRaycast(void);
+	friend int benchReset(void);
+	friend int benchGovernor(void);
+	friend int benchTelemetry(void);
+	friend int benchReplay(void);
+	friend int benchScripts(void);
+	friend int benchInterest(void);
+	friend int benchHash(void);
+	friend int benchFixed(void);
+public:
+	Game(const scenario &config);
+	~Game();
+	void run2player(void); //This method will be used to start the shooter game with the keyboard players and bots.
+	//Bots play for the duration of the scenario, nothing is drawn. A serial copy checks the parallel ticks if it is given.
+	void runHeadless(Game *const serial = NULL);
+	void runReplay(void); //Recording of the scenario is played in the window.
+	bool exportMap(void); //Entities are placed and saved as a map file, nothing is played.
+	//New match in the same storage, it is the match of a new game with the same seed.
+	void reset(const unsigned int &seed);
+	//-> World state of the current tick, to send it over network or to show it to spectators.
+	void captureSnapshot(worldSnapshot &snap);
+	void applySnapshot(const worldSnapshot &snap);
+	//---
+	//Simulates a single tick with the given inputs. Nothing is drawn, so it can be used for re-simulation.
+	void step(const tickInput &input);
+	void setCollisionMode(const CollisionMode &mode);
+	sf::Uint64 getHash(void); //Hash of the world state, it is cheap enough for every tick.
+};
+
+//-> GGPO style rollback for 2 player peer-to-peer matches. Local input is used
+//   immediately, input of the remote player is predicted by repeating its last
+//   known input. When the real remote input of an old tick arrives and it is
+//   different from the prediction, the world is restored to that tick and the
+//   ticks are simulated again.
+class RollbackSession {
+	Game *game;
+	int localPlayer;
+	unsigned int currentTick; //Next tick to simulate.
+	unsigned int confirmedTick; //Remote inputs are known before this tick.
+	worldSnapshot *states; //State before the tick t is at t % (ROLLBACK_MAX_FRAMES + 1).
+	tickInput inputs[ROLLBACK_MAX_FRAMES + 1]; //Inputs used in the simulation of the tick t.
+	tickInput remoteInputs[2 * (ROLLBACK_MAX_FRAMES + 1)]; //Received remote inputs, indexed with tick.
+	tickInput lastRemote;
+	unsigned int rollbackFrom; //First tick to re-simulate, equals to currentTick if there is no misprediction.
+	unsigned int rollbacks;
+	unsigned int resimulatedTicks;
+	void predict(tickInput &input, const unsigned int &tick);
+public:
+	RollbackSession();
+	~RollbackSession();
+	void init(Game *const game, const int &localPlayer);
+	//Returns false if the session is ROLLBACK_MAX_FRAMES ahead of the remote player, then the tick should be retried later.
+	bool advance(const tickInput &local);
+	//Remote inputs should arrive in tick order. Returns false if the input can not be stored.
+	bool addRemoteInput(const unsigned int &tick, const tickInput &remote);
+	//Re-simulates the mispredicted ticks, advance() also calls it.
+	void resimulate(void);
+	unsigned int getTick(void);
+	unsigned int getRollbacks(void);
+	unsigned int getResimulatedTicks(void);
+};
+//---
+
+//-> Benchmarks, they are run with "./game --bench <name>" and do not open the game window.
+int runBenchmark(const string &name);
+int benchSnapshot(void);
+int benchRollback(void);
+int benchAssets(void);
+int benchAlloc(void);
+int benchRender(void);
+int benchBroadphase(void);
+int benchMap(void);
+int benchBullets(void);
+int benchParticles(void);
+int benchRaycast(void);
+int benchReset(void);
+int benchGovernor(void);
+int benchTelemetry(void);
+int benchReplay(void);
+int benchScripts(void);
+int benchInterest(void);
+int benchHash(void);
+int benchFixed(void);
+scenario benchScenario(const int &w, const int &h, const int &nb, const int &ns, const int &np);
+bool equalSnapshots(const worldSnapshot &a, const worldSnapshot &b);
+//---
+
+//-> Conversions of the fixed point coordinates. Pixels are rounded like
+//   floor(x + 0.5), the shift of a negative value is arithmetic in C++20.
+inline int toFixed(const float &value) { return static_cast<int>(floor(value * FIXED_ONE + 0.5f)); }
+inline sf::Vector2i toFixed(const sf::Vector2f &value) { return sf::Vector2i(toFixed(value.x), toFixed(value.y)); }
+inline sf::Vector2f toFloat(const sf::Vector2i &value)
+{
+	return sf::Vector2f(CAST_FLOAT(value.x) / FIXED_ONE, CAST_FLOAT(value.y) / FIXED_ONE);
+}
+inline int toPixel(const int &value) { return (value + FIXED_ONE / 2) >> FIXED_SHIFT; }
+//---
+
+//-> This function is used by 3 class, so it is not a method of them.
+//   I tried to write it as if it is a macro. But I do not know what the compiler
+//   will do.
+inline bool isCollide(	const sf::Vector2f &pos1,
+						const sf::Vector2u &size1,
+						const sf::Vector2f &pos2,
+						const sf::Vector2u &size2)
+{
+	unsigned int x_limit, y_limit; //holds limits for the collision check
+	float x_diff, y_diff; //holds difference of two points for collision check
+	//-> x_limit is the width of the leftmost entity's texture size.
+	//   x_diff is the x coord of rightmost minus x coord of leftmost entity.
+	if (pos1.x <= pos2.x) {
 		x_diff = pos2.x - pos1.x;
 		x_limit = size1.x;
 	} else {
@@ -208,1127 +1795,7650 @@ inline bool isCollide(	const sf::Vector2f &pos1,
 }
 //---
 
-
-//////////////////////////////////// Definitions of Object Class
-void Object::init(	sf::RenderWindow *const window,
-					const string &texturePath,
-					const sf::Vector2f &pos,
-					const sf::Vector2u &xy_offset)
+//-> Pixel-accurate collision, masks are placed at the given fixed point positions.
+inline bool isCollide(	const CollisionMask &mask1,
+						const sf::Vector2i &pos1,
+						const CollisionMask &mask2,
+						const sf::Vector2i &pos2)
 {
-	//-> Fill the class' attributes and load texture from file.
-	//   And create the sprite.
-	this->window = window;
-	this->xy_offset = xy_offset;
-	if (!texture.loadFromFile(texturePath)) {
-		cout << "[ERROR] Object texture loading error." << endl;
+	return CollisionMask::overlap(mask1, pos1, mask2, pos2);
+}
+//---
+
+//-> Targets of the pair handlers, LayerOf gives the layer of a target type.
+template <typename T> struct LayerOf;
+template <> struct LayerOf<Sandbag> { static const CollisionLayer layer = LAYER_SANDBAG; };
+template <> struct LayerOf<Barrel> { static const CollisionLayer layer = LAYER_BARREL; };
+template <> struct LayerOf<Player> { static const CollisionLayer layer = LAYER_SOLDIER; };
+inline bool isSolid(Sandbag &) { return 1; }
+inline bool isSolid(Barrel &barrel) { return barrel.getVisible(); } //Destroyed barrels are not hit.
+inline bool isSolid(Player &) { return 1; }
+inline int teamOf(Sandbag &) { return -1; }
+inline int teamOf(Barrel &) { return -1; }
+inline int teamOf(Player &player) { return player.getTeam(); }
+//---
+
+//-> Pair handler of a mover layer and a target layer. Pairs which never collide
+//   get the empty specialization, so nothing is compiled for them. Team check is
+//   a constant of the pair, it is removed by the compiler if the pair has no team rule.
+template <CollisionLayer A, CollisionLayer B, bool Active = layersCollide(A, B)>
+struct PairHandler {
+	template <typename T>
+	static inline bool test(const collider &mover, T &target)
+	{
+		if ( &target == mover.self || !isSolid(target) ) {
+			return 0;
+		}
+		if ( teamFiltered(A, B) && mover.team >= 0 && teamOf(target) == mover.team ) {
+			return 0;
+		}
+		return isCollide(*mover.mask, mover.pos, target.getMask(), target.getFixedMaskPos());
 	}
-	sprite.setTexture(texture);
-	sprite.setPosition(pos);
-	//---
+	template <typename T>
+	static inline int first(const collider &mover, T *const targets, const int &n)
+	{
+		for ( int i = 0 ; i < n ; i++ ) {
+			if ( test(mover, targets[i]) ) {
+				return i;
+			}
+		}
+		return -1;
+	}
+};
+
+template <CollisionLayer A, CollisionLayer B>
+struct PairHandler<A, B, false> {
+	template <typename T>
+	static inline bool test(const collider &, T &) { return 0; }
+	template <typename T>
+	static inline int first(const collider &, T *const, const int &) { return -1; }
+};
+
+//First target which collides with the mover, or -1.
+template <CollisionLayer A, typename T>
+inline int firstCollision(const collider &mover, T *const targets, const int &n)
+{
+	return PairHandler<A, LayerOf<T>::layer>::first(mover, targets, n);
 }
 
-inline sf::Vector2f Object::getPosition()
+template <CollisionLayer A, typename T>
+inline bool collidesWith(const collider &mover, T &target)
 {
-	return sprite.getPosition();
+	return PairHandler<A, LayerOf<T>::layer>::test(mover, target);
 }
+//---
+
+
+//////////////////////////////////// Definitions of AllocTracker and AllocScope Classes
+const char *const AllocTracker::tagNames[NUM_ALLOC_TAGS] = {"general", "assets", "entities", "simulation", "render", "input", "rollback", "telemetry", "recording", "scripts"};
 
-//-> In this method, texture size of the object will be shrunk
-//   according to the its xy_offset attribute.
-inline sf::Vector2u Object::getSize()
+#ifdef ALLOC_TRACKING
+atomic<unsigned long long> AllocTracker::allocations[NUM_ALLOC_TAGS];
+atomic<unsigned long long> AllocTracker::frees[NUM_ALLOC_TAGS];
+atomic<long long> AllocTracker::liveBytes[NUM_ALLOC_TAGS];
+thread_local int AllocTracker::currentTag = TAG_GENERAL;
+
+//-> Size and tag of an allocation are kept in a header before the returned
+//   block. Header is 16 bytes, so alignment of malloc is kept. They are not
+//   inlined, so the compiler does not see the header access as out of bounds.
+typedef struct _allocHeader {
+	size_t size;
+	size_t tag;
+} allocHeader;
+
+__attribute__((noinline)) void *operator new(size_t size)
 {
-	sf::Vector2u size = texture.getSize();
-	size.x -= xy_offset.x;
-	size.y -= xy_offset.y;
-	return size;
+	allocHeader *header = static_cast<allocHeader *>(malloc(sizeof(allocHeader) + size));
+	if ( header == NULL ) {
+		throw bad_alloc();
+	}
+	header->size = size;
+	header->tag = AllocTracker::currentTag;
+	AllocTracker::allocations[header->tag].fetch_add(1, memory_order_relaxed);
+	AllocTracker::liveBytes[header->tag].fetch_add(size, memory_order_relaxed);
+	return header + 1;
 }
 
-inline void Object::setPosition(const sf::Vector2f &newPos)
+__attribute__((noinline)) void operator delete(void *ptr) noexcept
 {
-	sprite.setPosition(newPos);
+	if ( ptr == NULL ) {
+		return;
+	}
+	allocHeader *header = static_cast<allocHeader *>(ptr) - 1;
+	AllocTracker::frees[header->tag].fetch_add(1, memory_order_relaxed);
+	AllocTracker::liveBytes[header->tag].fetch_sub(header->size, memory_order_relaxed);
+	free(header);
 }
 
-inline void Object::paint()
+void *operator new[](size_t size) { return operator new(size); }
+
+void operator delete[](void *ptr) noexcept { operator delete(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { operator delete(ptr); }
+
+void operator delete[](void *ptr, size_t) noexcept { operator delete(ptr); }
+//---
+
+inline bool AllocTracker::enabled(void) { return 1; }
+
+unsigned long long AllocTracker::getAllocations(void)
 {
-	window->draw(sprite);
+	unsigned long long total = 0;
+	for ( int i = 0 ; i < NUM_ALLOC_TAGS ; i++ ) {
+		total += allocations[i].load(memory_order_relaxed);
+	}
+	return total;
 }
 
+long long AllocTracker::getLiveBytes(const AllocTag &tag) { return liveBytes[tag].load(memory_order_relaxed); }
 
-//////////////////////////////////// Definitions of Sandbag Class
-//Sandbag class is directly inherited from Object Class. There is no additional changes.
+AllocScope::AllocScope(const AllocTag &tag) : oldTag(AllocTracker::currentTag) { AllocTracker::currentTag = tag; }
 
+AllocScope::~AllocScope() { AllocTracker::currentTag = oldTag; }
+#else
+inline bool AllocTracker::enabled(void) { return 0; }
 
-//////////////////////////////////// Definitions of Barrel Class
-//Set as visible in construction.
-Barrel::Barrel() : isVisible(1) {};
+unsigned long long AllocTracker::getAllocations(void) { return 0; }
 
-inline bool Barrel::getVisible(void) { return isVisible; };
+long long AllocTracker::getLiveBytes(const AllocTag &) { return 0; }
 
-inline void Barrel::setVisible(const bool &visible) { isVisible = visible; };
+AllocScope::AllocScope(const AllocTag &) : oldTag(0) {}
 
-//This is the overrided paint method. Additionally check the barrel's visibility.
-inline void Barrel::paint() { if (isVisible == 1) { window->draw(sprite); } };
+AllocScope::~AllocScope() {}
+#endif
 
+void AllocTracker::report(const bool &atExit)
+{
+#ifdef ALLOC_TRACKING
+	cout << (atExit ? "[ALLOC] Leak summary at exit:" : "[ALLOC] Live memory:") << endl;
+	for ( int i = 0 ; i < NUM_ALLOC_TAGS ; i++ ) {
+		cout << "[ALLOC]   " << tagNames[i] << ": " << liveBytes[i] << " bytes live, "
+			 << allocations[i] << " allocations, " << frees[i] << " frees" << endl;
+	}
+#else
+	(void)atExit;
+#endif
+}
 
-//////////////////////////////////// Definitions of Bullet Class
-//NULL is assigned to next and prev pointers in construction.
-Bullet::Bullet() : next(NULL), prev(NULL) {}
 
-//This is overrided init method. This method decides direction and position of the bullet.
-void Bullet::init(	sf::RenderWindow *const window,
-				const string &texturePath,
-				const sf::Vector2f &pos,
-				const Direction &dir,
-				const float &speed)
+//////////////////////////////////// Definitions of TickAllocStats Class
+TickAllocStats::TickAllocStats() : before(0), ticks(0), allocatingTicks(0), maxPerTick(0) {}
+
+inline void TickAllocStats::begin(void) { before = AllocTracker::getAllocations(); }
+
+inline void TickAllocStats::end(void)
 {
-	sf::Vector2u bulletSize;
-	this->window = window;
-	if (!texture.loadFromFile(texturePath)) {
-		cout << "[ERROR] Bullet texture loading error." << endl;
+	unsigned long long count = AllocTracker::getAllocations() - before;
+	ticks++;
+	if ( count > 0 ) {
+		allocatingTicks++;
 	}
-	bulletSize = texture.getSize();
-	sprite.setTexture(texture);
+	if ( count > maxPerTick ) {
+		maxPerTick = count;
+	}
+}
 
-	//-> Here, origin of the bullet sprite is assigned according to the
-	//   rotation of the bullet. After the rotation, origin always is the
-	//   left-top of the rotated sprite. AND ALSO, position of the bullet
-	//   are adjusted so bullet texture looks like it is come from the
-	//   gun.
-	//   Normally xy_offset is used to shrink shadow effect etc. for
-	//   collision check. But in bullet we use it to set rotated bullets
-	//   size correctly.
-	switch (dir) {
-		case UP:
-			speedVector = sf::Vector2f(0, -speed);
-			sprite.setPosition(pos);
-			sprite.move(30,-25);
-			xy_offset.x = 0;
-			xy_offset.y = 0;
-			break;
-		case DOWN:
-			speedVector = sf::Vector2f(0, speed);
-			sprite.setOrigin(bulletSize.x - 1, bulletSize.y - 1);
-			sprite.rotate(180);
-			sprite.setPosition(pos);
-			sprite.move(0,60);
-			xy_offset.x = 0;
-			xy_offset.y = 0;
-			break;
-		case LEFT:
-			speedVector = sf::Vector2f(-speed, 0);
-			sprite.setOrigin(bulletSize.x - 1, 0);
-			sprite.rotate(270);
-			sprite.setPosition(pos);
-			sprite.move(-40,10);
-			xy_offset.x = -20;
-			xy_offset.y = 20;
-			break;
-		case RIGHT:
-			speedVector = sf::Vector2f(speed, 0);
-			sprite.setOrigin(0, bulletSize.y - 1);
-			sprite.rotate(90);
-			sprite.setPosition(pos);
-			sprite.move(55,45);
-			xy_offset.x = -20;
-			xy_offset.y = 20;
-			break;
-		default:
-			break;
+inline unsigned long long TickAllocStats::getAllocatingTicks(void) { return allocatingTicks; }
+
+void TickAllocStats::print(void)
+{
+	if ( !AllocTracker::enabled() ) {
+		return;
 	}
-	//---
+	cout << "[ALLOC] " << ticks << " ticks, " << allocatingTicks << " of them allocated, max "
+		 << maxPerTick << " allocations in a tick." << endl;
+}
+
+
+//////////////////////////////////// Definitions of FrameArena Class
+FrameArena::FrameArena() : memory(NULL), capacity(0), used(0), highWater(0), overflows(0) {}
+
+FrameArena::~FrameArena() { delete [] memory; }
+
+void FrameArena::init(const size_t &capacity)
+{
+	delete [] memory;
+	memory = new char[capacity];
+	this->capacity = capacity;
+	used = 0;
+	highWater = 0;
+	overflows = 0;
 }
 
-//-> This destructor is very critical.
-//   Removed bullet's next and prev nodes are changed according to the
-//   its values.
-Bullet::~Bullet() {
-	if ( prev != NULL && next != NULL ) {
-		prev->next = next;
-		next->prev = prev;
-	} else if ( prev == NULL && next != NULL ) {
-		next->prev = NULL;
-	} else if ( prev != NULL && next == NULL ) {
-		prev->next = NULL;
+inline void *FrameArena::alloc(const size_t &size, const size_t &align)
+{
+	size_t start = (used + align - 1) & ~(align - 1);
+	if ( start + size > capacity ) {
+		overflows++;
+		return NULL;
 	}
+	used = start + size;
+	if ( used > highWater ) {
+		highWater = used;
+	}
+	return memory + start;
 }
-//---
 
-void Bullet::move(void)
+template <typename T>
+inline T *FrameArena::allocArray(const size_t &count)
 {
-	sprite.move(speedVector);
+	return static_cast<T *>(alloc(count * sizeof(T), alignof(T)));
 }
 
-//////////////////////////////////// Definitions of BulletList Class
-//NULL is assigned to list pointer in construction.
-BulletList::BulletList() : list(NULL) {}
-
-//-> Destructor prevents memory leaks. It removes everything from the list.
-BulletList::~BulletList() {
-	if ( list != NULL ) {
-		Bullet *temp = list;
-		while ( list != NULL ) {
-			list = temp->next;
-			delete temp;
-			temp = list;
-		}
+inline void FrameArena::reset(void) { used = 0; }
+
+inline size_t FrameArena::getMark(void) { return used; }
+
+inline void FrameArena::release(const size_t &mark) { used = mark; }
+
+inline size_t FrameArena::getHighWater(void) { return highWater; }
+
+inline size_t FrameArena::getCapacity(void) { return capacity; }
+
+inline unsigned int FrameArena::getOverflows(void) { return overflows; }
+
+void FrameArena::print(void)
+{
+	cout << "[ARENA] High-water mark " << highWater << " of " << capacity << " bytes, "
+		 << overflows << " overflows." << endl;
+}
+
+
+//////////////////////////////////// Definitions of ArenaArray Class
+//Items are not constructed, the arrays hold plain structs and pointers.
+template <typename T>
+inline ArenaArray<T>::ArenaArray(FrameArena &arena, const size_t &capacity) : count(0)
+{
+	data = arena.allocArray<T>(capacity);
+	this->capacity = (data != NULL) ? capacity : 0;
+}
+
+template <typename T>
+inline bool ArenaArray<T>::push(const T &item)
+{
+	if ( count == capacity ) {
+		return 0;
 	}
+	data[count++] = item;
+	return 1;
 }
-//---
 
-//Classic init.
-void BulletList::init(sf::RenderWindow *const window, const string &texturePath, Player *const owner)
+template <typename T>
+inline T &ArenaArray<T>::operator[](const size_t &i) { return data[i]; }
+
+template <typename T>
+inline size_t ArenaArray<T>::size(void) { return count; }
+
+template <typename T>
+inline size_t ArenaArray<T>::getFree(void) { return capacity - count; }
+
+template <typename T>
+inline T *ArenaArray<T>::begin(void) { return data; }
+
+
+//////////////////////////////////// Definitions of SweepAndPrune Class
+SweepAndPrune::SweepAndPrune() :	boxes(NULL),
+									stamps(NULL),
+									inOrder(NULL),
+									order(NULL),
+									numOrder(0),
+									capacity(0),
+									stamp(0),
+									moves(0) {}
+
+SweepAndPrune::~SweepAndPrune()
 {
-	this->window = window;
-	this->texturePath = texturePath;
-	this->owner = owner;
+	delete [] boxes;
+	delete [] stamps;
+	delete [] inOrder;
+	delete [] order;
 }
 
-//-> This method add new bullet to the bullets' linked list.
-//   It decides the bullet's position according to the state of soldier.
-void BulletList::add(const sf::Vector2f &pos, const int &state, const float &speed)
+void SweepAndPrune::init(const int &capacity)
 {
-	Direction dir;
-	//-> Direction decision according to the state.
-	switch (state) {
-		case 0:
-		case 7:
-		case 8:
-			dir = UP;
-			break;
-		case 2:
-		case 9:
-		case 10:
-			dir = RIGHT;
-			break;
-		case 4:
-		case 3:
-		case 11:
-			dir = DOWN;
-			break;
-		case 6:
-		case 12:
-		case 13:
-			dir = LEFT;
-			break;
-		default:
-			return;
+	delete [] boxes;
+	delete [] stamps;
+	delete [] inOrder;
+	delete [] order;
+	this->capacity = capacity;
+	boxes = new sf::FloatRect[capacity];
+	stamps = new unsigned int[capacity];
+	inOrder = new bool[capacity];
+	order = new int[capacity];
+	for ( int i = 0 ; i < capacity ; i++ ) {
+		stamps[i] = 0;
+		inOrder[i] = 0;
 	}
-	//---
+	numOrder = 0;
+	stamp = 0;
+	moves = 0;
+}
 
-	//-> Linked list node addition.
-	if ( list != NULL ) {
-		Bullet *temp = list;
-		while ( temp->next != NULL ) {
-			temp = temp->next;
-		}
-		temp->next = new Bullet;
-		temp->next->prev = temp;
-		temp->next->init(window, texturePath, pos, dir, speed);
-	} else {
-		list = new Bullet;
-		list->init(window, texturePath, pos, dir, speed);
+inline void SweepAndPrune::begin(void) { stamp++; }
+
+inline void SweepAndPrune::setBox(const int &slot, const sf::FloatRect &box)
+{
+	boxes[slot] = box;
+	stamps[slot] = stamp;
+	if ( !inOrder[slot] ) {
+		inOrder[slot] = 1;
+		order[numOrder++] = slot;
 	}
-	//---
 }
-//---
 
-//-> This method just removes given node and adjust the list pointer.
-//   Removed node's next and prev pointers are changed in bullet's destructor.
-void BulletList::remove(Bullet *temp)
+bool SweepAndPrune::query(const int &firstDynamic, ArenaArray<sf::Uint32> &pairs)
 {
-	if ( temp != NULL ) {
-		if ( temp->prev == NULL && temp->next == NULL ) {
-			list = NULL;
-		} else if ( temp->prev == NULL && temp->next != NULL ) {
-			list = temp->next;
+	//-> Slots which are not set in this tick are removed.
+	int n = 0;
+	for ( int i = 0 ; i < numOrder ; i++ ) {
+		if ( stamps[order[i]] == stamp ) {
+			order[n++] = order[i];
+		} else {
+			inOrder[order[i]] = 0;
+		}
+	}
+	numOrder = n;
+	//---
+	//-> Insertion sort, new slots are at the end.
+	for ( int i = 1 ; i < numOrder ; i++ ) {
+		int slot = order[i];
+		float left = boxes[slot].left;
+		int j = i - 1;
+		while ( j >= 0 && boxes[order[j]].left > left ) {
+			order[j + 1] = order[j];
+			j--;
+			moves++;
+		}
+		order[j + 1] = slot;
+	}
+	//---
+	//-> Sweep, boxes after a box are tested until one starts after its right.
+	for ( int i = 0 ; i < numOrder ; i++ ) {
+		const int a = order[i];
+		const sf::FloatRect &boxA = boxes[a];
+		const float right = boxA.left + boxA.width;
+		for ( int j = i + 1 ; j < numOrder && boxes[order[j]].left <= right ; j++ ) {
+			const int b = order[j];
+			if ( (a >= firstDynamic) == (b >= firstDynamic) ) {
+				continue;
+			}
+			const sf::FloatRect &boxB = boxes[b];
+			if ( boxA.top <= boxB.top + boxB.height && boxB.top <= boxA.top + boxA.height ) {
+				sf::Uint32 pair = (a >= firstDynamic) ? (static_cast<sf::Uint32>(a) << 16 | b) : (static_cast<sf::Uint32>(b) << 16 | a);
+				if ( !pairs.push(pair) ) {
+					return 0;
+				}
+			}
 		}
-		delete temp;
 	}
+	//---
+	sort(pairs.begin(), pairs.begin() + pairs.size());
+	return 1;
 }
-//---
 
-//-> This method first check the collision of the bullets in the list.
-//   Then move bullets.
-void BulletList::update(Player *const players,
-						Barrel *const barrels,
-						Sandbag *const sandbags,
-						const int &np,
-						const int &nb,
-						const int &ns)
+inline unsigned long long SweepAndPrune::getMoves(void) { return moves; }
+
+
+//////////////////////////////////// Definitions of Random Class
+Random::Random() : state(1) {}
+
+//-> Seed is mixed (splitmix32), so close seeds give unrelated sequences. State can not be 0.
+void Random::seed(const unsigned int &seed)
 {
-	Bullet *temp = list; //Holds the list
-	Bullet *newTemp; //Holds the next node of the removed temp.
-	while ( temp != NULL ) {
-		//Get position and size of the bullet
-		sf::Vector2f bulletPos = temp->getPosition();
-		sf::Vector2u bulletSize = temp->getSize();
-
-		//-> If there is a collision then test variable will be set.
-		//   Bullet will be removed and while loop will be reset without further collision check.
-		int test = 0;
-		for ( int i = 0 ; i < ns ; i++ ) {
-			//-> Collision with sandbag just removes bullet.
-			if ( isCollide(bulletPos, bulletSize, sandbags[i].getPosition(), sandbags[i].getSize()) ) {
-				newTemp = temp->next;
-				remove(temp);
-				temp = newTemp;
-				test = 1;
-				break;
-			} else {
-				continue;
-			}
-			//---
-		}
-		if ( test == 1 ) {
-			continue;
-		}
+	unsigned int z = seed + 0x9e3779b9u;
+	z = (z ^ (z >> 16)) * 0x85ebca6bu;
+	z = (z ^ (z >> 13)) * 0xc2b2ae35u;
+	z ^= z >> 16;
+	state = (z != 0) ? z : 1;
+}
+//---
 
-		for ( int i = 0 ; i < nb ; i++ ) {
-			//Check whether barrel is visible or not.
-			if ( barrels[i].getVisible() == 0 ) {
-				continue;
-			}
-			//-> If there is a collision with barrel, then both barrel and bullet will be removed.
-			if ( isCollide(bulletPos, bulletSize, barrels[i].getPosition(), barrels[i].getSize()) ) {
-				barrels[i].setVisible(0);
-				newTemp = temp->next;
-				remove(temp);
-				temp = newTemp;
-				test = 1;
-				break;
-			} else {
-				continue;
-			}
-			//---
-		}
-		if ( test == 1 ) {
-			continue;
-		}
-		
-		for ( int i = 0 ; i < np ; i++ ) {
-			if ( (players+i) == owner ) { //To prevent check of the bulletlist owner.
-				continue;
-			}
-			//-> If there is a collision with a player, then player will be born at random location
-			//   and owner of the bullet get a point.
-			if ( isCollide(bulletPos, bulletSize, players[i].getPosition(), players[i].getSize()) ) {
-				players[i].reborn(players, barrels, sandbags, np, nb, ns);
-				owner->incrementScore();
-				newTemp = temp->next;
-				remove(temp);
-				temp = newTemp;
-				test = 1;
-				break;
-			} else {
-				continue;
+inline unsigned int Random::next(void)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+inline unsigned int Random::getState(void) { return state; }
+
+inline void Random::setState(const unsigned int &state) { this->state = (state != 0) ? state : 1; }
+
+
+//////////////////////////////////// Definitions of SpscRing Class
+template <typename T, unsigned int N>
+SpscRing<T, N>::SpscRing() : head(0), tail(0) {}
+
+//-> Release store of tail publishes the item to the consumer.
+template <typename T, unsigned int N>
+bool SpscRing<T, N>::push(const T &item)
+{
+	unsigned int t = tail.load(memory_order_relaxed);
+	if ( t - head.load(memory_order_acquire) >= N ) {
+		return 0;
+	}
+	items[t & (N - 1)] = item;
+	tail.store(t + 1, memory_order_release);
+	return 1;
+}
+//---
+
+template <typename T, unsigned int N>
+bool SpscRing<T, N>::peek(T &item)
+{
+	unsigned int h = head.load(memory_order_relaxed);
+	if ( h == tail.load(memory_order_acquire) ) {
+		return 0;
+	}
+	item = items[h & (N - 1)];
+	return 1;
+}
+
+template <typename T, unsigned int N>
+bool SpscRing<T, N>::pop(T &item)
+{
+	if ( !peek(item) ) {
+		return 0;
+	}
+	head.store(head.load(memory_order_relaxed) + 1, memory_order_release);
+	return 1;
+}
+
+
+//////////////////////////////////// Definitions of InputThread Class
+InputThread::InputThread() : running(0), focused(1), dropped(0), numKeys(0) {}
+
+InputThread::~InputThread() { stop(); }
+
+void InputThread::start(const sf::Keyboard::Key *const keys, const int &numKeys)
+{
+	if ( running ) {
+		return;
+	}
+	this->numKeys = (numKeys < INPUT_MAX_KEYS) ? numKeys : INPUT_MAX_KEYS;
+	for ( int i = 0 ; i < this->numKeys ; i++ ) {
+		this->keys[i] = keys[i];
+	}
+	running = 1;
+	worker = thread(&InputThread::loop, this);
+}
+
+void InputThread::stop(void)
+{
+	running = 0;
+	if ( worker.joinable() ) {
+		worker.join();
+	}
+}
+
+//-> Only the changes of the keys are queued. If the window loses focus, then
+//   held keys are released, so a soldier does not walk forever.
+void InputThread::loop(void)
+{
+	AllocScope scope(TAG_INPUT);
+	bool down[INPUT_MAX_KEYS] = {0};
+	while ( running ) {
+		bool active = focused;
+		for ( int i = 0 ; i < numKeys ; i++ ) {
+			bool pressed = active && sf::Keyboard::isKeyPressed(keys[i]);
+			if ( pressed != down[i] ) {
+				inputEvent event;
+				event.time = now();
+				event.key = keys[i];
+				event.pressed = pressed;
+				if ( queue.push(event) ) {
+					down[i] = pressed;
+				} else {
+					dropped++; //Key is checked again in the next loop.
+				}
 			}
-			//---
-		}
-		if ( test == 1 ) {
-			continue;
 		}
-		//---
+		this_thread::sleep_for(chrono::microseconds(INPUT_POLL_US));
+	}
+}
+//---
 
-		//-> This if block prevent the bullet from go beyond the window limit.
-		if ( (bulletPos.x < -CAST_FLOAT(bulletSize.x)) || //Left window limit
-			 (bulletPos.y < -CAST_FLOAT(bulletSize.y)) || //Up window limit
-			 (bulletPos.x > window->getSize().x) || //Right window limit
-			 (bulletPos.y > window->getSize().y) // Bottom window limit
-			 ) {
-			newTemp = temp->next;
-			remove(temp);
-			temp = newTemp;
-			continue;
-		}
-		//---
-		temp->move();
-		temp->paint();
-		temp = temp->next;
+inline void InputThread::setFocused(const bool &focused) { this->focused = focused; }
+
+bool InputThread::pop(inputEvent &event, const sf::Int64 &until)
+{
+	inputEvent next;
+	if ( !queue.peek(next) || next.time > until ) {
+		return 0;
 	}
+	return queue.pop(event);
 }
 
-//////////////////////////////////// Definitions of Player Class
-void Player::init(	sf::RenderWindow *const window,
-				const string &textBasePath,
-				const int &numTextures,
-				const sf::Vector2f &pos,
-				const sf::Vector2u &xy_offset)
+inline sf::Int64 InputThread::now(void) { return clock.getElapsedTime().asMicroseconds(); }
+
+inline unsigned int InputThread::getDropped(void) { return dropped; }
+
+
+//////////////////////////////////// Definitions of LatencyMeter Class
+LatencyMeter::LatencyMeter() :	pendingSum(0),
+								pendingOldest(0),
+								pendingCount(0),
+								total(0),
+								max(0),
+								count(0) {}
+
+void LatencyMeter::consumed(const sf::Int64 &eventTime)
 {
-	this->window = window;
-	this->xy_offset = xy_offset;
-	textures = new sf::Texture[numTextures];
-	for (int i = 0 ; i < numTextures ; i++) {
-		//-> to_string method in the if block convert the uint to str
-		if ( !(textures+i)->loadFromFile(textBasePath + "soldier" + to_string(i) + ".png") ) {
-			cout << "[ERROR] Soldier texture loading error." << endl;
-		}
-		//---
+	if ( pendingCount == 0 || eventTime < pendingOldest ) {
+		pendingOldest = eventTime;
 	}
-	state = 0;
-	s = 0;
-	oldDir = -1; //Means init step
-	score = 0;
-	//-> We will use soldier0.png at the beginning
-	sprite.setTexture(textures[state]);
-	//---
-	sprite.setOrigin(CAST_FLOAT(xy_offset.x) / 2, CAST_FLOAT(xy_offset.y) / 2);
-	sprite.setPosition(pos);
+	pendingSum += eventTime;
+	pendingCount++;
 }
 
-inline void Player::fire(BulletList *const list, const float &speed)
+void LatencyMeter::presented(const sf::Int64 &presentTime)
 {
-	list->add(getPosition(), state, speed);
+	if ( pendingCount == 0 ) {
+		return;
+	}
+	total += presentTime * pendingCount - pendingSum;
+	if ( presentTime - pendingOldest > max ) {
+		max = presentTime - pendingOldest;
+	}
+	count += pendingCount;
+	pendingSum = 0;
+	pendingCount = 0;
 }
 
-//-> This method moves the soldier to the random location.
-void Player::reborn(Player *const players,
-					Barrel *const barrels,
-					Sandbag *const sandbags,
-					const int &np,
-					const int &nb,
-					const int &ns)
+void LatencyMeter::print(void)
 {
-	sf::Vector2u curSize = getSize();
-	sf::Vector2u limits = window->getSize() - curSize;
-	sf::Vector2f newPos;
-	//-> Collision check loop.
-	while ( 1 ) {
-		//In this loop, if check variable is 1 then while loop is reset.
-		int check = 0;
-		newPos.x = rand() % limits.x;
-		newPos.y = rand() % limits.y;
-		for ( int i = 0 ; i < nb ; i++ ) {
-			if ( barrels[i].getVisible() == 0 ) { //Check whether barrel is visible or not.
-				continue;
-			}
-			if ( isCollide(newPos, curSize, barrels[i].getPosition(), barrels[i].getSize()) ) {
-				check = 1;
-				break;
-			} else {
-				continue;
-			}
+	if ( count == 0 ) {
+		return;
+	}
+	cout << "[INFO] Input to photon latency: avg " << CAST_FLOAT(total) / count / 1000
+		 << " ms, max " << CAST_FLOAT(max) / 1000 << " ms, " << count << " key events." << endl;
+}
+
+
+//////////////////////////////////// Definitions of LoadGovernor Class
+const char *const LoadGovernor::levelNames[NUM_LOAD_LEVELS] = {"normal", "no effects", "low render rate", "slow overlay", "bullet cap"};
+
+LoadGovernor::LoadGovernor() : budget(0), cost(0), level(LOAD_NORMAL), pressureTicks(0), reliefTicks(0)
+{
+	for ( int i = 0 ; i < NUM_LOAD_LEVELS ; i++ ) {
+		entered[i] = 0;
+		ticksAt[i] = 0;
+	}
+}
+
+void LoadGovernor::init(const sf::Int64 &budget)
+{
+	this->budget = budget;
+	cost = 0;
+	pressureTicks = 0;
+	reliefTicks = 0;
+}
+
+//-> Counters are cleared when the level is changed, so the next change waits
+//   until the new level has an effect on the average.
+bool LoadGovernor::record(const unsigned int &tick, const sf::Int64 &tickCost, const sf::Int64 &renderCost)
+{
+	cost += GOVERNOR_SMOOTHING * (tickCost + renderCost - cost);
+	ticksAt[level]++;
+	pressureTicks = (cost > GOVERNOR_HIGH * budget) ? pressureTicks + 1 : 0;
+	reliefTicks = (cost < GOVERNOR_LOW * budget) ? reliefTicks + 1 : 0;
+	int next = level;
+	if ( pressureTicks >= GOVERNOR_PRESSURE_TICKS && level + 1 < NUM_LOAD_LEVELS ) {
+		next = level + 1;
+	} else if ( reliefTicks >= GOVERNOR_RELIEF_TICKS && level > LOAD_NORMAL ) {
+		next = level - 1;
+	}
+	if ( next == level ) {
+		return 0;
+	}
+	cout << "[GOVERNOR] Tick " << tick << ": " << (next > level ? "degraded" : "recovered") << " to " << levelNames[next]
+		 << ", tick cost " << cost << " us of " << budget << " us." << endl;
+	level = next;
+	entered[level]++;
+	pressureTicks = 0;
+	reliefTicks = 0;
+	return 1;
+}
+//---
+
+inline int LoadGovernor::getLevel(void) { return level; }
+
+inline bool LoadGovernor::getEffects(void) { return level < LOAD_NO_EFFECTS; }
+
+inline unsigned int LoadGovernor::getRenderInterval(void) { return (level >= LOAD_LOW_RENDER_RATE) ? GOVERNOR_RENDER_INTERVAL : 1; }
+
+inline unsigned int LoadGovernor::getOverlayInterval(void) { return (level >= LOAD_SLOW_OVERLAY) ? GOVERNOR_OVERLAY_INTERVAL : 1; }
+
+inline bool LoadGovernor::getBulletCap(void) { return level >= LOAD_BULLET_CAP; }
+
+inline unsigned int LoadGovernor::getEntered(const int &level) { return entered[level]; }
+
+void LoadGovernor::print(void)
+{
+	cout << "[GOVERNOR]";
+	for ( int i = 0 ; i < NUM_LOAD_LEVELS ; i++ ) {
+		cout << " " << levelNames[i] << ": entered " << entered[i] << " times, " << ticksAt[i] << " ticks" << (i + 1 < NUM_LOAD_LEVELS ? "," : ".");
+	}
+	cout << endl;
+}
+
+//////////////////////////////////// Definitions of TelemetrySink Class
+const char *const TelemetrySink::kindNames[NUM_TELEMETRY_KINDS] = {"shot", "hit", "respawn", "tick", "frame", "dropped"};
+
+TelemetrySink::TelemetrySink() :	running(0),
+									dropped(0),
+									tick(0),
+									csv(0),
+									rotateRecords(TELEMETRY_ROTATE_RECORDS),
+									numFiles(0),
+									fileRecords(0),
+									written(0),
+									reportedDrops(0),
+									lastTick(0) {}
+
+TelemetrySink::~TelemetrySink() { stop(); }
+
+bool TelemetrySink::start(const string &path, const unsigned long long &rotateRecords)
+{
+	if ( running ) {
+		return 1;
+	}
+	this->path = path;
+	this->rotateRecords = rotateRecords;
+	csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+	numFiles = 0;
+	written = 0;
+	dropped = 0;
+	reportedDrops = 0;
+	if ( !rotate() ) {
+		cout << "[ERROR] Telemetry file cannot be opened: " << path << endl;
+		return 0;
+	}
+	running = 1;
+	writer = thread(&TelemetrySink::loop, this);
+	return 1;
+}
+
+void TelemetrySink::stop(void)
+{
+	running = 0;
+	if ( writer.joinable() ) {
+		writer.join();
+	}
+	if ( file.is_open() ) {
+		file.close();
+	}
+}
+
+string TelemetrySink::getPath(const unsigned int &i)
+{
+	if ( i == 0 ) {
+		return path;
+	}
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of('/');
+	if ( dot == string::npos || (slash != string::npos && dot < slash) ) {
+		return path + "." + to_string(i);
+	}
+	return path.substr(0, dot) + "." + to_string(i) + path.substr(dot);
+}
+
+bool TelemetrySink::rotate(void)
+{
+	if ( file.is_open() ) {
+		file.close();
+	}
+	file.open(getPath(numFiles).c_str(), ios::out | ios::trunc);
+	if ( !file ) {
+		return 0;
+	}
+	numFiles++;
+	fileRecords = 0;
+	if ( csv ) {
+		file << "tick,type,player,target,index,value\n";
+	}
+	return 1;
+}
+
+//-> Fields which are not used by the kind of the record are left out.
+void TelemetrySink::write(const telemetryRecord &record)
+{
+	static const char *const layerNames[NUM_LAYERS] = {"soldier", "bullet", "sandbag", "barrel"};
+	if ( fileRecords >= rotateRecords && !rotate() ) {
+		return;
+	}
+	const bool hasPlayer = (record.kind == TEL_SHOT || record.kind == TEL_HIT || record.kind == TEL_RESPAWN);
+	const bool hasValue = (record.kind != TEL_SHOT && record.kind != TEL_HIT);
+	const char *valueName = (record.kind == TEL_RESPAWN) ? "attempts" : (record.kind == TEL_DROPPED ? "count" : "us");
+	if ( csv ) {
+		file << record.tick << "," << kindNames[record.kind] << ",";
+		if ( hasPlayer ) {
+			file << static_cast<int>(record.player);
 		}
-		if ( check == 1 ) {
-			continue;
+		file << ",";
+		if ( record.kind == TEL_HIT ) {
+			file << layerNames[record.layer] << "," << record.index;
+		} else {
+			file << ",";
 		}
-		
-		for ( int i = 0 ; i < ns ; i++ ) {
-			if ( isCollide(newPos, curSize, sandbags[i].getPosition(), sandbags[i].getSize()) ) {
-				check = 1;
-				break;
-			} else {
-				continue;
-			}
+		file << ",";
+		if ( hasValue ) {
+			file << record.value;
 		}
-		if ( check == 1 ) {
-			continue;
+		file << "\n";
+	} else {
+		file << "{\"tick\":" << record.tick << ",\"type\":\"" << kindNames[record.kind] << "\"";
+		if ( hasPlayer ) {
+			file << ",\"player\":" << static_cast<int>(record.player);
 		}
+		if ( record.kind == TEL_HIT ) {
+			file << ",\"target\":\"" << layerNames[record.layer] << "\",\"index\":" << record.index;
+		}
+		if ( hasValue ) {
+			file << ",\"" << valueName << "\":" << record.value;
+		}
+		file << "}\n";
+	}
+	fileRecords++;
+	written++;
+	lastTick = record.tick;
+}
+//---
 
-		for ( int i = 0 ; i < np ; i++ ) {
-			if ( (players+i) == this ) { //To prevent check of same soldier.
-				continue;
-			}
-			if ( isCollide(newPos, curSize, players[i].getPosition(), players[i].getSize()) ) {
-				check = 1;
-				break;
-			} else {
-				continue;
-			}
+//-> State of running is read before the ring is drained, so the records which
+//   are pushed before stop() are written.
+void TelemetrySink::loop(void)
+{
+	AllocScope scope(TAG_TELEMETRY);
+	telemetryRecord record;
+	while ( 1 ) {
+		bool stopping = !running;
+		bool any = 0;
+		while ( queue.pop(record) ) {
+			write(record);
+			any = 1;
+		}
+		unsigned int drops = dropped;
+		if ( drops != reportedDrops ) {
+			telemetryRecord lost = {lastTick, TEL_DROPPED, 0, 0, 0, drops - reportedDrops};
+			write(lost);
+			reportedDrops = drops;
+			any = 1;
 		}
-		if ( check == 0 ) {
+		if ( any ) {
+			file.flush();
+		}
+		if ( stopping ) {
 			break;
 		}
+		this_thread::sleep_for(chrono::microseconds(TELEMETRY_FLUSH_US));
 	}
-	//---
-	this->setPosition(newPos);
-	this->paint();
 }
+//---
 
-inline void Player::incrementScore(void) { score += 1; }
+inline bool TelemetrySink::isRunning(void) { return running; }
 
-inline int Player::getScore(void) { return score; }
+inline void TelemetrySink::setTick(const unsigned int &tick) { this->tick = tick; }
 
-void Player::walk(	const float speed,
-					const Direction &dir,
-					Player *const players,
-					Barrel *const barrels,
-					Sandbag *const sandbags,
-					const int &np,
-					const int &nb,
-					const int &ns)
+inline void TelemetrySink::record(const TelemetryKind &kind, const int &player, const int &layer, const int &index, const sf::Int64 &value)
 {
-	sf::Vector2f velocityVector(0,0);
-	//-> As different from the given state, I implement a mechanism that used for the
-	//   opposite side movements (Press UP key when soldier look at the DOWN etc.).
-	//   In intermediate phases of the soldire (state 1,3,5,7) according to the
-	//   movement direction, old direction is guessed and saved. For example if soldier moves
-	//   state 1 to state 0 (UP) then old state will be state 2 (RIGHT) because it is probably the old direction.
-	//   Then if DOWN key pressed when soldier look at the UP, user move according to the oldDir.
-	switch (state) {
-		case 0:
-			switch (dir) {
-				case RIGHT:
-					state = 1;
-					break;
-				case LEFT:
-					s = 1;
-					state = 7;
-					break;
-				case DOWN:
-					if ( oldDir == LEFT ) {
-						s = 1;
-						state = 7;
-					} else if ( oldDir == RIGHT ) {
-						state = 1;
-					} else {
-						state = 1; //To handle init value (-1) of oldDir.
-					}
-					break;
-				case UP:
-					if ( s == 0 ) {
-						state = 7;
-						s = 1;
-						velocityVector.x += 0;
-						velocityVector.y += -1 * speed;
-					} else if ( s == 1 ) {
-						state = 8;
+	telemetryRecord next = {tick, static_cast<sf::Uint8>(kind), static_cast<sf::Uint8>(player), static_cast<sf::Uint8>(layer), index, value};
+	if ( !queue.push(next) ) {
+		dropped.fetch_add(1, memory_order_relaxed);
+	}
+}
+
+inline unsigned int TelemetrySink::getNumFiles(void) { return numFiles; }
+
+inline unsigned long long TelemetrySink::getWritten(void) { return written; }
+
+inline unsigned int TelemetrySink::getDropped(void) { return dropped; }
+
+void TelemetrySink::print(void)
+{
+	cout << "[TELEMETRY] " << written << " records written to " << numFiles << " file(s) from " << path << ", "
+		 << dropped << " dropped." << endl;
+}
+
+//////////////////////////////////// Definitions of MatchRecorder Class
+MatchRecorder::MatchRecorder() : keyframeTicks(RECORD_KEYFRAME_TICKS), numTicks(0), nextGameTick(0), bytes(0), running(0) {}
+
+MatchRecorder::~MatchRecorder() { stop(); }
+
+bool MatchRecorder::start(const string &path, const recordHeader &header)
+{
+	AllocScope scope(TAG_RECORDING);
+	stop();
+	file.open(path.c_str(), ios::binary | ios::trunc);
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	if ( !file ) {
+		cout << "[ERROR] Recording can not be written: " << path << endl;
+		file.close();
+		return 0;
+	}
+	this->path = path;
+	keyframeTicks = header.keyframeTicks;
+	blocks.clear();
+	numTicks = 0;
+	nextGameTick = 0;
+	bytes = sizeof(header);
+	running = 1;
+	return 1;
+}
+
+//-> Index and trailer are appended, the trailer is at the end of the file so the
+//   reader finds the index without reading the blocks.
+void MatchRecorder::stop(void)
+{
+	if ( !running ) {
+		return;
+	}
+	running = 0;
+	recordTrailer trailer;
+	memset(&trailer, 0, sizeof(trailer));
+	trailer.indexOffset = bytes;
+	trailer.numBlocks = blocks.size();
+	memcpy(trailer.magic, RECORD_MAGIC, 4);
+	file.write(reinterpret_cast<const char *>(blocks.data()), blocks.size() * sizeof(recordBlock));
+	file.write(reinterpret_cast<const char *>(&trailer), sizeof(trailer));
+	bytes += blocks.size() * sizeof(recordBlock) + sizeof(trailer);
+	file.close();
+	if ( !file ) {
+		cout << "[ERROR] Recording can not be written: " << path << endl;
+	}
+}
+//---
+
+inline bool MatchRecorder::isRunning(void) { return running; }
+
+inline bool MatchRecorder::needsKeyframe(const unsigned int &gameTick)
+{
+	return blocks.empty() || blocks.back().numTicks >= keyframeTicks || gameTick != nextGameTick;
+}
+
+void MatchRecorder::writeKeyframe(const worldSnapshot &snap, const unsigned int &matchSeed)
+{
+	AllocScope scope(TAG_RECORDING);
+	recordBlock newBlock = {bytes, numTicks, 0};
+	blocks.push_back(newBlock);
+	recordKeyframe keyframe;
+	memset(&keyframe, 0, sizeof(keyframe));
+	keyframe.matchSeed = matchSeed;
+	keyframe.tick = snap.tick;
+	keyframe.rngState = snap.rngState;
+	keyframe.nextBulletId = snap.nextBulletId;
+	keyframe.np = snap.np;
+	keyframe.nb = snap.nb;
+	keyframe.nbul = snap.nbul;
+	const unsigned int barrelBytes = (snap.nb + 7) / 8;
+	file.write(reinterpret_cast<const char *>(&keyframe), sizeof(keyframe));
+	file.write(reinterpret_cast<const char *>(snap.players), snap.np * sizeof(playerSnap));
+	file.write(reinterpret_cast<const char *>(snap.barrelVisible), barrelBytes);
+	file.write(reinterpret_cast<const char *>(snap.bullets), snap.nbul * sizeof(bulletSnap));
+	bytes += sizeof(keyframe) + snap.np * sizeof(playerSnap) + barrelBytes + snap.nbul * sizeof(bulletSnap);
+	nextGameTick = snap.tick;
+}
+
+inline void MatchRecorder::writeInput(const tickInput &input, const sf::Uint64 &hash)
+{
+	recordInput entry;
+	memset(&entry, 0, sizeof(entry));
+	entry.hash = static_cast<sf::Uint32>(hash);
+	entry.input = input;
+	file.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+	bytes += sizeof(entry);
+	blocks.back().numTicks++;
+	numTicks++;
+	nextGameTick++;
+}
+
+inline unsigned int MatchRecorder::getNumTicks(void) { return numTicks; }
+
+void MatchRecorder::print(void)
+{
+	cout << "[RECORD] " << numTicks << " ticks in " << blocks.size() << " blocks written to " << path << ", "
+		 << bytes << " bytes." << endl;
+}
+
+
+//////////////////////////////////// Definitions of RecordReader Class
+RecordReader::RecordReader() : keyframe(NULL), matchSeed(0), numTicks(0), block(-1) {}
+
+RecordReader::~RecordReader() { delete keyframe; }
+
+//-> Blocks should follow each other without a gap, as the index is used to find
+//   the block of a tick without reading the blocks.
+bool RecordReader::open(const string &path)
+{
+	AllocScope scope(TAG_RECORDING);
+	file.close();
+	file.clear();
+	file.open(path.c_str(), ios::binary);
+	if ( !file ) {
+		cout << "[ERROR] Recording can not be opened: " << path << endl;
+		return 0;
+	}
+	recordTrailer trailer;
+	file.read(reinterpret_cast<char *>(&header), sizeof(header));
+	file.seekg(0, ios::end);
+	const unsigned long long size = file.tellg();
+	file.seekg(size - sizeof(trailer));
+	file.read(reinterpret_cast<char *>(&trailer), sizeof(trailer));
+	if ( !file || size < sizeof(header) + sizeof(trailer) || memcmp(header.magic, RECORD_MAGIC, 4) != 0 ||
+		 header.version != RECORD_VERSION || memcmp(trailer.magic, RECORD_MAGIC, 4) != 0 ||
+		 trailer.indexOffset + static_cast<unsigned long long>(trailer.numBlocks) * sizeof(recordBlock) + sizeof(trailer) != size ) {
+		cout << "[ERROR] Recording is corrupted, old or not finished: " << path << endl;
+		return 0;
+	}
+	header.mapPath[RECORD_MAP_PATH_SIZE - 1] = '\0';
+	blocks.resize(trailer.numBlocks);
+	file.seekg(trailer.indexOffset);
+	file.read(reinterpret_cast<char *>(blocks.data()), blocks.size() * sizeof(recordBlock));
+	numTicks = 0;
+	//-> Scenario of the header is checked with the limits of the scenario options.
+	bool valid = file && !blocks.empty() && header.keyframeTicks > 0 && header.numHumans <= 2 &&
+				 header.numHumans + header.numBots >= 1 && header.numHumans + header.numBots <= SNAP_MAX_PLAYERS &&
+				 header.numBarrels <= SNAP_MAX_BARRELS && header.numSandbags <= SCENARIO_MAX_SANDBAGS &&
+				 header.numTeams <= SNAP_MAX_PLAYERS && header.numTeams != 1 &&
+				 header.width >= SCENARIO_MIN_SIZE && header.width <= SCENARIO_MAX_SIZE &&
+				 header.height >= SCENARIO_MIN_SIZE && header.height <= SCENARIO_MAX_SIZE &&
+				 header.tickRate >= 1 && header.tickRate <= SCENARIO_MAX_TICK_RATE &&
+				 header.bulletSpeed >= 1 && header.bulletSpeed <= SCENARIO_MAX_BULLET_SPEED;
+	//---
+	for ( size_t i = 0 ; i < blocks.size() && valid ; i++ ) {
+		valid = (blocks[i].tick == numTicks && blocks[i].numTicks <= header.keyframeTicks &&
+				 blocks[i].offset >= sizeof(header) && blocks[i].offset < trailer.indexOffset);
+		numTicks += blocks[i].numTicks;
+	}
+	if ( !valid ) {
+		cout << "[ERROR] Recording is corrupted: " << path << endl;
+		return 0;
+	}
+	if ( keyframe == NULL ) {
+		keyframe = new worldSnapshot;
+	}
+	inputs.reserve(header.keyframeTicks);
+	block = -1;
+	return 1;
+}
+//---
+
+void RecordReader::getScenario(scenario &config)
+{
+	config.width = header.width;
+	config.height = header.height;
+	config.numBarrels = header.numBarrels;
+	config.numSandbags = header.numSandbags;
+	config.numHumans = header.numHumans;
+	config.numBots = header.numBots;
+	config.tickRate = header.tickRate;
+	config.bulletSpeed = header.bulletSpeed;
+	config.seed = header.seed;
+	config.collisionMode = (header.collisionMode == COLLIDE_SWEEP) ? COLLIDE_SWEEP : COLLIDE_BRUTE;
+	config.bulletCollisions = header.bulletCollisions;
+	config.numTeams = header.numTeams;
+	config.mapPath = header.mapPath;
+	config.headless = 0;
+	config.duration = 0;
+	config.recordPath = "";
+	config.exportPath = "";
+	config.botScript = SCRIPT_NONE;
+	config.checkParallel = 0;
+}
+
+inline unsigned int RecordReader::getNumTicks(void) { return numTicks; }
+
+inline unsigned int RecordReader::getKeyframeTicks(void) { return header.keyframeTicks; }
+
+int RecordReader::findBlock(const unsigned int &tick)
+{
+	int first = 0, last = blocks.size() - 1;
+	while ( first < last ) {
+		int middle = (first + last + 1) / 2;
+		if ( blocks[middle].tick <= tick ) {
+			first = middle;
+		} else {
+			last = middle - 1;
+		}
+	}
+	return first;
+}
+
+//-> Entries which are used as indexes by the game are checked, so a corrupted
+//   block can not touch a player or a bullet list which does not exist.
+bool RecordReader::loadBlock(const int &block)
+{
+	if ( block < 0 || block >= static_cast<int>(blocks.size()) ) {
+		return 0;
+	}
+	this->block = -1;
+	recordKeyframe entry;
+	file.clear();
+	file.seekg(blocks[block].offset);
+	file.read(reinterpret_cast<char *>(&entry), sizeof(entry));
+	//-> Counts size the reads below, so they are checked before them.
+	if ( !file || entry.np > SNAP_MAX_PLAYERS || entry.nb > SNAP_MAX_BARRELS || entry.nbul > SNAP_MAX_BULLETS ||
+		 entry.np != header.numHumans + header.numBots || entry.nb != header.numBarrels ) {
+		cout << "[ERROR] Block " << block << " of the recording is corrupted." << endl;
+		return 0;
+	}
+	//---
+	keyframe->tick = entry.tick;
+	keyframe->rngState = entry.rngState;
+	keyframe->nextBulletId = entry.nextBulletId;
+	keyframe->np = entry.np;
+	keyframe->nb = entry.nb;
+	keyframe->nbul = entry.nbul;
+	memset(keyframe->barrelVisible, 0, sizeof(keyframe->barrelVisible));
+	file.read(reinterpret_cast<char *>(keyframe->players), entry.np * sizeof(playerSnap));
+	file.read(reinterpret_cast<char *>(keyframe->barrelVisible), (entry.nb + 7) / 8);
+	file.read(reinterpret_cast<char *>(keyframe->bullets), entry.nbul * sizeof(bulletSnap));
+	inputs.resize(blocks[block].numTicks);
+	file.read(reinterpret_cast<char *>(inputs.data()), inputs.size() * sizeof(recordInput));
+	bool valid = static_cast<bool>(file);
+	//Frames and masks of a soldier are indexed by its state.
+	for ( int i = 0 ; i < keyframe->np && valid ; i++ ) {
+		const playerSnap &player = keyframe->players[i];
+		valid = (player.state >= 0 && player.state < SOLDIER_FRAMES && (player.s == 0 || player.s == 1) &&
+				 player.oldDir >= -1 && player.oldDir <= RIGHT);
+	}
+	for ( int i = 0 ; i < keyframe->nbul && valid ; i++ ) {
+		valid = (keyframe->bullets[i].owner >= 0 && keyframe->bullets[i].owner < keyframe->np && keyframe->bullets[i].dir >= 0 && keyframe->bullets[i].dir < 4);
+	}
+	for ( size_t i = 0 ; i < inputs.size() && valid ; i++ ) {
+		valid = (inputs[i].input.capBullets <= 1 && inputs[i].input.move[0] >= -1 && inputs[i].input.move[0] < 4 &&
+				 inputs[i].input.move[1] >= -1 && inputs[i].input.move[1] < 4);
+	}
+	if ( !valid ) {
+		cout << "[ERROR] Block " << block << " of the recording is corrupted." << endl;
+		return 0;
+	}
+	matchSeed = entry.matchSeed;
+	this->block = block;
+	return 1;
+}
+//---
+
+inline int RecordReader::getBlock(void) { return block; }
+
+inline unsigned int RecordReader::getBlockStart(void) { return blocks[block].tick; }
+
+inline bool RecordReader::hasTick(const unsigned int &tick)
+{
+	return block >= 0 && tick >= blocks[block].tick && tick - blocks[block].tick < blocks[block].numTicks;
+}
+
+inline const worldSnapshot &RecordReader::getKeyframe(void) { return *keyframe; }
+
+inline unsigned int RecordReader::getMatchSeed(void) { return matchSeed; }
+
+inline const recordInput &RecordReader::getInput(const unsigned int &tick) { return inputs[tick - blocks[block].tick]; }
+
+//////////////////////////////////// Definitions of ScriptPool Class
+void *ScriptPool::freeSlots = NULL;
+vector<char *> ScriptPool::chunks;
+unsigned int ScriptPool::numSlots = 0;
+unsigned int ScriptPool::usedSlots = 0;
+unsigned int ScriptPool::growths = 0;
+unsigned int ScriptPool::heapFrames = 0;
+size_t ScriptPool::largestFrame = 0;
+
+void ScriptPool::grow(const unsigned int &slots)
+{
+	AllocScope scope(TAG_SCRIPTS);
+	char *chunk = new char[static_cast<size_t>(slots) * SCRIPT_FRAME_SIZE];
+	chunks.push_back(chunk);
+	for ( unsigned int i = 0 ; i < slots ; i++ ) {
+		void *slot = chunk + static_cast<size_t>(i) * SCRIPT_FRAME_SIZE;
+		*static_cast<void **>(slot) = freeSlots;
+		freeSlots = slot;
+	}
+	numSlots += slots;
+	growths++;
+}
+
+void ScriptPool::reserve(const unsigned int &slots)
+{
+	if ( numSlots - usedSlots < slots ) {
+		grow(slots - (numSlots - usedSlots));
+	}
+}
+
+void *ScriptPool::allocate(const size_t &size)
+{
+	largestFrame = max(largestFrame, size);
+	if ( size > SCRIPT_FRAME_SIZE ) {
+		AllocScope scope(TAG_SCRIPTS);
+		heapFrames++;
+		return ::operator new(size);
+	}
+	if ( freeSlots == NULL ) {
+		grow(SCRIPT_POOL_CHUNK);
+	}
+	void *slot = freeSlots;
+	freeSlots = *static_cast<void **>(slot);
+	usedSlots++;
+	return slot;
+}
+
+void ScriptPool::deallocate(void *const frame, const size_t &size)
+{
+	if ( size > SCRIPT_FRAME_SIZE ) {
+		::operator delete(frame);
+		return;
+	}
+	*static_cast<void **>(frame) = freeSlots;
+	freeSlots = frame;
+	usedSlots--;
+}
+
+void ScriptPool::release(void)
+{
+	if ( usedSlots != 0 ) {
+		return;
+	}
+	for ( size_t i = 0 ; i < chunks.size() ; i++ ) {
+		delete [] chunks[i];
+	}
+	chunks.clear();
+	chunks.shrink_to_fit();
+	freeSlots = NULL;
+	numSlots = 0;
+}
+
+inline unsigned int ScriptPool::getUsed(void) { return usedSlots; }
+
+inline unsigned int ScriptPool::getGrowths(void) { return growths; }
+
+inline unsigned int ScriptPool::getHeapFrames(void) { return heapFrames; }
+
+inline size_t ScriptPool::getLargestFrame(void) { return largestFrame; }
+
+
+//////////////////////////////////// Definitions of Script and ScriptWait Classes
+inline Script Script::promise_type::get_return_object(void) { return Script(coroutine_handle<promise_type>::from_promise(*this)); }
+
+inline suspend_always Script::promise_type::initial_suspend(void) noexcept { return suspend_always(); }
+
+inline suspend_always Script::promise_type::final_suspend(void) noexcept { return suspend_always(); }
+
+inline void Script::promise_type::return_void(void) {}
+
+//Game does not use exceptions, a script which throws is a bug.
+inline void Script::promise_type::unhandled_exception(void)
+{
+	cout << "[ERROR] Unhandled exception in a script." << endl;
+	terminate();
+}
+
+inline void *Script::promise_type::operator new(size_t size) { return ScriptPool::allocate(size); }
+
+inline void Script::promise_type::operator delete(void *frame, size_t size) { ScriptPool::deallocate(frame, size); }
+
+inline Script::Script(const coroutine_handle<promise_type> &handle) : handle(handle) {}
+
+inline Script::Script(Script &&other) : handle(other.handle) { other.handle = NULL; }
+
+//A script which is not given to a scheduler is never started.
+inline Script::~Script()
+{
+	if ( handle ) {
+		handle.destroy();
+	}
+}
+
+inline coroutine_handle<Script::promise_type> Script::release(void)
+{
+	coroutine_handle<promise_type> released = handle;
+	handle = NULL;
+	return released;
+}
+
+inline ScriptWait::ScriptWait(const unsigned int &ticks) : ticks(ticks) {}
+
+inline bool ScriptWait::await_ready(void) const noexcept { return ticks == 0; }
+
+inline void ScriptWait::await_suspend(coroutine_handle<Script::promise_type> handle) const noexcept
+{
+	handle.promise().wakeTick = handle.promise().tick + ticks;
+}
+
+inline void ScriptWait::await_resume(void) const noexcept {}
+
+
+//////////////////////////////////// Definitions of ScriptScheduler Class
+ScriptScheduler::ScriptScheduler() : resumes(0) {}
+
+ScriptScheduler::~ScriptScheduler()
+{
+	clear();
+	ScriptPool::release();
+}
+
+void ScriptScheduler::reserve(const unsigned int &capacity)
+{
+	AllocScope scope(TAG_SCRIPTS);
+	if ( scripts.capacity() < capacity ) {
+		scripts.reserve(capacity);
+	}
+	ScriptPool::reserve(capacity > scripts.size() ? capacity - scripts.size() : 0);
+}
+
+void ScriptScheduler::spawn(Script script, const unsigned int &tick)
+{
+	AllocScope scope(TAG_SCRIPTS);
+	coroutine_handle<Script::promise_type> handle = script.release();
+	handle.promise().tick = tick;
+	handle.promise().wakeTick = tick;
+	scripts.push_back(handle);
+}
+
+//-> Scripts which are kept are moved to the front in their order. A script which
+//   is spawned by a script is appended, so it also runs in this tick.
+void ScriptScheduler::run(const unsigned int &tick)
+{
+	size_t kept = 0;
+	for ( size_t i = 0 ; i < scripts.size() ; i++ ) {
+		coroutine_handle<Script::promise_type> handle = scripts[i];
+		if ( handle.promise().wakeTick <= tick ) {
+			handle.promise().tick = tick;
+			handle.resume();
+			resumes++;
+			if ( handle.done() ) {
+				handle.destroy();
+				continue;
+			}
+		}
+		scripts[kept++] = handle;
+	}
+	scripts.resize(kept);
+}
+//---
+
+void ScriptScheduler::clear(void)
+{
+	for ( size_t i = 0 ; i < scripts.size() ; i++ ) {
+		scripts[i].destroy();
+	}
+	scripts.clear();
+}
+
+inline unsigned int ScriptScheduler::size(void) { return scripts.size(); }
+
+inline unsigned long long ScriptScheduler::getResumes(void) { return resumes; }
+
+
+//////////////////////////////////// Definitions of WorkerPool Class
+WorkerPool::WorkerPool() :	stopping(0),
+							batchRun(NULL),
+							batchBody(NULL),
+							batchSize(0),
+							batchChunk(1),
+							batchNext(0),
+							batchLeft(0) {}
+
+WorkerPool::~WorkerPool() { stop(); }
+
+void WorkerPool::start(unsigned int numThreads)
+{
+	if ( !workers.empty() ) {
+		return;
+	}
+	if ( numThreads == 0 ) {
+		numThreads = thread::hardware_concurrency();
+	}
+	if ( numThreads == 0 ) {
+		numThreads = 2;
+	}
+	stopping = 0;
+	for ( unsigned int i = 0 ; i < numThreads ; i++ ) {
+		workers.push_back(thread(&WorkerPool::loop, this));
+	}
+}
+
+void WorkerPool::stop(void)
+{
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = 1;
+	}
+	ready.notify_all();
+	for ( unsigned int i = 0 ; i < workers.size() ; i++ ) {
+		workers[i].join();
+	}
+	workers.clear();
+}
+
+inline unsigned int WorkerPool::size(void) { return workers.size(); }
+
+//-> Workers sleep until a task or a chunk is queued. Chunks of a batch are taken
+//   first, queued tasks are finished before stop.
+void WorkerPool::loop(void)
+{
+	while ( 1 ) {
+		function<void()> task;
+		size_t begin = 0, end = 0;
+		{
+			unique_lock<mutex> guard(lock);
+			ready.wait(guard, [this]() { return stopping || !tasks.empty() || batchNext < batchSize; });
+			if ( !takeChunk(begin, end) ) {
+				if ( tasks.empty() ) {
+					return;
+				}
+				task = tasks.front();
+				tasks.pop_front();
+			}
+		}
+		if ( end > begin ) {
+			batchRun(batchBody, begin, end);
+			finishChunk();
+		} else {
+			task();
+		}
+	}
+}
+//---
+
+bool WorkerPool::takeChunk(size_t &begin, size_t &end)
+{
+	if ( batchNext >= batchSize ) {
+		return 0;
+	}
+	begin = batchNext;
+	end = min(begin + batchChunk, batchSize);
+	batchNext = end;
+	return 1;
+}
+
+void WorkerPool::finishChunk(void)
+{
+	lock_guard<mutex> guard(lock);
+	if ( --batchLeft == 0 ) {
+		batchDone.notify_all();
+	}
+}
+
+//-> Caller takes chunks like a worker, then waits for the chunks of the workers.
+void WorkerPool::runChunks(const size_t &n, const size_t &chunk, void (*run)(void *, const size_t &, const size_t &), void *body)
+{
+	lock_guard<mutex> owner(batchOwner);
+	{
+		lock_guard<mutex> guard(lock);
+		batchRun = run;
+		batchBody = body;
+		batchChunk = max(chunk, static_cast<size_t>(1));
+		batchNext = 0;
+		batchSize = n;
+		batchLeft = (n + batchChunk - 1) / batchChunk;
+	}
+	ready.notify_all();
+	size_t begin = 0, end = 0;
+	while ( 1 ) {
+		{
+			lock_guard<mutex> guard(lock);
+			if ( !takeChunk(begin, end) ) {
+				break;
+			}
+		}
+		run(body, begin, end);
+		finishChunk();
+	}
+	unique_lock<mutex> guard(lock);
+	batchDone.wait(guard, [this]() { return batchLeft == 0; });
+	batchSize = 0;
+	batchNext = 0;
+}
+//---
+
+//-> Task is wrapped into a packaged_task, so its result or exception goes to the future.
+template <typename F>
+future<typename result_of<F()>::type> WorkerPool::submit(F task)
+{
+	typedef typename result_of<F()>::type Result;
+	shared_ptr< packaged_task<Result()> > job = make_shared< packaged_task<Result()> >(task);
+	future<Result> result = job->get_future();
+	{
+		lock_guard<mutex> guard(lock);
+		tasks.push_back([job]() { (*job)(); });
+	}
+	ready.notify_one();
+	return result;
+}
+//---
+
+//-> Body is called through a plain function pointer, so nothing is allocated for it.
+template <typename F>
+void WorkerPool::forChunks(const size_t &n, const size_t &chunk, F &body)
+{
+	runChunks(n, chunk, [](void *f, const size_t &begin, const size_t &end) { (*static_cast<F *>(f))(begin, end); }, &body);
+}
+//---
+
+
+//////////////////////////////////// Definitions of CollisionMask Class
+CollisionMask::CollisionMask() : bits(NULL), width(0), height(0), words(0) {}
+
+CollisionMask::~CollisionMask() { delete [] bits; }
+
+void CollisionMask::build(	const sf::Uint8 *const pixels,
+							const unsigned int &stride,
+							const sf::IntRect &rect,
+							const int &rotation)
+{
+	const int w = rect.width, h = rect.height;
+	const bool swap = (rotation == 90 || rotation == 270);
+	width = swap ? h : w;
+	height = swap ? w : h;
+	words = (width + 63) / 64;
+	delete [] bits;
+	bits = new sf::Uint64[words * height];
+	memset(bits, 0, words * height * sizeof(sf::Uint64));
+	int minX = width, minY = height, maxX = -1, maxY = -1;
+	for ( int y = 0 ; y < h ; y++ ) {
+		for ( int x = 0 ; x < w ; x++ ) {
+			if ( pixels[((rect.top + y) * stride + rect.left + x) * 4 + 3] < COLLISION_ALPHA ) {
+				continue;
+			}
+			//-> Same rotation as the sprite, then moved back to the positive side.
+			int mx, my;
+			switch (rotation) {
+				case 90:
+					mx = h - 1 - y;
+					my = x;
+					break;
+				case 180:
+					mx = w - 1 - x;
+					my = h - 1 - y;
+					break;
+				case 270:
+					mx = y;
+					my = w - 1 - x;
+					break;
+				default:
+					mx = x;
+					my = y;
+					break;
+			}
+			//---
+			bits[my * words + (mx >> 6)] |= static_cast<sf::Uint64>(1) << (mx & 63);
+			minX = (mx < minX) ? mx : minX;
+			minY = (my < minY) ? my : minY;
+			maxX = (mx > maxX) ? mx : maxX;
+			maxY = (my > maxY) ? my : maxY;
+		}
+	}
+	opaque = (maxX < 0) ? sf::IntRect(0, 0, 0, 0) : sf::IntRect(minX, minY, maxX - minX + 1, maxY - minY + 1);
+}
+
+inline sf::Vector2u CollisionMask::getSize(void) const { return sf::Vector2u(width, height); }
+
+inline const sf::IntRect &CollisionMask::getOpaque(void) const { return opaque; }
+
+inline sf::Uint64 CollisionMask::rowBits(const int &y, const int &start) const
+{
+	const sf::Uint64 *row = bits + y * words;
+	int w = start >> 6; //Floor division, start can be negative.
+	int shift = start & 63;
+	sf::Uint64 low = (w >= 0 && w < words) ? row[w] >> shift : 0;
+	sf::Uint64 high = (shift != 0 && w + 1 >= 0 && w + 1 < words) ? row[w + 1] << (64 - shift) : 0;
+	return low | high;
+}
+
+//-> Opaque boxes are tested first. If they overlap, then the rows of b are shifted
+//   to the columns of a and the overlapping rows are tested a word at a time.
+bool CollisionMask::overlap(const CollisionMask &a,
+							const sf::Vector2i &posA,
+							const CollisionMask &b,
+							const sf::Vector2i &posB)
+{
+	const int ax = toPixel(posA.x), ay = toPixel(posA.y);
+	const int bx = toPixel(posB.x), by = toPixel(posB.y);
+	int left = ax + a.opaque.left, right = left + a.opaque.width;
+	int top = ay + a.opaque.top, bottom = top + a.opaque.height;
+	left = (bx + b.opaque.left > left) ? bx + b.opaque.left : left;
+	right = (bx + b.opaque.left + b.opaque.width < right) ? bx + b.opaque.left + b.opaque.width : right;
+	top = (by + b.opaque.top > top) ? by + b.opaque.top : top;
+	bottom = (by + b.opaque.top + b.opaque.height < bottom) ? by + b.opaque.top + b.opaque.height : bottom;
+	if ( left >= right || top >= bottom ) {
+		return 0;
+	}
+	const int firstWord = (left - ax) >> 6, lastWord = (right - 1 - ax) >> 6;
+	const int shift = ax - bx; //Column of b is the column of a plus shift.
+	for ( int y = top ; y < bottom ; y++ ) {
+		const sf::Uint64 *rowA = a.bits + (y - ay) * a.words;
+		for ( int w = firstWord ; w <= lastWord ; w++ ) {
+			if ( rowA[w] & b.rowBits(y - by, w * 64 + shift) ) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+//---
+
+
+//////////////////////////////////// Definitions of AssetStore Class
+const char *const AssetStore::fileNames[ASSET_SOLDIER] = {"grass.png", "barrel.png", "bags.png", "bullet.png"};
+
+AssetStore::AssetStore() :	mapping(NULL),
+							mappingSize(0),
+							decoded(NULL),
+							decodeJobs(NULL),
+							fontData(NULL),
+							fontDataSize(0),
+							numPending(0),
+							failed(0),
+							headless(0) {}
+
+//Jobs write into the store, so they are waited before the store is destroyed.
+AssetStore::~AssetStore()
+{
+	waitJobs();
+	unmap();
+	delete [] fontData;
+}
+
+void AssetStore::unmap(void)
+{
+	if ( mapping != NULL ) {
+		munmap(mapping, mappingSize);
+		mapping = NULL;
+		mappingSize = 0;
+	}
+}
+
+//Every asset has one frame except the soldier, which is the last one. So first rect of an asset is its id.
+inline int AssetStore::firstRect(const AssetId &id) { return id; }
+
+inline const sf::Texture &AssetStore::getTexture(const AssetId &id) { return textures[id]; }
+
+inline const sf::IntRect &AssetStore::getRect(const AssetId &id, const int &frame) { return rects[firstRect(id) + frame]; }
+
+inline const sf::IntRect *AssetStore::getRects(const AssetId &id) { return rects + firstRect(id); }
+
+inline const CollisionMask *AssetStore::getMasks(const AssetId &id) { return masks + firstRect(id); }
+
+inline const CollisionMask *AssetStore::getBulletMasks(void) { return bulletMasks; }
+
+inline const sf::Font &AssetStore::getFont(void) { return font; }
+
+inline void AssetStore::setHeadless(const bool &headless) { this->headless = headless; }
+
+void AssetStore::buildMasks(const AssetId &id, const sf::Uint8 *const pixels, const unsigned int &stride)
+{
+	if ( id == ASSET_GRASS ) {
+		return;
+	}
+	int count = (id == ASSET_SOLDIER) ? SOLDIER_FRAMES : 1;
+	for ( int i = 0 ; i < count ; i++ ) {
+		masks[firstRect(id) + i].build(pixels, stride, rects[firstRect(id) + i], 0);
+	}
+	//-> Bullet sprite is rotated according to its direction, see Bullet::init.
+	if ( id == ASSET_BULLET ) {
+		const sf::IntRect &rect = rects[firstRect(id)];
+		bulletMasks[UP].build(pixels, stride, rect, 0);
+		bulletMasks[DOWN].build(pixels, stride, rect, 180);
+		bulletMasks[LEFT].build(pixels, stride, rect, 270);
+		bulletMasks[RIGHT].build(pixels, stride, rect, 90);
+	}
+	//---
+}
+
+//-> Soldier frames are placed on a grid of 4 columns. All frames have the same size.
+bool AssetStore::decodeFiles(const string &textureDir, sf::Image *const images, sf::IntRect *const rects)
+{
+	for ( int i = 0 ; i < ASSET_SOLDIER ; i++ ) {
+		if ( !images[i].loadFromFile(textureDir + fileNames[i]) ) {
+			cout << "[ERROR] Texture loading error: " << fileNames[i] << endl;
+			return 0;
+		}
+		rects[firstRect(static_cast<AssetId>(i))] = sf::IntRect(0, 0, images[i].getSize().x, images[i].getSize().y);
+	}
+
+	sf::Image frames[SOLDIER_FRAMES];
+	for ( int i = 0 ; i < SOLDIER_FRAMES ; i++ ) {
+		if ( !frames[i].loadFromFile(textureDir + "soldier" + to_string(i) + ".png") ) {
+			cout << "[ERROR] Soldier texture loading error." << endl;
+			return 0;
+		}
+	}
+	const int columns = SOLDIER_ATLAS_COLUMNS;
+	const int rows = (SOLDIER_FRAMES + columns - 1) / columns;
+	sf::Vector2u frameSize = frames[0].getSize();
+	unsigned int atlasWidth = frameSize.x * columns;
+	unsigned int atlasHeight = frameSize.y * rows;
+	sf::Uint8 *pixels = new sf::Uint8[atlasWidth * atlasHeight * 4];
+	memset(pixels, 0, atlasWidth * atlasHeight * 4);
+	for ( int i = 0 ; i < SOLDIER_FRAMES ; i++ ) {
+		int left = (i % columns) * frameSize.x;
+		int top = (i / columns) * frameSize.y;
+		const sf::Uint8 *src = frames[i].getPixelsPtr();
+		for ( unsigned int y = 0 ; y < frameSize.y ; y++ ) {
+			memcpy(pixels + ((top + y) * atlasWidth + left) * 4, src + y * frameSize.x * 4, frameSize.x * 4);
+		}
+		rects[firstRect(ASSET_SOLDIER) + i] = sf::IntRect(left, top, frameSize.x, frameSize.y);
+	}
+	images[ASSET_SOLDIER].create(atlasWidth, atlasHeight, pixels);
+	delete [] pixels;
+	return 1;
+}
+//---
+
+bool AssetStore::loadFiles(const string &textureDir, const string &fontPath)
+{
+	sf::Image images[NUM_ASSETS];
+	if ( !decodeFiles(textureDir, images, rects) ) {
+		return 0;
+	}
+	for ( int i = 0 ; i < NUM_ASSETS ; i++ ) {
+		buildMasks(static_cast<AssetId>(i), images[i].getPixelsPtr(), images[i].getSize().x);
+	}
+	if ( headless ) {
+		return 1;
+	}
+	for ( int i = 0 ; i < NUM_ASSETS ; i++ ) {
+		textures[i].loadFromImage(images[i]);
+	}
+	//If background sprite is larger than the texture, then texture is repeated to fill it.
+	textures[ASSET_GRASS].setRepeated(true);
+	if ( !font.loadFromFile(fontPath) ) {
+		cout << "[ERROR] Font loading error." << endl;
+		return 0;
+	}
+	return 1;
+}
+
+//-> Every png file is a job of the pool. Decoded images are written into
+//   "decoded", which is not touched by the window thread until the job is ready.
+void AssetStore::loadFilesAsync(WorkerPool &pool, const string &textureDir, const string &fontPath)
+{
+	waitJobs();
+	const int numJobs = ASSET_SOLDIER + SOLDIER_FRAMES;
+	decoded = new sf::Image[numJobs];
+	decodeJobs = new future<bool>[numJobs];
+	failed = 0;
+	for ( int i = 0 ; i < numJobs ; i++ ) {
+		string path = textureDir + ((i < ASSET_SOLDIER) ? string(fileNames[i]) : "soldier" + to_string(i - ASSET_SOLDIER) + ".png");
+		sf::Image *image = decoded + i;
+		decodeJobs[i] = pool.submit([image, path]() {
+			AllocScope scope(TAG_ASSETS);
+			return image->loadFromFile(path);
+		});
+	}
+	delete [] fontData;
+	fontData = NULL;
+	fontJob = pool.submit([this, fontPath]() {
+		AllocScope scope(TAG_ASSETS);
+		return readFile(fontPath, fontData, fontDataSize);
+	});
+	numPending = numJobs + 1;
+}
+//---
+
+//-> Ready jobs are uploaded in the job order. Soldier atlas texture is created
+//   when the first soldier frame is ready, other frames are copied into it.
+int AssetStore::uploadReady(const int &maxUploads)
+{
+	const int numJobs = ASSET_SOLDIER + SOLDIER_FRAMES;
+	int uploads = 0;
+	for ( int i = 0 ; i < numJobs && uploads < maxUploads && decodeJobs != NULL ; i++ ) {
+		if ( !decodeJobs[i].valid() || decodeJobs[i].wait_for(chrono::seconds(0)) != future_status::ready ) {
+			continue;
+		}
+		if ( !decodeJobs[i].get() ) {
+			cout << "[ERROR] Texture loading error: job " << i << endl;
+			failed = 1;
+		} else if ( !uploadDecoded(i) ) {
+			failed = 1;
+		}
+		decoded[i] = sf::Image(); //Decoded pixels are not needed after the upload.
+		numPending--;
+		uploads++;
+	}
+	if ( fontJob.valid() && fontJob.wait_for(chrono::seconds(0)) == future_status::ready ) {
+		if ( !fontJob.get() || !font.loadFromMemory(fontData, fontDataSize) ) {
+			cout << "[ERROR] Font loading error." << endl;
+			failed = 1;
+		}
+		numPending--;
+	}
+	if ( numPending == 0 ) {
+		waitJobs();
+	}
+	return failed ? -1 : numPending;
+}
+//---
+
+bool AssetStore::uploadDecoded(const int &job)
+{
+	sf::Vector2u size = decoded[job].getSize();
+	if ( job < ASSET_SOLDIER ) {
+		textures[job].loadFromImage(decoded[job]);
+		rects[firstRect(static_cast<AssetId>(job))] = sf::IntRect(0, 0, size.x, size.y);
+		buildMasks(static_cast<AssetId>(job), decoded[job].getPixelsPtr(), size.x);
+		//If background sprite is larger than the texture, then texture is repeated to fill it.
+		if ( job == ASSET_GRASS ) {
+			textures[job].setRepeated(true);
+		}
+		return 1;
+	}
+	const int columns = SOLDIER_ATLAS_COLUMNS;
+	const int rows = (SOLDIER_FRAMES + columns - 1) / columns;
+	int frame = job - ASSET_SOLDIER;
+	sf::Texture &atlas = textures[ASSET_SOLDIER];
+	if ( atlas.getSize().x == 0 ) {
+		atlas.create(size.x * columns, size.y * rows);
+	}
+	if ( size.x * columns != atlas.getSize().x || size.y * rows != atlas.getSize().y ) {
+		cout << "[ERROR] Soldier frames should have the same size." << endl;
+		return 0;
+	}
+	int left = (frame % columns) * size.x;
+	int top = (frame / columns) * size.y;
+	atlas.update(decoded[job].getPixelsPtr(), size.x, size.y, left, top);
+	rects[firstRect(ASSET_SOLDIER) + frame] = sf::IntRect(left, top, size.x, size.y);
+	masks[firstRect(ASSET_SOLDIER) + frame].build(decoded[job].getPixelsPtr(), size.x, sf::IntRect(0, 0, size.x, size.y), 0);
+	return 1;
+}
+
+//-> Pending jobs are waited and job buffers are deleted.
+void AssetStore::waitJobs(void)
+{
+	if ( decodeJobs != NULL ) {
+		for ( int i = 0 ; i < ASSET_SOLDIER + SOLDIER_FRAMES ; i++ ) {
+			if ( decodeJobs[i].valid() ) {
+				decodeJobs[i].wait();
+			}
+		}
+	}
+	if ( fontJob.valid() ) {
+		fontJob.wait();
+	}
+	delete [] decodeJobs;
+	delete [] decoded;
+	decodeJobs = NULL;
+	decoded = NULL;
+}
+//---
+
+inline float AssetStore::getProgress(void)
+{
+	return 1.0f - CAST_FLOAT(numPending) / (ASSET_SOLDIER + SOLDIER_FRAMES + 1);
+}
+
+bool AssetStore::readFile(const string &path, char *&data, sf::Uint32 &size)
+{
+	ifstream file(path.c_str(), ios::binary | ios::ate);
+	if ( !file ) {
+		return 0;
+	}
+	size = file.tellg();
+	data = new char[size];
+	file.seekg(0);
+	return static_cast<bool>(file.read(data, size));
+}
+
+//-> Archive is mapped and textures are uploaded from the mapping, there is no
+//   png decode and no copy. After the upload pixel pages are dropped from the
+//   memory, font stays mapped because sf::Font reads it while the game runs.
+bool AssetStore::loadArchive(const string &archivePath)
+{
+	int fd = open(archivePath.c_str(), O_RDONLY);
+	if ( fd < 0 ) {
+		return 0;
+	}
+	struct stat info;
+	if ( fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(archiveHeader)) ) {
+		close(fd);
+		return 0;
+	}
+	unmap();
+	mappingSize = info.st_size;
+	mapping = mmap(NULL, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if ( mapping == MAP_FAILED ) {
+		mapping = NULL;
+		return 0;
+	}
+
+	const sf::Uint8 *base = static_cast<const sf::Uint8 *>(mapping);
+	const archiveHeader *header = reinterpret_cast<const archiveHeader *>(base);
+	const archivePage *pages = reinterpret_cast<const archivePage *>(header + 1);
+	const archiveRect *archiveRects = reinterpret_cast<const archiveRect *>(pages + NUM_ASSETS);
+	//-> Tables are read only after their counts are checked. Sizes are compared
+	//   with the space left after an offset, so a large offset can not wrap them.
+	const size_t tablesSize = sizeof(archiveHeader) + NUM_ASSETS * sizeof(archivePage) +
+							  (NUM_ASSETS - 1 + SOLDIER_FRAMES) * sizeof(archiveRect);
+	if ( memcmp(header->magic, ASSET_ARCHIVE_MAGIC, 4) != 0 || header->version != ASSET_ARCHIVE_VERSION ||
+		 header->numPages != NUM_ASSETS || header->numRects != NUM_ASSETS - 1 + SOLDIER_FRAMES ||
+		 mappingSize < tablesSize || header->fontOffset > mappingSize || header->fontSize > mappingSize - header->fontOffset ) {
+		cout << "[ERROR] Asset archive is corrupted or old: " << archivePath << endl;
+		unmap();
+		return 0;
+	}
+	for ( int i = 0 ; i < NUM_ASSETS ; i++ ) {
+		const sf::Uint64 pageSize = static_cast<sf::Uint64>(pages[i].width) * pages[i].height * 4;
+		if ( pages[i].offset < tablesSize || pages[i].offset > header->fontOffset || pageSize > header->fontOffset - pages[i].offset ) {
+			cout << "[ERROR] Asset archive is corrupted: " << archivePath << endl;
+			unmap();
+			return 0;
+		}
+	}
+	//Rects of the soldier frames are on the last page, the others on the page of their asset.
+	for ( unsigned int i = 0 ; i < header->numRects ; i++ ) {
+		const archivePage &page = pages[i < ASSET_SOLDIER ? i : static_cast<unsigned int>(ASSET_SOLDIER)];
+		const archiveRect &rect = archiveRects[i];
+		if ( rect.left < 0 || rect.top < 0 || rect.width <= 0 || rect.height <= 0 ||
+			 static_cast<sf::Int64>(rect.left) + rect.width > page.width || static_cast<sf::Int64>(rect.top) + rect.height > page.height ) {
+			cout << "[ERROR] Asset archive is corrupted: " << archivePath << endl;
+			unmap();
+			return 0;
+		}
+	}
+	//---
+	for ( int i = 0 ; i < NUM_ASSETS ; i++ ) {
+		if ( !headless ) {
+			textures[i].create(pages[i].width, pages[i].height);
+			textures[i].update(base + pages[i].offset);
+			textures[i].setRepeated(pages[i].repeated);
+		}
+	}
+	for ( unsigned int i = 0 ; i < header->numRects ; i++ ) {
+		rects[i] = sf::IntRect(archiveRects[i].left, archiveRects[i].top, archiveRects[i].width, archiveRects[i].height);
+	}
+	for ( int i = 0 ; i < NUM_ASSETS ; i++ ) {
+		buildMasks(static_cast<AssetId>(i), base + pages[i].offset, pages[i].width);
+	}
+	madvise(static_cast<char *>(mapping) + pages[0].offset, header->fontOffset - pages[0].offset, MADV_DONTNEED);
+	if ( headless ) {
+		return 1;
+	}
+	if ( !font.loadFromMemory(base + header->fontOffset, header->fontSize) ) {
+		cout << "[ERROR] Font loading error." << endl;
+		unmap();
+		return 0;
+	}
+	return 1;
+}
+//---
+
+//-> Offline packer, "./game --pack <archive>". Sizes and offsets are written
+//   first, then aligned pixel data and the font file.
+bool AssetStore::pack(const string &textureDir, const string &fontPath, const string &archivePath)
+{
+	sf::Image images[NUM_ASSETS];
+	sf::IntRect packRects[NUM_ASSETS - 1 + SOLDIER_FRAMES];
+	if ( !decodeFiles(textureDir, images, packRects) ) {
+		return 0;
+	}
+	char *fontData = NULL;
+	sf::Uint32 fontSize = 0;
+	if ( !readFile(fontPath, fontData, fontSize) ) {
+		cout << "[ERROR] Font loading error." << endl;
+		delete [] fontData;
+		return 0;
+	}
+
+	archiveHeader header;
+	archivePage pages[NUM_ASSETS];
+	archiveRect archiveRects[NUM_ASSETS - 1 + SOLDIER_FRAMES];
+	memcpy(header.magic, ASSET_ARCHIVE_MAGIC, 4);
+	header.version = ASSET_ARCHIVE_VERSION;
+	header.numPages = NUM_ASSETS;
+	header.numRects = NUM_ASSETS - 1 + SOLDIER_FRAMES;
+	sf::Uint32 offset = sizeof(header) + sizeof(pages) + sizeof(archiveRects);
+	for ( int i = 0 ; i < NUM_ASSETS ; i++ ) {
+		offset = (offset + ASSET_ARCHIVE_ALIGN - 1) / ASSET_ARCHIVE_ALIGN * ASSET_ARCHIVE_ALIGN;
+		pages[i].width = images[i].getSize().x;
+		pages[i].height = images[i].getSize().y;
+		pages[i].offset = offset;
+		pages[i].repeated = (i == ASSET_GRASS);
+		offset += pages[i].width * pages[i].height * 4;
+	}
+	for ( unsigned int i = 0 ; i < header.numRects ; i++ ) {
+		archiveRects[i].left = packRects[i].left;
+		archiveRects[i].top = packRects[i].top;
+		archiveRects[i].width = packRects[i].width;
+		archiveRects[i].height = packRects[i].height;
+	}
+	header.fontOffset = (offset + ASSET_ARCHIVE_ALIGN - 1) / ASSET_ARCHIVE_ALIGN * ASSET_ARCHIVE_ALIGN;
+	header.fontSize = fontSize;
+
+	ofstream out(archivePath.c_str(), ios::binary);
+	out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char *>(pages), sizeof(pages));
+	out.write(reinterpret_cast<const char *>(archiveRects), sizeof(archiveRects));
+	for ( int i = 0 ; i < NUM_ASSETS ; i++ ) {
+		while ( static_cast<sf::Uint32>(out.tellp()) < pages[i].offset ) {
+			out.put(0);
+		}
+		out.write(reinterpret_cast<const char *>(images[i].getPixelsPtr()), pages[i].width * pages[i].height * 4);
+	}
+	while ( static_cast<sf::Uint32>(out.tellp()) < header.fontOffset ) {
+		out.put(0);
+	}
+	out.write(fontData, fontSize);
+	delete [] fontData;
+	if ( !out ) {
+		cout << "[ERROR] Asset archive can not be written: " << archivePath << endl;
+		return 0;
+	}
+	cout << "[INFO] Asset archive is written: " << archivePath << " (" << out.tellp() << " bytes)" << endl;
+	return 1;
+}
+//---
+
+long residentKB(void)
+{
+	long pages = 0, resident = 0;
+	ifstream statm("/proc/self/statm");
+	statm >> pages >> resident;
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+
+//////////////////////////////////// Definitions of GameMap Class
+GameMap::GameMap() :	mapping(NULL),
+						mappingSize(0),
+						header(NULL),
+						obstacles(NULL),
+						cellStart(NULL),
+						cellItems(NULL),
+						spawns(NULL),
+						navigation(NULL) {}
+
+GameMap::~GameMap() { unmap(); }
+
+void GameMap::unmap(void)
+{
+	if ( mapping != NULL ) {
+		munmap(mapping, mappingSize);
+		mapping = NULL;
+		header = NULL;
+	}
+}
+
+inline bool GameMap::isLoaded(void) const { return header != NULL; }
+
+inline sf::Vector2u GameMap::getSize(void) const { return sf::Vector2u(header->width, header->height); }
+
+inline int GameMap::getNumBarrels(void) const { return header->numBarrels; }
+
+inline int GameMap::getNumSandbags(void) const { return header->numSandbags; }
+
+inline sf::Vector2f GameMap::getBarrel(const int &i) const { return sf::Vector2f(obstacles[i].x, obstacles[i].y); }
+
+inline sf::Vector2f GameMap::getSandbag(const int &i) const
+{
+	const mapPoint &point = obstacles[header->numBarrels + i];
+	return sf::Vector2f(point.x, point.y);
+}
+
+inline unsigned int GameMap::getNumSpawns(void) const { return header->numSpawns; }
+
+inline sf::Vector2f GameMap::getSpawn(const unsigned int &i) const { return sf::Vector2f(spawns[i].x, spawns[i].y); }
+
+inline void GameMap::cellRange(const sf::FloatRect &box, const int &columns, const int &rows, int *const range)
+{
+	range[0] = max(0, min(columns - 1, static_cast<int>(floor(box.left / MAP_CELL_SIZE))));
+	range[1] = max(0, min(rows - 1, static_cast<int>(floor(box.top / MAP_CELL_SIZE))));
+	range[2] = max(0, min(columns - 1, static_cast<int>(floor((box.left + box.width) / MAP_CELL_SIZE))));
+	range[3] = max(0, min(rows - 1, static_cast<int>(floor((box.top + box.height) / MAP_CELL_SIZE))));
+}
+
+//-> Sizes of the sections come from the header, so a file which is not exactly
+//   that long is rejected. Offsets of the index are checked, as they are used
+//   without bounds checks while playing.
+bool GameMap::load(const string &path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if ( fd < 0 ) {
+		cout << "[ERROR] Map file can not be opened: " << path << endl;
+		return 0;
+	}
+	struct stat info;
+	if ( fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(mapHeader)) ) {
+		cout << "[ERROR] Map file is corrupted: " << path << endl;
+		close(fd);
+		return 0;
+	}
+	unmap();
+	mappingSize = info.st_size;
+	mapping = mmap(NULL, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if ( mapping == MAP_FAILED ) {
+		mapping = NULL;
+		return 0;
+	}
+
+	const mapHeader *file = static_cast<const mapHeader *>(mapping);
+	//-> Size is checked as the scenario options, a window and its render texture are as large as the map.
+	if ( file->width < SCENARIO_MIN_SIZE || file->width > SCENARIO_MAX_SIZE || file->height < SCENARIO_MIN_SIZE || file->height > SCENARIO_MAX_SIZE ) {
+		cout << "[ERROR] Map size should be between " << SCENARIO_MIN_SIZE << " and " << SCENARIO_MAX_SIZE << ": " << path << endl;
+		unmap();
+		return 0;
+	}
+	//---
+	const size_t numCells = static_cast<size_t>(file->columns) * file->rows;
+	const size_t numObstacles = static_cast<size_t>(file->numBarrels) + file->numSandbags;
+	if ( memcmp(file->magic, MAP_MAGIC, 4) != 0 || file->version != MAP_VERSION || file->cellSize != MAP_CELL_SIZE ||
+		 file->columns != (file->width + MAP_CELL_SIZE - 1) / MAP_CELL_SIZE || file->rows != (file->height + MAP_CELL_SIZE - 1) / MAP_CELL_SIZE ||
+		 mappingSize != sizeof(mapHeader) + numObstacles * sizeof(mapPoint) + (numCells + 1) * sizeof(sf::Uint32) +
+						file->numCellItems * sizeof(sf::Uint32) + file->numSpawns * sizeof(mapPoint) + numCells ) {
+		cout << "[ERROR] Map file is corrupted or old: " << path << endl;
+		unmap();
+		return 0;
+	}
+	const sf::Uint8 *base = static_cast<const sf::Uint8 *>(mapping) + sizeof(mapHeader);
+	obstacles = reinterpret_cast<const mapPoint *>(base);
+	cellStart = reinterpret_cast<const sf::Uint32 *>(obstacles + numObstacles);
+	cellItems = cellStart + numCells + 1;
+	spawns = reinterpret_cast<const mapPoint *>(cellItems + file->numCellItems);
+	navigation = reinterpret_cast<const sf::Uint8 *>(spawns + file->numSpawns);
+	bool valid = (cellStart[numCells] == file->numCellItems);
+	for ( size_t i = 0 ; i < numCells && valid ; i++ ) {
+		valid = (cellStart[i] <= cellStart[i + 1]);
+	}
+	for ( sf::Uint32 i = 0 ; i < file->numCellItems && valid ; i++ ) {
+		valid = (cellItems[i] < numObstacles);
+	}
+	if ( !valid || file->numSpawns < MAP_MIN_SPAWNS || file->numBarrels > SNAP_MAX_BARRELS || file->numSandbags > SCENARIO_MAX_SANDBAGS ) {
+		cout << "[ERROR] Map file is corrupted: " << path << endl;
+		unmap();
+		return 0;
+	}
+	header = file;
+	return 1;
+}
+//---
+
+bool GameMap::matches(AssetStore &assets) const
+{
+	const AssetId ids[] = {ASSET_BARREL, ASSET_BAGS, ASSET_SOLDIER};
+	for ( int i = 0 ; i < 3 ; i++ ) {
+		sf::Vector2u size = assets.getMasks(ids[i])->getSize();
+		if ( size.x != header->maskSizes[2 * i] || size.y != header->maskSizes[2 * i + 1] ) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+//-> Index is built from the opaque boxes of the obstacles, a cell is not
+//   walkable if a box touches it. A spawn is a soldier frame which is in the
+//   map and whose box, grown by PADDING, touches no obstacle box.
+bool GameMap::save(	const string &path,
+					const sf::Vector2u &worldSize,
+					Barrel *const barrels,
+					Sandbag *const sandbags,
+					const int &nb,
+					const int &ns,
+					AssetStore &assets)
+{
+	mapHeader out;
+	memset(&out, 0, sizeof(out));
+	memcpy(out.magic, MAP_MAGIC, 4);
+	out.version = MAP_VERSION;
+	out.width = worldSize.x;
+	out.height = worldSize.y;
+	out.numBarrels = nb;
+	out.numSandbags = ns;
+	out.cellSize = MAP_CELL_SIZE;
+	out.columns = (worldSize.x + MAP_CELL_SIZE - 1) / MAP_CELL_SIZE;
+	out.rows = (worldSize.y + MAP_CELL_SIZE - 1) / MAP_CELL_SIZE;
+	const AssetId ids[] = {ASSET_BARREL, ASSET_BAGS, ASSET_SOLDIER};
+	for ( int i = 0 ; i < 3 ; i++ ) {
+		out.maskSizes[2 * i] = assets.getMasks(ids[i])->getSize().x;
+		out.maskSizes[2 * i + 1] = assets.getMasks(ids[i])->getSize().y;
+	}
+	const int numCells = out.columns * out.rows;
+
+	vector<mapPoint> points(nb + ns);
+	vector<sf::FloatRect> boxes(nb + ns); //Indexed by slot.
+	for ( int i = 0 ; i < nb ; i++ ) {
+		mapPoint point = {barrels[i].getPosition().x, barrels[i].getPosition().y};
+		points[i] = point;
+		boxes[ns + i] = barrels[i].getOpaqueBox();
+	}
+	for ( int i = 0 ; i < ns ; i++ ) {
+		mapPoint point = {sandbags[i].getPosition().x, sandbags[i].getPosition().y};
+		points[nb + i] = point;
+		boxes[i] = sandbags[i].getOpaqueBox();
+	}
+
+	//-> Cells are counted first, then the slots are written in ascending order.
+	vector<sf::Uint32> start(numCells + 1, 0);
+	int range[4];
+	for ( int s = 0 ; s < nb + ns ; s++ ) {
+		cellRange(boxes[s], out.columns, out.rows, range);
+		for ( int y = range[1] ; y <= range[3] ; y++ ) {
+			for ( int x = range[0] ; x <= range[2] ; x++ ) {
+				start[y * out.columns + x + 1]++;
+			}
+		}
+	}
+	for ( int c = 0 ; c < numCells ; c++ ) {
+		start[c + 1] += start[c];
+	}
+	vector<sf::Uint32> items(start[numCells]);
+	vector<sf::Uint32> next(start.begin(), start.end() - 1);
+	for ( int s = 0 ; s < nb + ns ; s++ ) {
+		cellRange(boxes[s], out.columns, out.rows, range);
+		for ( int y = range[1] ; y <= range[3] ; y++ ) {
+			for ( int x = range[0] ; x <= range[2] ; x++ ) {
+				items[next[y * out.columns + x]++] = s;
+			}
+		}
+	}
+	out.numCellItems = items.size();
+	vector<sf::Uint8> walkable(numCells);
+	for ( int c = 0 ; c < numCells ; c++ ) {
+		walkable[c] = (start[c] == start[c + 1]);
+	}
+	//---
+
+	//-> Spawn table.
+	vector<mapPoint> spawnTable;
+	const sf::Vector2u soldier = assets.getMasks(ASSET_SOLDIER)->getSize();
+	for ( unsigned int y = 0 ; y + soldier.y <= worldSize.y ; y += MAP_SPAWN_STEP ) {
+		for ( unsigned int x = 0 ; x + soldier.x <= worldSize.x ; x += MAP_SPAWN_STEP ) {
+			sf::FloatRect padded(CAST_FLOAT(x) - PADDING, CAST_FLOAT(y) - PADDING, soldier.x + 2 * PADDING, soldier.y + 2 * PADDING);
+			bool clear = 1;
+			cellRange(padded, out.columns, out.rows, range);
+			for ( int cy = range[1] ; cy <= range[3] && clear ; cy++ ) {
+				for ( int cx = range[0] ; cx <= range[2] && clear ; cx++ ) {
+					const int c = cy * out.columns + cx;
+					for ( sf::Uint32 i = start[c] ; i < start[c + 1] && clear ; i++ ) {
+						clear = !padded.intersects(boxes[items[i]]);
+					}
+				}
+			}
+			if ( clear ) {
+				mapPoint point = {CAST_FLOAT(x), CAST_FLOAT(y)};
+				spawnTable.push_back(point);
+			}
+		}
+	}
+	out.numSpawns = spawnTable.size();
+	if ( out.numSpawns < MAP_MIN_SPAWNS ) {
+		cout << "[ERROR] Map has " << out.numSpawns << " spawns, at least " << MAP_MIN_SPAWNS << " are needed." << endl;
+		return 0;
+	}
+	//---
+
+	ofstream file(path.c_str(), ios::binary);
+	file.write(reinterpret_cast<const char *>(&out), sizeof(out));
+	file.write(reinterpret_cast<const char *>(points.data()), points.size() * sizeof(mapPoint));
+	file.write(reinterpret_cast<const char *>(start.data()), start.size() * sizeof(sf::Uint32));
+	file.write(reinterpret_cast<const char *>(items.data()), items.size() * sizeof(sf::Uint32));
+	file.write(reinterpret_cast<const char *>(spawnTable.data()), spawnTable.size() * sizeof(mapPoint));
+	file.write(reinterpret_cast<const char *>(walkable.data()), walkable.size());
+	if ( !file ) {
+		cout << "[ERROR] Map file can not be written: " << path << endl;
+		return 0;
+	}
+	cout << "[INFO] Map file is written: " << path << " (" << file.tellp() << " bytes, " << out.numSpawns << " spawns)" << endl;
+	return 1;
+}
+//---
+
+//-> Slots of a cell are ascending, so the scan of a cell stops at the first hit
+//   or at a slot which is not lower than the best hit of the other cells.
+template <CollisionLayer A>
+int GameMap::findObstacle(const collider &mover, Barrel *const barrels, Sandbag *const sandbags) const
+{
+	const sf::IntRect &opaque = mover.mask->getOpaque();
+	const sf::Uint32 ns = header->numSandbags;
+	const sf::Vector2f corner = toFloat(mover.pos);
+	sf::FloatRect box(corner.x + opaque.left, corner.y + opaque.top, opaque.width, opaque.height);
+	int range[4];
+	cellRange(box, header->columns, header->rows, range);
+	sf::Uint32 best = 0xFFFFFFFF;
+	for ( int y = range[1] ; y <= range[3] ; y++ ) {
+		for ( int x = range[0] ; x <= range[2] ; x++ ) {
+			const int c = y * header->columns + x;
+			for ( const sf::Uint32 *p = cellItems + cellStart[c] ; p < cellItems + cellStart[c + 1] && *p < best ; p++ ) {
+				if ( (*p < ns) ? collidesWith<A>(mover, sandbags[*p]) : collidesWith<A>(mover, barrels[*p - ns]) ) {
+					best = *p;
+				}
+			}
+		}
+	}
+	return (best == 0xFFFFFFFF) ? -1 : static_cast<int>(best);
+}
+//---
+
+bool GameMap::isWalkable(const sf::Vector2f &point) const
+{
+	if ( point.x < 0 || point.y < 0 || point.x >= header->width || point.y >= header->height ) {
+		return 0;
+	}
+	return navigation[static_cast<int>(point.y / MAP_CELL_SIZE) * header->columns + static_cast<int>(point.x / MAP_CELL_SIZE)];
+}
+
+
+//////////////////////////////////// Definitions of Object Class
+void Object::init(	const sf::Vector2u *const worldSize,
+					const sf::Texture &texture,
+					const sf::Vector2f &pos,
+					const CollisionMask &mask)
+{
+	//-> Fill the class' attributes and create the sprite.
+	//   Texture is loaded by the AssetStore.
+	this->worldSize = worldSize;
+	this->texture = &texture;
+	this->mask = &mask;
+	maskOffset = sf::Vector2i(0, 0);
+	//Rect is the mask size, not the texture size, because there is no texture in headless games.
+	sprite.setTexture(texture);
+	sprite.setTextureRect(sf::IntRect(0, 0, mask.getSize().x, mask.getSize().y));
+	setPosition(pos);
+	//---
+}
+
+inline sf::Vector2f Object::getPosition()
+{
+	return toFloat(fixedPos);
+}
+
+inline sf::Vector2i Object::getFixedPos(void) { return fixedPos; }
+
+inline sf::Vector2u Object::getSize() { return mask->getSize(); }
+
+inline const CollisionMask &Object::getMask(void) { return *mask; }
+
+inline sf::Vector2f Object::getMaskPos(void) { return toFloat(fixedPos + maskOffset); }
+
+inline sf::Vector2i Object::getFixedMaskPos(void) { return fixedPos + maskOffset; }
+
+inline sf::FloatRect Object::getOpaqueBox(void)
+{
+	const sf::IntRect &opaque = mask->getOpaque();
+	sf::Vector2f pos = getMaskPos();
+	return sf::FloatRect(pos.x + opaque.left - 1, pos.y + opaque.top - 1, opaque.width + 2, opaque.height + 2);
+}
+
+inline void Object::setPosition(const sf::Vector2f &newPos) { setFixedPos(toFixed(newPos)); }
+
+inline void Object::setFixedPos(const sf::Vector2i &newPos)
+{
+	fixedPos = newPos;
+	sprite.setPosition(toFloat(fixedPos));
+}
+
+inline sf::FloatRect Object::getBounds(void) { return sprite.getGlobalBounds(); }
+
+inline void Object::paint(sf::RenderTarget &target)
+{
+	target.draw(sprite);
+}
+
+inline bool Object::appendQuad(ArenaArray<sf::Vertex> &batch)
+{
+	if ( batch.getFree() < 4 ) {
+		return 0;
+	}
+	const sf::IntRect &rect = sprite.getTextureRect();
+	sf::Transform transform = sprite.getTransform();
+	float w = rect.width, h = rect.height, u = rect.left, v = rect.top;
+	batch.push(sf::Vertex(transform.transformPoint(sf::Vector2f(0, 0)), sf::Vector2f(u, v)));
+	batch.push(sf::Vertex(transform.transformPoint(sf::Vector2f(w, 0)), sf::Vector2f(u + w, v)));
+	batch.push(sf::Vertex(transform.transformPoint(sf::Vector2f(w, h)), sf::Vector2f(u + w, v + h)));
+	batch.push(sf::Vertex(transform.transformPoint(sf::Vector2f(0, h)), sf::Vector2f(u, v + h)));
+	return 1;
+}
+
+
+//////////////////////////////////// Definitions of Sandbag Class
+//Sandbag class is directly inherited from Object Class. There is no additional changes.
+
+
+//////////////////////////////////// Definitions of Barrel Class
+//Set as visible in construction.
+Barrel::Barrel() : isVisible(1), hiddenHash(NULL), hashKey(0) {};
+
+inline bool Barrel::getVisible(void) { return isVisible; };
+
+inline void Barrel::setVisible(const bool &visible)
+{
+	if ( hiddenHash != NULL && visible != isVisible ) {
+		*hiddenHash ^= hashKey;
+	}
+	isVisible = visible;
+}
+
+void Barrel::setHash(sf::Uint64 *const hiddenHash, const int &index)
+{
+	this->hiddenHash = hiddenHash;
+	hashKey = StateHash::barrel(index);
+	if ( !isVisible ) {
+		*hiddenHash ^= hashKey;
+	}
+}
+
+//This is the overrided paint method. Additionally check the barrel's visibility.
+inline void Barrel::paint(sf::RenderTarget &target) { if (isVisible == 1) { target.draw(sprite); } };
+
+
+//////////////////////////////////// Definitions of Bullet Class
+//NULL is assigned to next and prev pointers in construction.
+Bullet::Bullet() : id(0), age(0), next(NULL), prev(NULL) {}
+
+//This is overrided init method. This method decides direction and position of the bullet.
+void Bullet::init(	const sf::Vector2u *const worldSize,
+				const sf::Texture &texture,
+				const CollisionMask *const masks,
+				const sf::Vector2i &pos,
+				const Direction &dir,
+				const float &speed,
+				const unsigned int &id)
+{
+	sf::Vector2u bulletSize;
+	sf::Vector2i gunOffset(0, 0);
+	const int step = toFixed(speed);
+	this->worldSize = worldSize;
+	this->id = id;
+	this->dir = dir;
+	this->speed = speed;
+	age = 0;
+	this->texture = &texture;
+	mask = masks + dir;
+	bulletSize = masks[UP].getSize(); //Unrotated bullet, the texture is empty in headless games.
+	sprite.setTexture(texture);
+	sprite.setTextureRect(sf::IntRect(0, 0, bulletSize.x, bulletSize.y));
+
+	//-> Here, origin of the bullet sprite is assigned according to the
+	//   rotation of the bullet. After the rotation, origin always is the
+	//   left-top of the rotated sprite. AND ALSO, position of the bullet
+	//   are adjusted so bullet texture looks like it is come from the
+	//   gun, offsets are from the top-left of the soldier frame.
+	//   Mask of the direction is rotated like the sprite, its offset is the
+	//   top-left of the rotated sprite. It is written here in whole pixels,
+	//   so it does not depend on the float rotation of the sprite.
+	//   Bullets are reused from the pool, so rotation is set instead of rotate.
+	switch (dir) {
+		case UP:
+			speedVector = sf::Vector2i(0, -step);
+			sprite.setOrigin(0, 0);
+			sprite.setRotation(0);
+			gunOffset = sf::Vector2i(55, 0);
+			maskOffset = sf::Vector2i(0, 0);
+			break;
+		case DOWN:
+			speedVector = sf::Vector2i(0, step);
+			sprite.setOrigin(bulletSize.x - 1, bulletSize.y - 1);
+			sprite.setRotation(180);
+			gunOffset = sf::Vector2i(25, 85);
+			maskOffset = sf::Vector2i(-FIXED_ONE, -FIXED_ONE);
+			break;
+		case LEFT:
+			speedVector = sf::Vector2i(-step, 0);
+			sprite.setOrigin(bulletSize.x - 1, 0);
+			sprite.setRotation(270);
+			gunOffset = sf::Vector2i(-15, 35);
+			maskOffset = sf::Vector2i(0, -FIXED_ONE);
+			break;
+		case RIGHT:
+			speedVector = sf::Vector2i(step, 0);
+			sprite.setOrigin(0, bulletSize.y - 1);
+			sprite.setRotation(90);
+			gunOffset = sf::Vector2i(80, 70);
+			maskOffset = sf::Vector2i(-FIXED_ONE, 0);
+			break;
+		default:
+			break;
+	}
+	//---
+	spawnPos = pos + gunOffset * FIXED_ONE;
+	setFixedPos(spawnPos);
+	StateHash::bullet(id, dir, speed, toFloat(spawnPos), hashKey, hashStep);
+}
+
+void Bullet::move(void)
+{
+	setFixedPos(fixedPos + speedVector);
+	age++;
+}
+
+void Bullet::save(bulletSnap &snap, const int &owner)
+{
+	snap.id = id;
+	snap.owner = owner;
+	snap.dir = dir;
+	snap.speed = speed;
+	snap.age = age;
+	snap.spawnPos = toFloat(spawnPos);
+}
+
+//Moves are fixed point, so "age" moves from the spawn position are exactly the saved position.
+void Bullet::restore(const bulletSnap &snap)
+{
+	spawnPos = toFixed(snap.spawnPos);
+	age = snap.age;
+	setFixedPos(spawnPos + speedVector * static_cast<int>(age));
+	StateHash::bullet(id, dir, speed, snap.spawnPos, hashKey, hashStep);
+}
+
+inline unsigned int Bullet::getId(void) { return id; }
+
+inline sf::Uint64 Bullet::getHashTerm(void) { return hashKey + age * hashStep; }
+
+inline sf::Uint64 Bullet::getHashStep(void) { return hashStep; }
+
+//////////////////////////////////// Definitions of BulletList Class
+//NULL is assigned to list pointers in construction.
+BulletList::BulletList() : pool(NULL), freeList(NULL), list(NULL), tail(NULL), count(0), hash(0), hashStep(0), telemetry(NULL), nextId(NULL) {}
+
+//Destructor prevents memory leaks. Bullets are in the pool, so only the pool is deleted.
+BulletList::~BulletList() { delete [] pool; }
+
+//-> All bullets of the list are returned to the pool.
+void BulletList::clear(void)
+{
+	while ( list != NULL ) {
+		remove(list);
+	}
+}
+//---
+
+inline Bullet *BulletList::getHead(void) { return list; }
+
+inline sf::Uint64 BulletList::getHash(void) { return hash; }
+
+inline int BulletList::getPoolIndex(Bullet *const bullet) { return bullet - pool; }
+
+//-> Texture is shared by all bullets. Pool is created here and all of
+//   its bullets are put into the free list. Id counter belongs to the game.
+void BulletList::init(	const sf::Vector2u *const worldSize,
+						const GameMap *const map,
+						const sf::Texture &texture,
+						const CollisionMask *const masks,
+						Player *const owner,
+						unsigned int *const nextId)
+{
+	this->worldSize = worldSize;
+	this->nextId = nextId;
+	this->map = map;
+	this->owner = owner;
+	this->texture = &texture;
+	this->masks = masks;
+	pool = new Bullet[BULLET_POOL_SIZE];
+	for ( int i = 0 ; i < BULLET_POOL_SIZE ; i++ ) {
+		pool[i].next = (i + 1 < BULLET_POOL_SIZE) ? &pool[i + 1] : NULL;
+	}
+	freeList = pool;
+}
+//---
+
+//-> Linked list node addition. NULL means the pool is empty.
+Bullet *BulletList::append(void)
+{
+	if ( freeList == NULL ) {
+		return NULL;
+	}
+	Bullet *newBullet = freeList;
+	freeList = freeList->next;
+	newBullet->next = NULL;
+	newBullet->prev = tail;
+	if ( tail != NULL ) {
+		tail->next = newBullet;
+	} else {
+		list = newBullet;
+	}
+	tail = newBullet;
+	count++;
+	return newBullet;
+}
+//---
+
+//-> This method add new bullet to the bullets' linked list.
+//   It decides the bullet's position according to the state of soldier.
+bool BulletList::add(const sf::Vector2i &pos, const int &state, const float &speed)
+{
+	Direction dir;
+	//-> Direction decision according to the state.
+	switch (state) {
+		case 0:
+		case 7:
+		case 8:
+			dir = UP;
+			break;
+		case 2:
+		case 9:
+		case 10:
+			dir = RIGHT;
+			break;
+		case 4:
+		case 3:
+		case 11:
+			dir = DOWN;
+			break;
+		case 6:
+		case 12:
+		case 13:
+			dir = LEFT;
+			break;
+		default:
+			return 0;
+	}
+	//---
+
+	//-> If all bullets of the pool are flying, new fire is ignored.
+	Bullet *newBullet = append();
+	if ( newBullet == NULL ) {
+		return 0;
+	}
+	newBullet->init(worldSize, *texture, masks, pos, dir, speed, (*nextId)++);
+	hash += newBullet->getHashTerm();
+	hashStep += newBullet->getHashStep();
+	return 1;
+	//---
+}
+
+inline void BulletList::setTelemetry(TelemetrySink *const telemetry) { this->telemetry = telemetry; }
+//---
+
+//-> Bullet is created from the snapshot and appended to the list.
+void BulletList::load(const bulletSnap &snap)
+{
+	Bullet *newBullet = append();
+	if ( newBullet == NULL ) {
+		return;
+	}
+	newBullet->init(worldSize, *texture, masks, toFixed(snap.spawnPos), snap.dir, snap.speed, snap.id);
+	newBullet->restore(snap);
+	hash += newBullet->getHashTerm();
+	hashStep += newBullet->getHashStep();
+	//-> New bullets should not reuse the ids of loaded bullets.
+	if ( snap.id >= *nextId ) {
+		*nextId = snap.id + 1;
+	}
+	//---
+}
+//---
+
+//-> This method removes given node, adjusts the list pointers and
+//   returns the node to the pool.
+void BulletList::remove(Bullet *temp)
+{
+	if ( temp != NULL ) {
+		if ( temp->prev != NULL ) {
+			temp->prev->next = temp->next;
+		} else {
+			list = temp->next;
+		}
+		if ( temp->next != NULL ) {
+			temp->next->prev = temp->prev;
+		} else {
+			tail = temp->prev;
+		}
+		temp->prev = NULL;
+		temp->next = freeList;
+		freeList = temp;
+		count--;
+		hash -= temp->getHashTerm();
+		hashStep -= temp->getHashStep();
+	}
+}
+
+inline int BulletList::size(void) { return count; }
+//---
+
+//-> This method first check the collision of the bullets in the list.
+//   Then move bullets. Bullets are painted by paint(), this method only simulates.
+//   Candidates of a bullet are the pairs of its slot, sorted by the entity slots.
+//   Without pairs (brute force), every entity is a candidate.
+void BulletList::update(Player *const players,
+						Barrel *const barrels,
+						Sandbag *const sandbags,
+						const int &np,
+						const int &nb,
+						const int &ns,
+						ArenaArray<hitEvent> &hits,
+						const sf::Uint32 *const pairs,
+						const size_t &numPairs,
+						const int &firstSlot)
+{
+	Bullet *temp = list; //Holds the list
+	Bullet *newTemp; //Holds the next node of the removed temp.
+	while ( temp != NULL ) {
+		//Get position and size of the bullet, in fixed point.
+		sf::Vector2i bulletPos = temp->getFixedPos();
+		sf::Vector2i bulletSize(temp->getSize().x * FIXED_ONE, temp->getSize().y * FIXED_ONE);
+
+		//-> Entity slots are sandbags, barrels and then players. First hit slot is the
+		//   same as the order of the checks, so both ways give the same result.
+		int hit = -1;
+		const collider mover = {&temp->getMask(), temp->getFixedMaskPos(), owner, owner->getTeam()};
+		if ( pairs != NULL ) {
+			const sf::Uint32 slot = firstSlot + getPoolIndex(temp);
+			const sf::Uint32 *end = pairs + numPairs;
+			for ( const sf::Uint32 *p = lower_bound(pairs, end, slot << 16) ; p < end && (*p >> 16) == slot ; p++ ) {
+				if ( isHit(temp, *p & 0xFFFF, players, barrels, sandbags, nb, ns) ) {
+					hit = *p & 0xFFFF;
+					break;
+				}
+			}
+		} else {
+			int i = -1;
+			if ( map != NULL ) {
+				hit = map->findObstacle<LAYER_BULLET>(mover, barrels, sandbags);
+			} else if ( (i = firstCollision<LAYER_BULLET>(mover, sandbags, ns)) >= 0 ) {
+				hit = i;
+			} else if ( (i = firstCollision<LAYER_BULLET>(mover, barrels, nb)) >= 0 ) {
+				hit = ns + i;
+			}
+			if ( hit < 0 && (i = firstCollision<LAYER_BULLET>(mover, players, np)) >= 0 ) {
+				hit = ns + nb + i;
+			}
+		}
+		//---
+
+		//-> Collision with sandbag just removes bullet. If there is a collision with barrel,
+		//   then both barrel and bullet will be removed. If there is a collision with a player,
+		//   then a hit event is added. Player will be born at random location and owner of the
+		//   bullet get a point when it is applied.
+		if ( hit >= 0 ) {
+			if ( telemetry != NULL ) {
+				const int layer = (hit < ns) ? LAYER_SANDBAG : ((hit < ns + nb) ? LAYER_BARREL : LAYER_SOLDIER);
+				const int index = (hit < ns) ? hit : ((hit < ns + nb) ? hit - ns : hit - ns - nb);
+				telemetry->record(TEL_HIT, owner - players, layer, index, 0);
+			}
+			if ( hit >= ns && hit < ns + nb ) {
+				barrels[hit - ns].setVisible(0);
+			} else if ( hit >= ns + nb ) {
+				int i = hit - ns - nb;
+				hitEvent event = {static_cast<unsigned char>(i), static_cast<unsigned char>(owner - players)};
+				if ( !hits.push(event) ) { //Arena is full, hit is applied at once.
+					players[i].reborn(players, barrels, sandbags, np, nb, ns);
+					owner->incrementScore();
+				}
+			}
+			newTemp = temp->next;
+			remove(temp);
+			temp = newTemp;
+			continue;
+		}
+		//---
+
+		//-> This if block prevent the bullet from go beyond the window limit.
+		if ( (bulletPos.x < -bulletSize.x) || //Left window limit
+			 (bulletPos.y < -bulletSize.y) || //Up window limit
+			 (bulletPos.x > static_cast<int>(worldSize->x) * FIXED_ONE) || //Right window limit
+			 (bulletPos.y > static_cast<int>(worldSize->y) * FIXED_ONE) // Bottom window limit
+			 ) {
+			newTemp = temp->next;
+			remove(temp);
+			temp = newTemp;
+			continue;
+		}
+		//---
+		temp->move();
+		temp = temp->next;
+	}
+	hash += hashStep; //Every bullet which is left is moved once.
+}
+
+inline bool BulletList::isHit(	Bullet *const bullet,
+								const int &slot,
+								Player *const players,
+								Barrel *const barrels,
+								Sandbag *const sandbags,
+								const int &nb,
+								const int &ns)
+{
+	const collider mover = {&bullet->getMask(), bullet->getFixedMaskPos(), owner, owner->getTeam()};
+	if ( slot < ns ) {
+		return collidesWith<LAYER_BULLET>(mover, sandbags[slot]);
+	}
+	if ( slot < ns + nb ) {
+		return collidesWith<LAYER_BULLET>(mover, barrels[slot - ns]);
+	}
+	return collidesWith<LAYER_BULLET>(mover, players[slot - ns - nb]);
+}
+
+void BulletList::paint(ArenaArray<sf::Vertex> &batch)
+{
+	for ( Bullet *temp = list ; temp != NULL && temp->appendQuad(batch) ; temp = temp->next ) {
+	}
+}
+
+//////////////////////////////////// Definitions of Player Class
+void Player::init(	const sf::Vector2u *const worldSize,
+				const GameMap *const map,
+				Random *const rng,
+				const sf::Texture &atlas,
+				const sf::IntRect *const frames,
+				const CollisionMask *const masks,
+				const sf::Vector2f &pos)
+{
+	this->worldSize = worldSize;
+	this->map = map;
+	this->rng = rng;
+	this->texture = &atlas;
+	this->frames = frames;
+	this->masks = masks;
+	maskOffset = sf::Vector2i(0, 0); //Soldier sprite has no origin.
+	state = 0;
+	s = 0;
+	oldDir = -1; //Means init step
+	score = 0;
+	deaths = 0;
+	team = -1;
+	telemetry = NULL;
+	id = 0;
+	//-> We will use soldier0.png at the beginning
+	sprite.setTexture(atlas);
+	setFrame();
+	//---
+	setPosition(pos);
+}
+
+inline void Player::setFrame(void)
+{
+	sprite.setTextureRect(frames[state]);
+	mask = masks + state;
+}
+
+inline void Player::fire(BulletList *const list, const float &speed)
+{
+	if ( list->add(fixedPos, state, speed) && telemetry != NULL ) {
+		telemetry->record(TEL_SHOT, id, 0, 0, 0);
+	}
+}
+
+//-> This method moves the soldier to the random location.
+void Player::reborn(Player *const players,
+					Barrel *const barrels,
+					Sandbag *const sandbags,
+					const int &np,
+					const int &nb,
+					const int &ns)
+{
+	sf::Vector2u curSize = getSize();
+	sf::Vector2u limits = *worldSize - curSize;
+	const CollisionMask &curMask = getMask();
+	sf::Vector2i newPos; //Soldier has no origin, so it is also the position of the mask.
+	int attempts = 0;
+	//-> Collision check loop. Spawns of a map touch no obstacle, so only the
+	//   players are checked for them.
+	while ( 1 ) {
+		attempts++;
+		if ( map != NULL ) {
+			newPos = toFixed(map->getSpawn(rng->next() % map->getNumSpawns()));
+		} else {
+			newPos.x = (rng->next() % limits.x) * FIXED_ONE;
+			newPos.y = (rng->next() % limits.y) * FIXED_ONE;
+		}
+		const collider mover = {&curMask, newPos, this, team};
+		if ( map == NULL && (firstCollision<LAYER_SOLDIER>(mover, barrels, nb) >= 0 || firstCollision<LAYER_SOLDIER>(mover, sandbags, ns) >= 0) ) {
+			continue;
+		}
+		if ( firstCollision<LAYER_SOLDIER>(mover, players, np) < 0 ) {
+			break;
+		}
+	}
+	//---
+	this->setFixedPos(newPos);
+	deaths++;
+	if ( telemetry != NULL ) {
+		telemetry->record(TEL_RESPAWN, id, 0, 0, attempts);
+	}
+}
+
+inline void Player::incrementScore(void) { score += 1; }
+
+inline int Player::getScore(void) { return score; }
+
+inline int Player::getDeaths(void) { return deaths; }
+
+inline void Player::setTeam(const int &team) { this->team = team; }
+
+inline int Player::getTeam(void) { return team; }
+
+inline void Player::setTelemetry(TelemetrySink *const telemetry, const int &id)
+{
+	this->telemetry = telemetry;
+	this->id = id;
+}
+
+void Player::reset(void)
+{
+	state = 0;
+	s = 0;
+	oldDir = -1;
+	score = 0;
+	deaths = 0;
+	setFrame();
+}
+void Player::save(playerSnap &snap)
+{
+	snap.pos = getPosition();
+	snap.state = state;
+	snap.s = s;
+	snap.oldDir = oldDir;
+	snap.score = score;
+	snap.deaths = deaths;
+}
+
+void Player::load(const playerSnap &snap)
+{
+	setPosition(snap.pos);
+	state = snap.state;
+	setFrame();
+	s = snap.s;
+	oldDir = snap.oldDir;
+	score = snap.score;
+	deaths = snap.deaths;
+}
+
+void Player::walk(	const float speed,
+					const Direction &dir,
+					Player *const players,
+					Barrel *const barrels,
+					Sandbag *const sandbags,
+					const int &np,
+					const int &nb,
+					const int &ns)
+{
+	sf::Vector2i velocityVector(0,0); //Fixed point.
+	const int step = toFixed(speed);
+	//-> As different from the given state, I implement a mechanism that used for the
+	//   opposite side movements (Press UP key when soldier look at the DOWN etc.).
+	//   In intermediate phases of the soldire (state 1,3,5,7) according to the
+	//   movement direction, old direction is guessed and saved. For example if soldier moves
+	//   state 1 to state 0 (UP) then old state will be state 2 (RIGHT) because it is probably the old direction.
+	//   Then if DOWN key pressed when soldier look at the UP, user move according to the oldDir.
+	switch (state) {
+		case 0:
+			switch (dir) {
+				case RIGHT:
+					state = 1;
+					break;
+				case LEFT:
+					s = 1;
+					state = 7;
+					break;
+				case DOWN:
+					if ( oldDir == LEFT ) {
+						s = 1;
+						state = 7;
+					} else if ( oldDir == RIGHT ) {
+						state = 1;
+					} else {
+						state = 1; //To handle init value (-1) of oldDir.
+					}
+					break;
+				case UP:
+					if ( s == 0 ) {
+						state = 7;
+						s = 1;
+						velocityVector.x += 0;
+						velocityVector.y += -1 * step;
+					} else if ( s == 1 ) {
+						state = 8;
+						s = 0;
+						velocityVector.x += 0;
+						velocityVector.y += -1 * step;
+					}
+					break;
+			}
+			break;
+		case 1:
+			switch (dir) {
+				case UP:
+				case LEFT:
+					state = 0;
+					oldDir = RIGHT;
+					break;
+				case DOWN:
+				case RIGHT:
+					state = 2;
+					oldDir = UP;
+					break;
+			}
+			break;
+		case 2:
+			switch (dir) {
+				case UP:
+					state = 1;
+					break;
+				case DOWN:
+					s = 1;
+					state = 3;
+					break;
+				case LEFT:
+					if ( oldDir == UP ) {
+						state = 1;
+					} else if ( oldDir == DOWN ) {
+						s = 1;
+						state = 3;
+					}
+					break;
+				case RIGHT:
+					if ( s == 0 ) {
+						s = 1;
+						state = 10;
+						velocityVector.x += step;
+						velocityVector.y += 0;
+					} else if ( s == 1 ) {
+						s = 0;
+						state = 9;
+						velocityVector.x += step;
+						velocityVector.y += 0;
+					}
+					break;
+			}
+			break;
+		case 3:
+			switch (dir) {
+				case UP:
+				case RIGHT:
+					state = 2;
+					oldDir = DOWN;
+					break;
+				case DOWN:
+					velocityVector.x += 0;
+					velocityVector.y += step;
+				case LEFT:
+					state = 4;
+					oldDir = RIGHT;
+					break;
+			}
+			break;
+		case 4:
+			switch (dir) {
+				case RIGHT:
+					state = 3;
+					s = 1;
+					break;
+				case LEFT:
+					state = 5;
+					break;
+				case UP:
+					if ( oldDir == RIGHT ) {
+						state = 3;
+						s = 1;
+					} else if ( oldDir == LEFT ) {
+						state = 5;
+					}
+					break;
+				case DOWN:
+					if ( s == 0 ) {
+						state = 3;
+						s = 1;
+						velocityVector.x += 0;
+						velocityVector.y += step;
+					} else if ( s == 1 ) {
+						state = 11;
 						s = 0;
 						velocityVector.x += 0;
-						velocityVector.y += -1 * speed;
+						velocityVector.y += step;
+					}
+					break;
+			}
+			break;
+		case 5:
+			switch (dir) {
+				case UP:
+				case LEFT:
+					state = 6;
+					oldDir = DOWN;
+					break;
+				case DOWN:
+				case RIGHT:
+					state = 4;
+					oldDir = LEFT;
+					break;
+			}
+			break;
+		case 6:
+			switch (dir) {
+				case UP:
+					state = 7;
+					s = 1;
+					break;
+				case DOWN:
+					state = 5;
+					break;
+				case RIGHT:
+					if ( oldDir == DOWN ) {
+						state = 5;
+					} else if ( oldDir == UP ) {
+						state = 7;
+						s = 1;
+					}
+					break;
+				case LEFT:
+					if ( s == 0 ) {
+						state = 13;
+						s = 1;
+						velocityVector.x += -1 * step;
+						velocityVector.y += 0;
+					} else if ( s == 1 ) {
+						state = 12;
+						s = 0;
+						velocityVector.x += -1 * step;
+						velocityVector.y += 0;
+					}
+					break;
+			}
+			break;
+		case 7:
+			switch (dir) {
+				case UP:
+					velocityVector.x += 0;
+					velocityVector.y += -1 * step;
+				case RIGHT:
+					state = 0;
+					oldDir = LEFT;
+					break;
+				case DOWN:
+				case LEFT:
+					state = 6;
+					oldDir = UP;
+					break;
+			}
+			break;
+		case 8:
+			velocityVector.x += 0;
+			velocityVector.y += -1 * step;
+			state = 0;
+			break;
+		case 9:
+			velocityVector.x += step;
+			velocityVector.y += 0;
+			state = 2;
+			break;
+		case 10:
+			velocityVector.x += step;
+			velocityVector.y += 0;
+			state = 2;
+			break;
+		case 11:
+			velocityVector.x += 0;
+			velocityVector.y += step;
+			state = 4;
+			break;
+		case 12:
+			velocityVector.x += -1 * step;
+			velocityVector.y += 0;
+			state = 6;
+			break;
+		case 13:
+			velocityVector.x += -1 * step;
+			velocityVector.y += 0;
+			state = 6;
+			break;
+		default:
+			break;
+	}
+	//---
+
+	setFrame();
+	sf::Vector2i newPos = getFixedMaskPos() + velocityVector;
+	const CollisionMask &curMask = getMask();
+	//-> Collision check of the given soldier with barrels sandbags and other soldier(s).
+	const collider mover = {&curMask, newPos, this, team};
+	if ( map != NULL && map->findObstacle<LAYER_SOLDIER>(mover, barrels, sandbags) >= 0 ) {
+		return;
+	}
+	if ( map == NULL && (firstCollision<LAYER_SOLDIER>(mover, barrels, nb) >= 0 || firstCollision<LAYER_SOLDIER>(mover, sandbags, ns) >= 0) ) {
+		return;
+	}
+	if ( firstCollision<LAYER_SOLDIER>(mover, players, np) >= 0 ) {
+		return;
+	}
+	//---
+
+	//-> This if block prevent the opaque pixels of the soldier from go beyond the window limit.
+	const sf::IntRect &opaque = curMask.getOpaque();
+	if ( (newPos.x + opaque.left * FIXED_ONE >= 0) && //Left window limit
+		 (newPos.y + opaque.top * FIXED_ONE >= 0) && //Up window limit
+		 (newPos.x + (opaque.left + opaque.width) * FIXED_ONE <= static_cast<int>(worldSize->x) * FIXED_ONE) && //Right window limit
+		 (newPos.y + (opaque.top + opaque.height) * FIXED_ONE <= static_cast<int>(worldSize->y) * FIXED_ONE) // Bottom window limit
+		 ) {
+		setFixedPos(fixedPos + velocityVector); //If there is no collision then soldier will move
+	}
+	//---
+}
+
+inline int Player::getFrame(void) { return state; }
+
+//////////////////////////////////// Definitions of BitWriter and BitReader Classes
+BitWriter::BitWriter(unsigned char *const buf, const unsigned int &capacity) :	buf(buf),
+																				capacity(capacity),
+																				bitPos(0),
+																				overflow(0) {}
+
+//-> Bits are written LSB first. A new byte is cleared before its first bit is written,
+//   so the buffer does not need to be cleared by the caller.
+void BitWriter::write(unsigned int value, const int &bits)
+{
+	int remaining = bits;
+	while ( remaining > 0 ) {
+		unsigned int byteIndex = bitPos >> 3;
+		unsigned int bitOffset = bitPos & 7;
+		if ( byteIndex >= capacity ) {
+			overflow = 1;
+			return;
+		}
+		if ( bitOffset == 0 ) {
+			buf[byteIndex] = 0;
+		}
+		int n = 8 - bitOffset;
+		if ( n > remaining ) {
+			n = remaining;
+		}
+		unsigned int mask = (1u << n) - 1;
+		buf[byteIndex] |= (value & mask) << bitOffset;
+		value >>= n;
+		remaining -= n;
+		bitPos += n;
+	}
+}
+//---
+
+void BitWriter::writeVar(unsigned int value)
+{
+	do {
+		unsigned int group = value & 0x7f;
+		value >>= 7;
+		write(group | (value != 0 ? 0x80 : 0), 8);
+	} while ( value != 0 );
+}
+
+//Zigzag encoding, small negative values also take a few bits.
+inline void BitWriter::writeSigned(const int &value, const int &bits)
+{
+	write((static_cast<unsigned int>(value) << 1) ^ static_cast<unsigned int>(value >> 31), bits);
+}
+
+inline unsigned int BitWriter::bytes(void) { return (bitPos + 7) >> 3; }
+
+inline bool BitWriter::ok(void) { return !overflow; }
+
+BitReader::BitReader(const unsigned char *const buf, const unsigned int &size) :	buf(buf),
+																					size(size),
+																					bitPos(0),
+																					overflow(0) {}
+
+unsigned int BitReader::read(const int &bits)
+{
+	unsigned int value = 0;
+	int done = 0;
+	while ( done < bits ) {
+		unsigned int byteIndex = bitPos >> 3;
+		unsigned int bitOffset = bitPos & 7;
+		if ( byteIndex >= size ) {
+			overflow = 1;
+			return 0;
+		}
+		int n = 8 - bitOffset;
+		if ( n > bits - done ) {
+			n = bits - done;
+		}
+		unsigned int mask = (1u << n) - 1;
+		value |= ((buf[byteIndex] >> bitOffset) & mask) << done;
+		done += n;
+		bitPos += n;
+	}
+	return value;
+}
+
+unsigned int BitReader::readVar(void)
+{
+	unsigned int value = 0;
+	for ( int shift = 0 ; shift < 35 ; shift += 7 ) {
+		unsigned int group = read(8);
+		value |= (group & 0x7f) << shift;
+		if ( (group & 0x80) == 0 ) {
+			return value;
+		}
+	}
+	overflow = 1; //Too long, data is corrupted.
+	return 0;
+}
+
+inline int BitReader::readSigned(const int &bits)
+{
+	unsigned int value = read(bits);
+	return static_cast<int>(value >> 1) ^ -static_cast<int>(value & 1);
+}
+
+inline bool BitReader::ok(void) { return !overflow; }
+
+
+//////////////////////////////////// Definitions of SnapshotCodec Class
+inline int SnapshotCodec::quantize(const float &value)
+{
+	return static_cast<int>(floor(value * SNAP_POS_SCALE + 0.5f));
+}
+
+//-> Layout of a player: moved bit (+ small delta or full position), state changed bit
+//   (+ state, s and oldDir), score changed bit (+ score). Without baseline every
+//   field is written.
+void SnapshotCodec::encodePlayers(BitWriter &w, const worldSnapshot &cur, const worldSnapshot *const base)
+{
+	for ( int i = 0 ; i < cur.np ; i++ ) {
+		const playerSnap &p = cur.players[i];
+		int qx = quantize(p.pos.x);
+		int qy = quantize(p.pos.y);
+		bool moved = 1, stateChanged = 1, scoreChanged = 1;
+		int dx = 0, dy = 0;
+		if ( base != NULL ) {
+			const playerSnap &b = base->players[i];
+			dx = qx - quantize(b.pos.x);
+			dy = qy - quantize(b.pos.y);
+			moved = (dx != 0 || dy != 0);
+			stateChanged = (p.state != b.state || p.s != b.s || p.oldDir != b.oldDir);
+			scoreChanged = (p.score != b.score || p.deaths != b.deaths); //Deaths are sent with the score.
+			w.write(moved, 1);
+			w.write(stateChanged, 1);
+			w.write(scoreChanged, 1);
+		}
+		if ( moved ) {
+			//-> Soldiers move a few pixels in a tick, so a delta fits into 8 bits
+			//   most of the time. Reborn moves the soldier far away, then full position is sent.
+			if ( base != NULL && dx > -128 && dx < 128 && dy > -128 && dy < 128 ) {
+				w.write(1, 1);
+				w.writeSigned(dx, 8);
+				w.writeSigned(dy, 8);
+			} else {
+				if ( base != NULL ) {
+					w.write(0, 1);
+				}
+				w.writeSigned(qx, SNAP_POS_BITS);
+				w.writeSigned(qy, SNAP_POS_BITS);
+			}
+			//---
+		}
+		if ( stateChanged ) {
+			w.write(p.state, 4);
+			w.write(p.s, 1);
+			w.write(p.oldDir + 1, 3); //oldDir is -1 at the beginning.
+		}
+		if ( scoreChanged ) {
+			w.writeVar(p.score);
+			w.writeVar(p.deaths);
+		}
+	}
+}
+
+//-> Without baseline all live bullets are written as spawn events. With baseline,
+//   indexes of the baseline bullets which are removed and the bullets fired after the
+//   baseline are written. Both lists are sorted by id, so a single merge pass finds them.
+void SnapshotCodec::encodeBullets(BitWriter &w, const worldSnapshot &cur, const worldSnapshot *const base)
+{
+	int firstNew = 0; //Index of the first bullet in cur which is not in the baseline.
+	unsigned int lastId = 0;
+	if ( base != NULL ) {
+		//-> Count the removed bullets first, count is written before the indexes.
+		int removed = 0;
+		int j = 0;
+		for ( int i = 0 ; i < base->nbul ; i++ ) {
+			while ( j < cur.nbul && cur.bullets[j].id < base->bullets[i].id ) {
+				j++;
+			}
+			if ( j >= cur.nbul || cur.bullets[j].id != base->bullets[i].id ) {
+				removed++;
+			}
+		}
+		w.writeVar(removed);
+		j = 0;
+		int lastIndex = 0;
+		for ( int i = 0 ; i < base->nbul ; i++ ) {
+			while ( j < cur.nbul && cur.bullets[j].id < base->bullets[i].id ) {
+				j++;
+			}
+			if ( j >= cur.nbul || cur.bullets[j].id != base->bullets[i].id ) {
+				w.writeVar(i - lastIndex);
+				lastIndex = i;
+			}
+		}
+		//---
+		//-> Bullets fired after the baseline have larger ids than every baseline bullet.
+		if ( base->nbul > 0 ) {
+			lastId = base->bullets[base->nbul - 1].id;
+			while ( firstNew < cur.nbul && cur.bullets[firstNew].id <= lastId ) {
+				firstNew++;
+			}
+		}
+		//---
+	}
+	w.writeVar(cur.nbul - firstNew);
+	for ( int i = firstNew ; i < cur.nbul ; i++ ) {
+		const bulletSnap &b = cur.bullets[i];
+		w.writeVar(b.id - lastId);
+		lastId = b.id;
+		w.write(b.owner, 4);
+		w.write(b.dir, 2);
+		w.writeVar(b.age);
+		w.writeVar(quantize(b.speed));
+		w.writeSigned(quantize(b.spawnPos.x), SNAP_POS_BITS);
+		w.writeSigned(quantize(b.spawnPos.y), SNAP_POS_BITS);
+	}
+}
+//---
+
+unsigned int SnapshotCodec::encode(	const worldSnapshot &cur,
+									const worldSnapshot *const base,
+									unsigned char *const out,
+									const unsigned int &capacity)
+{
+	//-> Baseline with different entity counts can not be used.
+	const worldSnapshot *baseline = base;
+	if ( baseline != NULL && (baseline->np != cur.np || baseline->nb != cur.nb || baseline->tick > cur.tick) ) {
+		baseline = NULL;
+	}
+	//---
+	BitWriter w(out, capacity);
+	//-> Header
+	w.write(cur.tick, 32);
+	w.write(baseline != NULL, 1);
+	if ( baseline != NULL ) {
+		w.writeVar(cur.tick - baseline->tick);
+	}
+	w.write(cur.np, 5);
+	w.write(cur.nb, 9);
+	//---
+	encodePlayers(w, cur, baseline);
+	//-> Barrels, visibility bits are written only if one of them is changed.
+	int nbytes = (cur.nb + 7) / 8;
+	bool barrelsChanged = (baseline == NULL || memcmp(cur.barrelVisible, baseline->barrelVisible, nbytes) != 0);
+	if ( baseline != NULL ) {
+		w.write(barrelsChanged, 1);
+	}
+	if ( barrelsChanged ) {
+		for ( int i = 0 ; i < nbytes ; i++ ) {
+			int bits = cur.nb - 8 * i;
+			w.write(cur.barrelVisible[i], bits < 8 ? bits : 8);
+		}
+	}
+	//---
+	encodeBullets(w, cur, baseline);
+	return w.ok() ? w.bytes() : 0;
+}
+
+bool SnapshotCodec::decode(	const unsigned char *const in,
+							const unsigned int &size,
+							const worldSnapshot *const base,
+							worldSnapshot &out)
+{
+	BitReader r(in, size);
+	//-> Header, baseline of the sender should be same with the given one.
+	out.tick = r.read(32);
+	bool hasBase = r.read(1);
+	const worldSnapshot *baseline = NULL;
+	if ( hasBase ) {
+		unsigned int baseTick = out.tick - r.readVar();
+		if ( base == NULL || base->tick != baseTick ) {
+			return 0;
+		}
+		baseline = base;
+	}
+	out.np = r.read(5);
+	out.nb = r.read(9);
+	if ( out.np > SNAP_MAX_PLAYERS || out.nb > SNAP_MAX_BARRELS ||
+		 (baseline != NULL && (baseline->np != out.np || baseline->nb != out.nb)) ) {
+		return 0;
+	}
+	//---
+	//-> Players, unchanged fields are copied from the baseline.
+	for ( int i = 0 ; i < out.np ; i++ ) {
+		playerSnap &p = out.players[i];
+		bool moved = 1, stateChanged = 1, scoreChanged = 1;
+		if ( baseline != NULL ) {
+			p = baseline->players[i];
+			moved = r.read(1);
+			stateChanged = r.read(1);
+			scoreChanged = r.read(1);
+		}
+		if ( moved ) {
+			if ( baseline != NULL && r.read(1) ) {
+				int qx = quantize(p.pos.x) + r.readSigned(8);
+				int qy = quantize(p.pos.y) + r.readSigned(8);
+				p.pos = sf::Vector2f(CAST_FLOAT(qx) / SNAP_POS_SCALE, CAST_FLOAT(qy) / SNAP_POS_SCALE);
+			} else {
+				int qx = r.readSigned(SNAP_POS_BITS);
+				int qy = r.readSigned(SNAP_POS_BITS);
+				p.pos = sf::Vector2f(CAST_FLOAT(qx) / SNAP_POS_SCALE, CAST_FLOAT(qy) / SNAP_POS_SCALE);
+			}
+		}
+		if ( stateChanged ) {
+			p.state = r.read(4);
+			p.s = r.read(1);
+			p.oldDir = static_cast<int>(r.read(3)) - 1;
+			//Frames and masks are indexed by the state.
+			if ( p.state >= SOLDIER_FRAMES || p.oldDir > RIGHT ) {
+				return 0;
+			}
+		}
+		if ( scoreChanged ) {
+			p.score = r.readVar();
+			p.deaths = r.readVar();
+		}
+	}
+	//---
+	//-> Barrels
+	int nbytes = (out.nb + 7) / 8;
+	memset(out.barrelVisible, 0, sizeof(out.barrelVisible));
+	if ( baseline == NULL || r.read(1) ) {
+		for ( int i = 0 ; i < nbytes ; i++ ) {
+			int bits = out.nb - 8 * i;
+			out.barrelVisible[i] = r.read(bits < 8 ? bits : 8);
+		}
+	} else {
+		memcpy(out.barrelVisible, baseline->barrelVisible, nbytes);
+	}
+	//---
+	//-> Bullets. Baseline bullets which are not removed are aged, then the new ones are appended.
+	out.nbul = 0;
+	unsigned int lastId = 0;
+	if ( baseline != NULL ) {
+		unsigned char removed[SNAP_MAX_BULLETS];
+		memset(removed, 0, baseline->nbul);
+		unsigned int numRemoved = r.readVar();
+		unsigned int index = 0;
+		for ( unsigned int i = 0 ; i < numRemoved ; i++ ) {
+			//Delta is checked before it is added, so a large one can not wrap the index.
+			unsigned int delta = r.readVar();
+			if ( !r.ok() || delta >= static_cast<unsigned int>(baseline->nbul) - index ) {
+				return 0;
+			}
+			index += delta;
+			removed[index] = 1;
+		}
+		unsigned int elapsed = out.tick - baseline->tick;
+		for ( int i = 0 ; i < baseline->nbul ; i++ ) {
+			if ( removed[i] == 0 ) {
+				out.bullets[out.nbul] = baseline->bullets[i];
+				out.bullets[out.nbul].age += elapsed;
+				out.nbul++;
+			}
+		}
+		if ( baseline->nbul > 0 ) {
+			lastId = baseline->bullets[baseline->nbul - 1].id;
+		}
+	}
+	unsigned int numNew = r.readVar();
+	if ( numNew > static_cast<unsigned int>(SNAP_MAX_BULLETS - out.nbul) ) {
+		return 0;
+	}
+	for ( unsigned int i = 0 ; i < numNew ; i++ ) {
+		bulletSnap &b = out.bullets[out.nbul++];
+		lastId += r.readVar();
+		b.id = lastId;
+		b.owner = r.read(4);
+		unsigned int dir = r.read(2);
+		if ( b.owner >= out.np || dir > RIGHT ) {
+			return 0;
+		}
+		b.dir = static_cast<Direction>(dir);
+		b.age = r.readVar();
+		b.speed = CAST_FLOAT(r.readVar()) / SNAP_POS_SCALE;
+		int qx = r.readSigned(SNAP_POS_BITS);
+		int qy = r.readSigned(SNAP_POS_BITS);
+		b.spawnPos = sf::Vector2f(CAST_FLOAT(qx) / SNAP_POS_SCALE, CAST_FLOAT(qy) / SNAP_POS_SCALE);
+	}
+	//---
+	return r.ok();
+}
+
+sf::Vector2f SnapshotCodec::bulletPosition(const bulletSnap &bullet)
+{
+	float distance = bullet.speed * bullet.age;
+	switch (bullet.dir) {
+		case UP:
+			return bullet.spawnPos + sf::Vector2f(0, -distance);
+		case DOWN:
+			return bullet.spawnPos + sf::Vector2f(0, distance);
+		case LEFT:
+			return bullet.spawnPos + sf::Vector2f(-distance, 0);
+		case RIGHT:
+			return bullet.spawnPos + sf::Vector2f(distance, 0);
+		default:
+			return bullet.spawnPos;
+	}
+}
+
+
+//////////////////////////////////// Definitions of InterestGrid Class
+InterestGrid::InterestGrid() : columns(0), rows(0) {}
+
+void InterestGrid::init(const sf::Vector2u &worldSize)
+{
+	this->worldSize = worldSize;
+	columns = (worldSize.x + INTEREST_CELL_SIZE - 1) / INTEREST_CELL_SIZE;
+	rows = (worldSize.y + INTEREST_CELL_SIZE - 1) / INTEREST_CELL_SIZE;
+	cellStart.assign(columns * rows + 1, 0);
+	cellItems.resize(SNAP_MAX_PLAYERS + SNAP_MAX_BULLETS);
+	positions.resize(SNAP_MAX_PLAYERS + SNAP_MAX_BULLETS);
+	itemCells.resize(SNAP_MAX_PLAYERS + SNAP_MAX_BULLETS);
+}
+
+inline int InterestGrid::cellOf(const sf::Vector2f &pos)
+{
+	int x = max(0, min(columns - 1, static_cast<int>(floor(pos.x / INTEREST_CELL_SIZE))));
+	int y = max(0, min(rows - 1, static_cast<int>(floor(pos.y / INTEREST_CELL_SIZE))));
+	return y * columns + x;
+}
+
+//-> Counting sort of the items by cell, so a cell is a range of items.
+void InterestGrid::build(const worldSnapshot &world)
+{
+	const int numItems = world.np + world.nbul;
+	for ( int i = 0 ; i < numItems ; i++ ) {
+		positions[i] = (i < world.np) ? world.players[i].pos : SnapshotCodec::bulletPosition(world.bullets[i - world.np]);
+		itemCells[i] = cellOf(positions[i]);
+	}
+	fill(cellStart.begin(), cellStart.end(), 0);
+	for ( int i = 0 ; i < numItems ; i++ ) {
+		cellStart[itemCells[i]]++;
+	}
+	for ( int c = 1 ; c <= columns * rows ; c++ ) {
+		cellStart[c] += cellStart[c - 1]; //End of the cell c for now.
+	}
+	for ( int i = numItems - 1 ; i >= 0 ; i-- ) {
+		cellItems[--cellStart[itemCells[i]]] = i;
+	}
+}
+//---
+
+void InterestGrid::query(const sf::Vector2f &center, const float &radius, vector<sf::Uint16> &found)
+{
+	found.clear();
+	const int first = cellOf(center - sf::Vector2f(radius, radius));
+	const int last = cellOf(center + sf::Vector2f(radius, radius));
+	const float radius2 = radius * radius;
+	for ( int y = first / columns ; y <= last / columns ; y++ ) {
+		for ( int c = y * columns + first % columns ; c <= y * columns + last % columns ; c++ ) {
+			for ( sf::Uint32 i = cellStart[c] ; i < cellStart[c + 1] ; i++ ) {
+				sf::Vector2f d = positions[cellItems[i]] - center;
+				if ( d.x * d.x + d.y * d.y <= radius2 ) {
+					found.push_back(cellItems[i]);
+				}
+			}
+		}
+	}
+	sort(found.begin(), found.end());
+}
+
+
+//////////////////////////////////// Definitions of InterestClient Class
+InterestClient::InterestClient() :	radius(0),
+									baseline(NULL),
+									hasBaseline(0),
+									playerMask(0),
+									nextClientId(0) {}
+
+InterestClient::~InterestClient() { delete baseline; }
+
+void InterestClient::init(const float &radius)
+{
+	this->radius = radius + INTEREST_MARGIN;
+	if ( baseline == NULL ) {
+		baseline = new worldSnapshot;
+	}
+	hasBaseline = 0;
+	playerMask = 0;
+	nextClientId = 0;
+	bullets.clear();
+	bullets.reserve(SNAP_MAX_BULLETS);
+	nextBullets.reserve(SNAP_MAX_BULLETS);
+	found.reserve(SNAP_MAX_PLAYERS + SNAP_MAX_BULLETS);
+	events.reserve(2 * (SNAP_MAX_PLAYERS + SNAP_MAX_BULLETS));
+}
+
+inline void InterestClient::setCenter(const sf::Vector2f &center) { this->center = center; }
+
+//-> Found bullets and the bullets of the last update are both in world id order,
+//   so a merge finds the ones which are kept, entered and left.
+void InterestClient::update(const worldSnapshot &world, InterestGrid &grid, worldSnapshot &out)
+{
+	grid.query(center, radius, found);
+	events.clear();
+	out.tick = world.tick;
+	out.rngState = 0;
+	out.nextBulletId = 0;
+	out.np = world.np;
+	out.nb = world.nb;
+	memcpy(out.barrelVisible, world.barrelVisible, sizeof(out.barrelVisible));
+	//-> Soldiers
+	size_t f = 0;
+	unsigned int mask = 0;
+	for ( ; f < found.size() && found[f] < world.np ; f++ ) {
+		mask |= 1u << found[f];
+	}
+	for ( int i = 0 ; i < world.np ; i++ ) {
+		if ( mask & (1u << i) ) {
+			out.players[i] = world.players[i];
+		} else if ( hasBaseline ) {
+			out.players[i] = baseline->players[i];
+		} else {
+			out.players[i] = playerSnap();
+			out.players[i].oldDir = -1;
+		}
+		if ( ((mask ^ playerMask) >> i) & 1 ) {
+			interestEvent event = {0, static_cast<bool>((mask >> i) & 1), static_cast<unsigned int>(i)};
+			events.push_back(event);
+		}
+	}
+	playerMask = mask;
+	//---
+	//-> Bullets
+	nextBullets.clear();
+	out.nbul = 0;
+	size_t old = 0;
+	for ( ; f < found.size() ; f++ ) {
+		const bulletSnap &bullet = world.bullets[found[f] - world.np];
+		while ( old < bullets.size() && bullets[old].worldId < bullet.id ) {
+			interestEvent event = {1, 0, bullets[old++].clientId};
+			events.push_back(event);
+		}
+		interestBullet entry = {bullet.id, 0};
+		if ( old < bullets.size() && bullets[old].worldId == bullet.id ) {
+			entry.clientId = bullets[old++].clientId;
+		} else {
+			entry.clientId = nextClientId++;
+			interestEvent event = {1, 1, entry.clientId};
+			events.push_back(event);
+		}
+		nextBullets.push_back(entry);
+		out.bullets[out.nbul] = bullet;
+		out.bullets[out.nbul].id = entry.clientId;
+		out.nbul++;
+	}
+	for ( ; old < bullets.size() ; old++ ) {
+		interestEvent event = {1, 0, bullets[old].clientId};
+		events.push_back(event);
+	}
+	bullets.swap(nextBullets);
+	sort(out.bullets, out.bullets + out.nbul, [](const bulletSnap &a, const bulletSnap &b) { return a.id < b.id; });
+	//---
+}
+//---
+
+inline void InterestClient::acknowledge(const worldSnapshot &sent)
+{
+	*baseline = sent;
+	hasBaseline = 1;
+}
+
+inline const worldSnapshot *InterestClient::getBaseline(void) { return hasBaseline ? baseline : NULL; }
+
+inline const vector<interestEvent> &InterestClient::getEvents(void) { return events; }
+
+inline unsigned int InterestClient::getPlayerMask(void) { return playerMask; }
+
+
+//////////////////////////////////// Definitions of StateHash Class
+//Finalizer of splitmix64, a changed input bit changes about half of the output bits.
+inline sf::Uint64 StateHash::mix(sf::Uint64 value)
+{
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+	return value ^ (value >> 31);
+}
+
+inline sf::Uint64 StateHash::pair(const float &a, const float &b)
+{
+	sf::Uint32 x, y;
+	memcpy(&x, &a, sizeof(x));
+	memcpy(&y, &b, sizeof(y));
+	return (static_cast<sf::Uint64>(x) << 32) | y;
+}
+
+inline sf::Uint64 StateHash::pair(const unsigned int &a, const unsigned int &b)
+{
+	return (static_cast<sf::Uint64>(a) << 32) | b;
+}
+
+inline sf::Uint64 StateHash::start(const unsigned int &tick, const unsigned int &rngState, const unsigned int &nextBulletId)
+{
+	return mix(mix(pair(tick, rngState)) ^ nextBulletId);
+}
+
+inline sf::Uint64 StateHash::add(const sf::Uint64 &hash, const sf::Uint64 &term) { return mix(hash ^ term); }
+
+sf::Uint64 StateHash::player(const playerSnap &snap)
+{
+	sf::Uint64 hash = mix(pair(snap.pos.x, snap.pos.y));
+	hash = mix(hash ^ pair(static_cast<unsigned int>(snap.state), static_cast<unsigned int>(snap.s)));
+	hash = mix(hash ^ pair(static_cast<unsigned int>(snap.oldDir), static_cast<unsigned int>(snap.score)));
+	return mix(hash ^ static_cast<unsigned int>(snap.deaths));
+}
+
+//-> Step is odd, so every age of the bullet gives another term.
+void StateHash::bullet(	const unsigned int &id,
+						const Direction &dir,
+						const float &speed,
+						const sf::Vector2f &spawnPos,
+						sf::Uint64 &key,
+						sf::Uint64 &step)
+{
+	key = mix(mix(pair(spawnPos.x, spawnPos.y)) ^ pair(id, static_cast<unsigned int>(dir)) ^ pair(speed, 0.0f));
+	step = mix(key) | 1;
+}
+//---
+
+inline sf::Uint64 StateHash::barrel(const int &index) { return mix(0x9E3779B97F4A7C15ULL * (index + 1)); }
+
+//-> Whole snapshot is hashed, it checks the incremental hash of the game.
+sf::Uint64 StateHash::world(const worldSnapshot &snap)
+{
+	sf::Uint64 lists[SNAP_MAX_PLAYERS] = {0};
+	for ( int i = 0 ; i < snap.nbul ; i++ ) {
+		const bulletSnap &bullet = snap.bullets[i];
+		sf::Uint64 key, step;
+		StateHash::bullet(bullet.id, bullet.dir, bullet.speed, bullet.spawnPos, key, step);
+		lists[bullet.owner] += key + bullet.age * step;
+	}
+	sf::Uint64 hidden = 0;
+	for ( int i = 0 ; i < snap.nb ; i++ ) {
+		if ( !((snap.barrelVisible[i >> 3] >> (i & 7)) & 1) ) {
+			hidden ^= barrel(i);
+		}
+	}
+	sf::Uint64 hash = start(snap.tick, snap.rngState, snap.nextBulletId);
+	for ( int i = 0 ; i < snap.np ; i++ ) {
+		hash = add(add(hash, player(snap.players[i])), lists[i]);
+	}
+	return add(hash, hidden);
+}
+//---
+
+
+//////////////////////////////////// Definitions of ParticleSystem Class
+ParticleSystem::ParticleSystem() :	posX(NULL),
+									posY(NULL),
+									velX(NULL),
+									velY(NULL),
+									life(NULL),
+									colors(NULL),
+									vertices(NULL),
+									capacity(0),
+									count(0),
+									updateTime(0),
+									drawTime(0)
+{
+	rng.seed(1);
+}
+
+ParticleSystem::~ParticleSystem()
+{
+	delete [] posX;
+	delete [] posY;
+	delete [] velX;
+	delete [] velY;
+	delete [] life;
+	delete [] colors;
+	delete [] vertices;
+}
+
+void ParticleSystem::init(const size_t &capacity)
+{
+	this->capacity = capacity;
+	posX = new float[capacity];
+	posY = new float[capacity];
+	velX = new float[capacity];
+	velY = new float[capacity];
+	life = new float[capacity];
+	colors = new sf::Color[capacity];
+	vertices = new sf::Vertex[4 * capacity];
+	count = 0;
+}
+
+inline void ParticleSystem::clear(void)
+{
+	count = 0;
+	bounds = sf::FloatRect();
+}
+
+inline size_t ParticleSystem::size(void) { return count; }
+
+inline sf::FloatRect ParticleSystem::getBounds(void) { return bounds; }
+
+inline sf::Int64 ParticleSystem::getUpdateTime(void) { return updateTime; }
+
+inline sf::Int64 ParticleSystem::getDrawTime(void) { return drawTime; }
+
+//-> If the pool is full, then the new particles are dropped.
+void ParticleSystem::spawn(const sf::Vector2f &center, const int &amount, const sf::Color &color, const float &maxSpeed)
+{
+	for ( int i = 0 ; i < amount && count < capacity ; i++, count++ ) {
+		float angle = (rng.next() % 3600) * 3.14159265f / 1800;
+		float speed = maxSpeed * (rng.next() % 1000) / 1000;
+		posX[count] = center.x;
+		posY[count] = center.y;
+		velX[count] = cos(angle) * speed;
+		velY[count] = sin(angle) * speed;
+		life[count] = 0.6f + (rng.next() % 1000) / 1000.0f;
+		colors[count] = color;
+	}
+}
+//---
+
+//-> No branches and no calls, only independent operations on the arrays.
+void ParticleSystem::integrate(const size_t &begin, const size_t &end, const float &dt)
+{
+	const float drag = pow(PARTICLE_DRAG, dt);
+	const float fall = PARTICLE_GRAVITY * dt;
+	float *__restrict x = posX;
+	float *__restrict y = posY;
+	float *__restrict vx = velX;
+	float *__restrict vy = velY;
+	float *__restrict left = life;
+	for ( size_t i = begin ; i < end ; i++ ) {
+		vx[i] *= drag;
+		vy[i] = vy[i] * drag + fall;
+		x[i] += vx[i] * dt;
+		y[i] += vy[i] * dt;
+		left[i] -= dt;
+	}
+}
+//---
+
+//-> Large systems are split into a range per worker, the calling thread takes
+//   the first range. Vertices are built after the dead particles are removed.
+void ParticleSystem::update(const float &dt, WorkerPool *const pool)
+{
+	sf::Clock clock;
+	if ( pool != NULL && pool->size() > 1 && count >= PARTICLE_PARALLEL_MIN ) {
+		auto body = [this, dt](const size_t &begin, const size_t &end) { integrate(begin, end, dt); };
+		pool->forChunks(count, (count + pool->size() - 1) / pool->size(), body);
+	} else {
+		integrate(0, count, dt);
+	}
+	for ( size_t i = 0 ; i < count ; ) {
+		if ( life[i] > 0 ) {
+			i++;
+			continue;
+		}
+		count--;
+		posX[i] = posX[count];
+		posY[i] = posY[count];
+		velX[i] = velX[count];
+		velY[i] = velY[count];
+		life[i] = life[count];
+		colors[i] = colors[count];
+	}
+	updateTime = clock.getElapsedTime().asMicroseconds();
+
+	clock.restart();
+	float minX = 0, minY = 0, maxX = 0, maxY = 0;
+	if ( count > 0 ) {
+		minX = maxX = posX[0];
+		minY = maxY = posY[0];
+	}
+	for ( size_t i = 0 ; i < count ; i++ ) {
+		minX = min(minX, posX[i]);
+		maxX = max(maxX, posX[i]);
+		minY = min(minY, posY[i]);
+		maxY = max(maxY, posY[i]);
+		sf::Color color = colors[i];
+		color.a = (life[i] < PARTICLE_FADE) ? static_cast<sf::Uint8>(255 * life[i] / PARTICLE_FADE) : 255;
+		sf::Vertex *quad = vertices + 4 * i;
+		quad[0] = sf::Vertex(sf::Vector2f(posX[i], posY[i]), color);
+		quad[1] = sf::Vertex(sf::Vector2f(posX[i] + PARTICLE_SIZE, posY[i]), color);
+		quad[2] = sf::Vertex(sf::Vector2f(posX[i] + PARTICLE_SIZE, posY[i] + PARTICLE_SIZE), color);
+		quad[3] = sf::Vertex(sf::Vector2f(posX[i], posY[i] + PARTICLE_SIZE), color);
+	}
+	bounds = (count > 0) ? sf::FloatRect(minX, minY, maxX - minX + PARTICLE_SIZE, maxY - minY + PARTICLE_SIZE) : sf::FloatRect();
+	drawTime = clock.getElapsedTime().asMicroseconds();
+}
+//---
+
+inline void ParticleSystem::paint(sf::RenderTarget &target)
+{
+	if ( count > 0 ) {
+		sf::Clock clock;
+		target.draw(vertices, 4 * count, sf::Quads);
+		drawTime += clock.getElapsedTime().asMicroseconds();
+	}
+}
+
+
+//////////////////////////////////// Definitions of RaycastGrid Class
+RaycastGrid::RaycastGrid() :	boxes(NULL),
+								opaque(NULL),
+								cellStart(NULL),
+								cellItems(NULL),
+								blockers(NULL),
+								cellFill(NULL),
+								itemCapacity(0),
+								columns(0),
+								rows(0),
+								numSandbags(0),
+								numBarrels(0),
+								updatedCells(0) {}
+
+RaycastGrid::~RaycastGrid()
+{
+	delete [] boxes;
+	delete [] opaque;
+	delete [] cellStart;
+	delete [] cellItems;
+	delete [] blockers;
+	delete [] cellFill;
+}
+
+inline void RaycastGrid::cellRange(const sf::FloatRect &box, int *const range) const
+{
+	range[0] = max(0, static_cast<int>(floor(box.left / RAYCAST_CELL_SIZE)));
+	range[1] = max(0, static_cast<int>(floor(box.top / RAYCAST_CELL_SIZE)));
+	range[2] = min(columns - 1, static_cast<int>(floor((box.left + box.width) / RAYCAST_CELL_SIZE)));
+	range[3] = min(rows - 1, static_cast<int>(floor((box.top + box.height) / RAYCAST_CELL_SIZE)));
+}
+
+//-> A box of width w touches at most w / RAYCAST_CELL_SIZE + 2 columns wherever
+//   it is, so the items of the boxes fit after they are moved.
+void RaycastGrid::init(const sf::Vector2u &worldSize, Sandbag *const sandbags, const int &ns, Barrel *const barrels, const int &nb)
+{
+	delete [] boxes;
+	delete [] opaque;
+	delete [] cellStart;
+	delete [] cellItems;
+	delete [] blockers;
+	delete [] cellFill;
+	numSandbags = ns;
+	numBarrels = nb;
+	columns = (worldSize.x + RAYCAST_CELL_SIZE - 1) / RAYCAST_CELL_SIZE + 1;
+	rows = (worldSize.y + RAYCAST_CELL_SIZE - 1) / RAYCAST_CELL_SIZE + 1;
+	const int numCells = columns * rows;
+	boxes = new sf::FloatRect[ns + nb];
+	opaque = new bool[ns + nb];
+	cellStart = new sf::Uint32[numCells + 1];
+	blockers = new sf::Uint16[numCells];
+	cellFill = new sf::Uint32[numCells];
+	itemCapacity = 0;
+	for ( int slot = 0 ; slot < ns + nb ; slot++ ) {
+		sf::FloatRect box = (slot < ns) ? sandbags[slot].getOpaqueBox() : barrels[slot - ns].getOpaqueBox();
+		itemCapacity += (static_cast<size_t>(box.width / RAYCAST_CELL_SIZE) + 2) * (static_cast<size_t>(box.height / RAYCAST_CELL_SIZE) + 2);
+	}
+	cellItems = new sf::Uint32[itemCapacity];
+	build(sandbags, barrels);
+}
+//---
+
+//-> Slots are put into the cells with a counting sort, so the slots of a cell
+//   are in ascending order.
+void RaycastGrid::build(Sandbag *const sandbags, Barrel *const barrels)
+{
+	const int ns = numSandbags;
+	const int nb = numBarrels;
+	const int numCells = columns * rows;
+	for ( int i = 0 ; i < ns ; i++ ) {
+		boxes[i] = sandbags[i].getOpaqueBox();
+		opaque[i] = 1;
+	}
+	for ( int i = 0 ; i < nb ; i++ ) {
+		boxes[ns + i] = barrels[i].getOpaqueBox();
+		opaque[ns + i] = barrels[i].getVisible();
+	}
+	for ( int c = 0 ; c <= numCells ; c++ ) {
+		cellStart[c] = 0;
+	}
+	for ( int c = 0 ; c < numCells ; c++ ) {
+		blockers[c] = 0;
+	}
+	int range[4];
+	for ( int slot = 0 ; slot < ns + nb ; slot++ ) {
+		cellRange(boxes[slot], range);
+		for ( int y = range[1] ; y <= range[3] ; y++ ) {
+			for ( int x = range[0] ; x <= range[2] ; x++ ) {
+				cellStart[y * columns + x + 1]++;
+				blockers[y * columns + x] += opaque[slot];
+			}
+		}
+	}
+	for ( int c = 0 ; c < numCells ; c++ ) {
+		cellStart[c + 1] += cellStart[c];
+	}
+	memcpy(cellFill, cellStart, numCells * sizeof(sf::Uint32));
+	for ( int slot = 0 ; slot < ns + nb ; slot++ ) {
+		cellRange(boxes[slot], range);
+		for ( int y = range[1] ; y <= range[3] ; y++ ) {
+			for ( int x = range[0] ; x <= range[2] ; x++ ) {
+				cellItems[cellFill[y * columns + x]++] = slot;
+			}
+		}
+	}
+	updatedCells = 0;
+}
+//---
+
+void RaycastGrid::sync(Barrel *const barrels)
+{
+	int range[4];
+	for ( int i = 0 ; i < numBarrels ; i++ ) {
+		const int slot = numSandbags + i;
+		const bool visible = barrels[i].getVisible();
+		if ( visible == opaque[slot] ) {
+			continue;
+		}
+		opaque[slot] = visible;
+		cellRange(boxes[slot], range);
+		for ( int y = range[1] ; y <= range[3] ; y++ ) {
+			for ( int x = range[0] ; x <= range[2] ; x++ ) {
+				blockers[y * columns + x] += visible ? 1 : -1;
+				updatedCells++;
+			}
+		}
+	}
+}
+
+//-> Slab test, the segment is clipped by the x and the y range of the box.
+bool RaycastGrid::intersect(const sf::FloatRect &box, const sf::Vector2f &from, const sf::Vector2f &dir, float &t)
+{
+	const float origin[2] = {from.x, from.y};
+	const float delta[2] = {dir.x, dir.y};
+	const float low[2] = {box.left, box.top};
+	const float high[2] = {box.left + box.width, box.top + box.height};
+	float tNear = 0, tFar = 1;
+	for ( int a = 0 ; a < 2 ; a++ ) {
+		if ( delta[a] == 0 ) {
+			if ( origin[a] < low[a] || origin[a] > high[a] ) {
+				return 0;
+			}
+			continue;
+		}
+		float t1 = (low[a] - origin[a]) / delta[a];
+		float t2 = (high[a] - origin[a]) / delta[a];
+		if ( t1 > t2 ) {
+			swap(t1, t2);
+		}
+		tNear = max(tNear, t1);
+		tFar = min(tFar, t2);
+		if ( tNear > tFar ) {
+			return 0;
+		}
+	}
+	t = tNear;
+	return 1;
+}
+//---
+
+//-> Amanatides-Woo traversal. tMax is the t at which the ray leaves the cell in
+//   an axis, tDelta is the t of a cell width. A box which is hit before the ray
+//   leaves a cell covers that cell, so the walk stops at the first cell whose
+//   exit is after the nearest hit. At a tie the walk goes on, a box
+//   which starts at the border is only in the next cell. Cells out of the grid have no obstacles.
+rayHit RaycastGrid::cast(const sf::Vector2f &from, const sf::Vector2f &to) const
+{
+	rayHit hit = {-1, 1};
+	const sf::Vector2f dir = to - from;
+	int cellX = static_cast<int>(floor(from.x / RAYCAST_CELL_SIZE));
+	int cellY = static_cast<int>(floor(from.y / RAYCAST_CELL_SIZE));
+	const int stepX = (dir.x > 0) - (dir.x < 0);
+	const int stepY = (dir.y > 0) - (dir.y < 0);
+	const float tDeltaX = (stepX != 0) ? RAYCAST_CELL_SIZE / fabs(dir.x) : INFINITY;
+	const float tDeltaY = (stepY != 0) ? RAYCAST_CELL_SIZE / fabs(dir.y) : INFINITY;
+	float tMaxX = (stepX != 0) ? ((cellX + (stepX > 0)) * CAST_FLOAT(RAYCAST_CELL_SIZE) - from.x) / dir.x : INFINITY;
+	float tMaxY = (stepY != 0) ? ((cellY + (stepY > 0)) * CAST_FLOAT(RAYCAST_CELL_SIZE) - from.y) / dir.y : INFINITY;
+	while ( 1 ) {
+		const float tExit = min(min(tMaxX, tMaxY), 1.0f);
+		if ( cellX >= 0 && cellX < columns && cellY >= 0 && cellY < rows && blockers[cellY * columns + cellX] > 0 ) {
+			const int cell = cellY * columns + cellX;
+			for ( sf::Uint32 p = cellStart[cell] ; p < cellStart[cell + 1] ; p++ ) {
+				const int slot = cellItems[p];
+				float t;
+				if ( opaque[slot] && intersect(boxes[slot], from, dir, t) && (hit.slot < 0 || t < hit.t || (t == hit.t && slot < hit.slot)) ) {
+					hit.slot = slot;
+					hit.t = t;
+				}
+			}
+		}
+		if ( (hit.slot >= 0 && hit.t < tExit) || tExit >= 1 ) {
+			break;
+		}
+		if ( tMaxX < tMaxY ) {
+			cellX += stepX;
+			tMaxX += tDeltaX;
+		} else {
+			cellY += stepY;
+			tMaxY += tDeltaY;
+		}
+	}
+	return hit;
+}
+//---
+
+inline bool RaycastGrid::canSee(const sf::Vector2f &from, const sf::Vector2f &to) const
+{
+	return cast(from, to).slot < 0;
+}
+
+void RaycastGrid::castRange(const rayQuery *const queries, rayHit *const hits, const size_t &begin, const size_t &end) const
+{
+	for ( size_t i = begin ; i < end ; i++ ) {
+		hits[i] = cast(queries[i].from, queries[i].to);
+	}
+}
+
+void RaycastGrid::castBatch(	const rayQuery *const queries,
+								rayHit *const hits,
+								const size_t &n,
+								WorkerPool *const pool,
+								const size_t &minParallel) const
+{
+	if ( pool != NULL && pool->size() > 1 && n >= minParallel ) {
+		auto body = [this, queries, hits](const size_t &begin, const size_t &end) { castRange(queries, hits, begin, end); };
+		pool->forChunks(n, (n + pool->size() - 1) / pool->size(), body);
+	} else {
+		castRange(queries, hits, 0, n);
+	}
+}
+
+inline unsigned long long RaycastGrid::getUpdatedCells(void) const { return updatedCells; }
+
+//////////////////////////////////// Definitions of ScoreBoard Class
+ScoreBoard::ScoreBoard() : window(NULL), font(NULL), textSize(0), numScores(0), numVertices(0) {}
+
+void ScoreBoard::init(	sf::RenderWindow *const window,
+						const sf::Font &font,
+						const unsigned int &textSize,
+						const int &numPlayers)
+{
+	const char glyphChars[SCOREBOARD_GLYPHS + 1] = "0123456789 -";
+	this->window = window;
+	this->font = &font;
+	this->textSize = textSize;
+	for ( int i = 0 ; i < SCOREBOARD_GLYPHS ; i++ ) {
+		glyphs[i] = font.getGlyph(glyphChars[i], textSize, false);
+	}
+	numScores = numPlayers < SNAP_MAX_PLAYERS ? numPlayers : SNAP_MAX_PLAYERS;
+	for ( int i = 0 ; i < numScores ; i++ ) {
+		scores[i] = 0;
+	}
+	layout();
+}
+
+//-> Writes the quad of the glyph and returns the x of the next glyph.
+inline float ScoreBoard::appendGlyph(const int &glyph, const float &x, const float &baseline)
+{
+	const sf::Glyph &g = glyphs[glyph];
+	float left = x + g.bounds.left, top = baseline + g.bounds.top;
+	float right = left + g.bounds.width, bottom = top + g.bounds.height;
+	float u = g.textureRect.left, v = g.textureRect.top;
+	float uw = u + g.textureRect.width, vh = v + g.textureRect.height;
+	sf::Vertex *quad = vertices + numVertices;
+	quad[0] = sf::Vertex(sf::Vector2f(left, top), sf::Vector2f(u, v));
+	quad[1] = sf::Vertex(sf::Vector2f(right, top), sf::Vector2f(uw, v));
+	quad[2] = sf::Vertex(sf::Vector2f(right, bottom), sf::Vector2f(uw, vh));
+	quad[3] = sf::Vertex(sf::Vector2f(left, bottom), sf::Vector2f(u, vh));
+	numVertices += 4;
+	return x + g.advance;
+}
+//---
+
+//-> Glyphs are placed from x = 0 and then moved to the bottom center of the window.
+void ScoreBoard::layout(void)
+{
+	const float baseline = window->getSize().y - textSize;
+	float x = 0;
+	numVertices = 0;
+	for ( int i = numScores - 1 ; i >= 0 ; i-- ) {
+		char digits[12];
+		int numDigits = 0;
+		unsigned int score = (scores[i] > 0) ? scores[i] : 0;
+		do {
+			digits[numDigits++] = score % 10;
+			score /= 10;
+		} while ( score > 0 );
+		while ( numDigits > 0 ) {
+			x = appendGlyph(digits[--numDigits], x, baseline);
+		}
+		if ( i > 0 ) {
+			x = appendGlyph(SCOREBOARD_SPACE, x, baseline);
+			x = appendGlyph(SCOREBOARD_DASH, x, baseline);
+			x = appendGlyph(SCOREBOARD_SPACE, x, baseline);
+		}
+	}
+	float shift = (window->getSize().x - x) / 2;
+	float top = baseline, bottom = baseline;
+	for ( int i = 0 ; i < numVertices ; i++ ) {
+		vertices[i].position.x += shift;
+		top = (vertices[i].position.y < top) ? vertices[i].position.y : top;
+		bottom = (vertices[i].position.y > bottom) ? vertices[i].position.y : bottom;
+	}
+	bounds = sf::FloatRect(shift, top, x, bottom - top);
+}
+//---
+
+bool ScoreBoard::update(Player *const players)
+{
+	bool changed = 0;
+	for ( int i = 0 ; i < numScores ; i++ ) {
+		if ( scores[i] != players[i].getScore() ) {
+			scores[i] = players[i].getScore();
+			changed = 1;
+		}
+	}
+	if ( changed ) {
+		layout();
+	}
+	return changed;
+}
+
+inline sf::FloatRect ScoreBoard::getBounds(void) { return bounds; }
+
+inline void ScoreBoard::paint(sf::RenderTarget &target)
+{
+	target.draw(vertices, numVertices, sf::Quads, sf::RenderStates(&font->getTexture(textSize)));
+}
+
+
+//////////////////////////////////// Definitions of ScenarioLoader Class
+void ScenarioLoader::setDefaults(scenario &config)
+{
+	config.width = 1024;
+	config.height = 746;
+	config.numBarrels = 5;
+	config.numSandbags = 5;
+	config.numHumans = 2;
+	config.numBots = 0;
+	config.tickRate = TICK_RATE;
+	config.bulletSpeed = BULLET_SPEED;
+	config.seed = 0;
+	config.headless = 0;
+	config.duration = 0;
+	config.collisionMode = COLLIDE_BRUTE;
+	config.bulletCollisions = 0;
+	config.numTeams = 0;
+	config.textureDir = "textures/";
+	config.fontPath = "./font.ttf";
+	config.archivePath = ASSET_ARCHIVE_PATH;
+	config.mapPath = "";
+	config.exportPath = "";
+	config.telemetryPath = "";
+	config.recordPath = "";
+	config.replayPath = "";
+	config.botScript = SCRIPT_NONE;
+	config.checkParallel = 0;
+}
+
+//Whole value should be a number in [min, max].
+bool ScenarioLoader::parseInt(const string &value, const long &min, const long &max, long &out)
+{
+	char *end;
+	errno = 0;
+	out = strtol(value.c_str(), &end, 10);
+	return !value.empty() && *end == '\0' && errno == 0 && out >= min && out <= max;
+}
+
+bool ScenarioLoader::setOption(scenario &config, const string &key, const string &value)
+{
+	long number = 0;
+	bool valid = 1;
+	if ( key == "width" ) {
+		valid = parseInt(value, SCENARIO_MIN_SIZE, SCENARIO_MAX_SIZE, number);
+		config.width = number;
+	} else if ( key == "height" ) {
+		valid = parseInt(value, SCENARIO_MIN_SIZE, SCENARIO_MAX_SIZE, number);
+		config.height = number;
+	} else if ( key == "barrels" ) {
+		valid = parseInt(value, 0, SNAP_MAX_BARRELS, number);
+		config.numBarrels = number;
+	} else if ( key == "sandbags" ) {
+		valid = parseInt(value, 0, SCENARIO_MAX_SANDBAGS, number);
+		config.numSandbags = number;
+	} else if ( key == "players" ) {
+		valid = parseInt(value, 0, 2, number);
+		config.numHumans = number;
+	} else if ( key == "bots" ) {
+		valid = parseInt(value, 0, SNAP_MAX_PLAYERS, number);
+		config.numBots = number;
+	} else if ( key == "tick-rate" ) {
+		valid = parseInt(value, 1, SCENARIO_MAX_TICK_RATE, number);
+		config.tickRate = number;
+	} else if ( key == "bullet-speed" ) {
+		valid = parseInt(value, 1, SCENARIO_MAX_BULLET_SPEED, number);
+		config.bulletSpeed = number;
+	} else if ( key == "seed" ) {
+		valid = parseInt(value, 0, 0xFFFFFFFFL, number);
+		config.seed = number;
+	} else if ( key == "headless" ) {
+		valid = parseInt(value, 0, 1, number);
+		config.headless = number;
+	} else if ( key == "duration" ) {
+		valid = parseInt(value, 0, 0xFFFFFFFFL, number);
+		config.duration = number;
+	} else if ( key == "bullet-collisions" ) {
+		valid = parseInt(value, 0, 1, number);
+		config.bulletCollisions = number;
+	} else if ( key == "teams" ) {
+		valid = parseInt(value, 0, SNAP_MAX_PLAYERS, number) && number != 1;
+		config.numTeams = number;
+	} else if ( key == "broadphase" ) {
+		valid = (value == "brute" || value == "sweep");
+		config.collisionMode = (value == "sweep") ? COLLIDE_SWEEP : COLLIDE_BRUTE;
+	} else if ( key == "textures" ) {
+		config.textureDir = value;
+	} else if ( key == "font" ) {
+		config.fontPath = value;
+	} else if ( key == "assets" ) {
+		config.archivePath = value;
+	} else if ( key == "map" ) {
+		config.mapPath = value;
+	} else if ( key == "export-map" ) {
+		config.exportPath = value;
+	} else if ( key == "telemetry" ) {
+		config.telemetryPath = value;
+	} else if ( key == "record" ) {
+		config.recordPath = value;
+	} else if ( key == "replay" ) {
+		config.replayPath = value;
+	} else if ( key == "script" ) {
+		valid = (value == "none" || value == "patrol");
+		config.botScript = (value == "patrol") ? SCRIPT_PATROL : SCRIPT_NONE;
+	} else if ( key == "check-parallel" ) {
+		valid = parseInt(value, 0, 1, number);
+		config.checkParallel = number;
+	} else {
+		cout << "[ERROR] Unknown scenario option: " << key << endl;
+		return 0;
+	}
+	if ( !valid ) {
+		cout << "[ERROR] Invalid value for " << key << ": " << value << endl;
+	}
+	return valid;
+}
+
+bool ScenarioLoader::loadFile(scenario &config, const string &path)
+{
+	ifstream file(path);
+	if ( !file ) {
+		cout << "[ERROR] Scenario file can not be opened: " << path << endl;
+		return 0;
+	}
+	const char *const blanks = " \t\r";
+	string line;
+	for ( int lineNumber = 1 ; getline(file, line) ; lineNumber++ ) {
+		line = line.substr(0, line.find('#'));
+		size_t first = line.find_first_not_of(blanks);
+		if ( first == string::npos ) {
+			continue;
+		}
+		size_t equal = line.find('=');
+		if ( equal == string::npos ) {
+			cout << "[ERROR] " << path << ":" << lineNumber << ": \"key = value\" is expected." << endl;
+			return 0;
+		}
+		string key = line.substr(first, equal - first);
+		string value = line.substr(equal + 1);
+		key.erase(key.find_last_not_of(blanks) + 1);
+		value.erase(0, value.find_first_not_of(blanks));
+		value.erase(value.find_last_not_of(blanks) + 1);
+		if ( !setOption(config, key, value) ) {
+			cout << "[ERROR] " << path << ":" << lineNumber << ": Scenario file is not loaded." << endl;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+bool ScenarioLoader::loadArgs(scenario &config, int argc, char **argv)
+{
+	for ( int i = 1 ; i < argc ; i++ ) {
+		string arg = argv[i];
+		if ( arg.compare(0, 2, "--") != 0 ) {
+			cout << "[ERROR] Unexpected argument: " << arg << endl;
+			return 0;
+		}
+		string key = arg.substr(2), value;
+		size_t equal = key.find('=');
+		if ( equal != string::npos ) {
+			value = key.substr(equal + 1);
+			key.erase(equal);
+		} else if ( key == "headless" || key == "check-parallel" ) {
+			value = "1";
+		} else if ( i + 1 < argc ) {
+			value = argv[++i];
+		} else {
+			cout << "[ERROR] Missing value for " << arg << endl;
+			return 0;
+		}
+		if ( key == "config" ) { //File is loaded before the other options.
+			continue;
+		}
+		if ( !setOption(config, key, value) ) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+//-> Bullets of SNAP_MAX_PLAYERS full pools fit in a snapshot and in a keyframe,
+//   so the bullet capacity is checked by the player count.
+bool ScenarioLoader::validate(const scenario &config)
+{
+	if ( config.numHumans > 2 ) {
+		cout << "[ERROR] A game has 0 to 2 keyboard players." << endl;
+		return 0;
+	}
+	if ( config.numHumans + config.numBots < 1 || config.numHumans + config.numBots > SNAP_MAX_PLAYERS ) {
+		cout << "[ERROR] A game has 1 to " << SNAP_MAX_PLAYERS << " players and bots." << endl;
+		return 0;
+	}
+	if ( config.numTeams > config.numHumans + config.numBots ) {
+		cout << "[ERROR] There are more teams than players." << endl;
+		return 0;
+	}
+	if ( config.headless && config.numHumans != 0 ) {
+		cout << "[ERROR] Keyboard players need a window, use \"--players 0\" in headless games." << endl;
+		return 0;
+	}
+	if ( config.headless && config.duration == 0 ) {
+		cout << "[ERROR] Headless games need a duration." << endl;
+		return 0;
+	}
+	if ( config.checkParallel && !config.headless ) {
+		cout << "[ERROR] Parallel ticks are checked only in headless games." << endl;
+		return 0;
+	}
+	if ( !config.replayPath.empty() && (config.headless || !config.recordPath.empty()) ) {
+		cout << "[ERROR] Recordings are played in a window and can not be recorded again." << endl;
+		return 0;
+	}
+	if ( config.botScript != SCRIPT_NONE && !config.recordPath.empty() ) {
+		cout << "[ERROR] Scripted bots can not be recorded, state of the scripts is not in the keyframes." << endl;
+		return 0;
+	}
+	return 1;
+}
+//---
+
+bool ScenarioLoader::load(scenario &config, int argc, char **argv)
+{
+	setDefaults(config);
+	for ( int i = 1 ; i < argc ; i++ ) {
+		string arg = argv[i];
+		if ( arg.compare(0, 9, "--config=") == 0 && !loadFile(config, arg.substr(9)) ) {
+			return 0;
+		}
+		if ( arg == "--config" && i + 1 < argc && !loadFile(config, argv[i + 1]) ) {
+			return 0;
+		}
+	}
+	if ( !loadArgs(config, argc, argv) || !validate(config) ) {
+		return 0;
+	}
+	if ( config.seed == 0 ) {
+		config.seed = time(NULL);
+	}
+	if ( !config.replayPath.empty() ) {
+		RecordReader reader;
+		if ( !reader.open(config.replayPath) ) {
+			return 0;
+		}
+		reader.getScenario(config);
+	}
+	return 1;
+}
+
+//Seed is printed, so a run can be repeated with "--seed".
+void ScenarioLoader::print(const scenario &config)
+{
+	cout << "[INFO] Scenario: " << config.width << "x" << config.height << ", " << config.numBarrels << " barrels, "
+		 << config.numSandbags << " sandbags, " << config.numHumans << " players, " << config.numBots << " bots, "
+		 << config.tickRate << " ticks/s, bullet speed " << config.bulletSpeed << ", seed " << config.seed
+		 << (config.bulletCollisions ? ", bullet collisions" : "") << (config.numTeams ? ", " + to_string(config.numTeams) + " teams" : "") << (config.headless ? ", headless" : "") << ", duration " << config.duration << " ticks"
+		 << (config.mapPath.empty() ? "" : ", map " + config.mapPath)
+		 << (config.telemetryPath.empty() ? "" : ", telemetry " + config.telemetryPath)
+		 << (config.recordPath.empty() ? "" : ", record " + config.recordPath)
+		 << (config.replayPath.empty() ? "" : ", replay " + config.replayPath)
+		 << (config.botScript == SCRIPT_PATROL ? ", patrolling bots" : "")
+		 << (config.checkParallel ? ", parallel ticks checked" : "") << "." << endl;
+}
+
+
+//////////////////////////////////// Definitions of Game Class
+Game::Game(const scenario &config) :	numBarrels(config.numBarrels),
+										numSandbags(config.numSandbags),
+										numPlayers(config.numHumans + config.numBots),
+										numHumans(config.numHumans),
+										width(config.width),
+										height(config.height),
+										worldSize(config.width, config.height),
+										tickRate(config.tickRate),
+										bulletSpeed(config.bulletSpeed),
+										duration(config.duration),
+										headless(config.headless),
+										textureDir(config.textureDir),
+										fontPath(config.fontPath),
+										archivePath(config.archivePath),
+										mapPath(config.mapPath),
+										exportPath(config.exportPath),
+										telemetryPath(config.telemetryPath),
+										recordPath(config.recordPath),
+										replayPath(config.replayPath),
+										tick(0),
+										matchSeed(config.seed),
+										window(NULL),
+										text(NULL),
+										showMessage(0),
+										particleTime(0),
+										barrels(NULL),
+										sandbags(NULL),
+										players(NULL),
+										bullets(NULL),
+										collisionMode(COLLIDE_BRUTE),
+										bulletCollisions(config.bulletCollisions),
+										capBullets(0),
+										numTeams(config.numTeams),
+										botScript(config.botScript),
+										cancelledBullets(0),
+										hiddenBarrels(0),
+										sightParallelMin(RAYCAST_PARALLEL_MIN),
+										nextBulletId(0),
+										keyframe(NULL),
+										frame(NULL),
+										records(NULL),
+										bulletRects(NULL),
+										numBulletRects(0),
+										numDirty(0),
+										fullRedraw(1),
+										needPresent(0),
+										presentedFrames(0),
+										skippedFrames(0),
+										redrawnArea(0),
+										placement(NULL)
+{
+	rng.seed(config.seed); //Seed the random number generator, the loader replaces 0 with the time.
+	setCollisionMode(config.collisionMode);
+}
+
+Game::~Game() //Clear the memory.
+{
+	delete [] barrels;
+	delete [] sandbags;
+	delete [] players;
+	delete [] bullets;
+	delete [] records;
+	delete [] bulletRects;
+	delete [] placement;
+	delete keyframe;
+	delete frame;
+	delete text;
+	delete window;
+}
+
+//-> 1 means there is a collision, 0 means no collision.
+bool Game::entityCollisionCheck(entityArray *const entities, const unsigned int &lastEntIndex)
+{
+	//-> Compare the new entity location with older entities to prevent collision.
+	sf::Vector2u extend(PADDING, PADDING);
+	for (unsigned int i = 0 ; i < lastEntIndex ; i++) {
+		if ( isCollide(entities[i].pos, entities[i].size + extend, entities[lastEntIndex].pos, entities[lastEntIndex].size + extend) ) {
+			return 1;
+		} else {
+			continue;
+		}
+	}
+	return 0;
+}
+
+//-> Archive is used if it exists, otherwise loose files are decoded by the
+//   worker pool while the window shows the loading screen. So the load time is
+//   close to the decode time of the slowest file. Load time and resident memory
+//   are reported to compare the two paths.
+void Game::initAssets(void)
+{
+	AllocScope scope(TAG_ASSETS);
+	sf::Clock clock;
+	string source = archivePath;
+	assets.setHeadless(headless);
+	if ( !assets.loadArchive(archivePath) ) {
+		if ( headless ) {
+			//There is no loading screen, so the files are decoded in this thread.
+			source = "loose files";
+			if ( !assets.loadFiles(textureDir, fontPath) ) {
+				exit(1);
+			}
+		} else {
+			source = "loose files (" + to_string(workers.size()) + " workers)";
+			assets.loadFilesAsync(workers, textureDir, fontPath);
+			int pending;
+			while ( (pending = assets.uploadReady(ASSET_UPLOADS_PER_FRAME)) > 0 ) {
+				drawLoading(assets.getProgress());
+			}
+			if ( pending < 0 ) {
+				exit(1);
+			}
+		}
+	}
+	cout << "[INFO] Assets are loaded from " << source << " in " << clock.getElapsedTime().asMicroseconds() / 1000.0
+		 << " ms, resident memory " << residentKB() << " KB." << endl;
+}
+//---
+
+//-> Loading screen, a progress bar. Font is not loaded yet, so there is no text.
+void Game::drawLoading(const float &progress)
+{
+	sf::Event event;
+	while (window->pollEvent(event)) {
+		if ( event.type == sf::Event::Closed ) {
+			window->close();
+		}
+	}
+	if ( !window->isOpen() ) {
+		return;
+	}
+	sf::RectangleShape frame(sf::Vector2f(width / 2, 20));
+	sf::RectangleShape bar(sf::Vector2f(width / 2 * progress, 20));
+	frame.setPosition(width / 4, height / 2 - 10);
+	bar.setPosition(width / 4, height / 2 - 10);
+	frame.setFillColor(sf::Color(60, 60, 60));
+	bar.setFillColor(sf::Color::White);
+	window->clear(sf::Color::Black);
+	window->draw(frame);
+	window->draw(bar);
+	window->display();
+	sf::sleep(sf::milliseconds(1));
+}
+//---
+
+inline void Game::initBackGround(void)
+{
+	//Background texture is repeated by the AssetStore.
+	bgSprite.setTexture(assets.getTexture(ASSET_GRASS));
+	
+	//-> Sprite will be same width and height with window. In case of the larger
+	//   sprite, then texture repeatedly fill the sprite area.
+	bgSprite.setTextureRect(sf::IntRect(0, 0, width, height));
+	//---
+}
+
+inline sf::Vector2f Game::getRandCoord(const sf::Vector2u &textureSize)
+{
+	//-> Create a random x and y according to the game width and height and also
+	//   texture of the entities width and height.
+	sf::Vector2f randCoord;
+	randCoord.x = rng.next() % (width - textureSize.x);
+	randCoord.y = rng.next() % (height - textureSize.y);
+	//---
+	return randCoord;
+}
+
+inline void Game::initEntities(void)
+{
+	AllocScope scope(TAG_ENTITIES);
+	//-> Memory allocations of entities.
+	barrels = new Barrel[numBarrels];
+	sandbags = new Sandbag[numSandbags];
+	players = new Player[numPlayers];
+	bullets = new BulletList[numPlayers];
+	//---
+
+	//-> This part created for the collision check.
+	//   Size of entity texture and position of entity will be saved to the array.
+	placement = new entityArray[numBarrels + numSandbags + numPlayers];
+	//---
+
+	//-> Entities are initialized at (0,0) location, then they are placed.
+	const GameMap *index = map.isLoaded() ? &map : NULL;
+	for (int i = 0 ; i < numBarrels ; i++ ) {
+		(barrels+i)->init(&worldSize, assets.getTexture(ASSET_BARREL), sf::Vector2f(0,0), *assets.getMasks(ASSET_BARREL));
+		(barrels+i)->setHash(&hiddenBarrels, i);
+	}
+	for (int i = 0 ; i < numSandbags ; i++ ) {
+		(sandbags+i)->init(&worldSize, assets.getTexture(ASSET_BAGS), sf::Vector2f(0,0), *assets.getMasks(ASSET_BAGS));
+	}
+	for (int i = 0 ; i < numPlayers ; i++ ) {
+		(players+i)->init(&worldSize, index, &rng, assets.getTexture(ASSET_SOLDIER), assets.getRects(ASSET_SOLDIER), assets.getMasks(ASSET_SOLDIER), sf::Vector2f(0,0));
+		(bullets+i)->init(&worldSize, index, assets.getTexture(ASSET_BULLET), assets.getBulletMasks(), (players+i), &nextBulletId);
+		(players+i)->setTeam(numTeams ? i % numTeams : -1);
+	}
+	placeEntities();
+	//---
+
+	broadPhase.init(numSandbags + numBarrels + numPlayers + BULLET_POOL_SIZE * numPlayers);
+	sight.init(worldSize, sandbags, numSandbags, barrels, numBarrels);
+	records = new drawRecord[numBarrels + numPlayers];
+	for ( int i = 0 ; i < numBarrels + numPlayers ; i++ ) {
+		records[i].frame = -1;
+		records[i].deaths = 0;
+	}
+	bulletRects = new sf::FloatRect[BULLET_POOL_SIZE * numPlayers];
+	numBulletRects = 0;
+	invalidate();
+}
+
+//-> In every step, texture size of the entity is saved to the "placement" array,
+//   than this item is moved to a random coordinate and also this coordinate
+//   is saved to the "placement" array. Then collision check is applied
+//   to the given "placement" array. lastEntIndex is the index of the
+//   new saved entitiy in the "placement" array.
+//   Obstacles of a map are placed without checks, and the players are placed
+//   at its spawns, so only the players are checked for them.
+void Game::placeEntities(void)
+{
+	entityArray *entities = placement;
+	unsigned int lastEntIndex = 0;
+	const GameMap *index = map.isLoaded() ? &map : NULL;
+	for (int i = 0 ; i < numBarrels ; i++ ) {
+		if ( index != NULL ) {
+			(barrels+i)->setPosition(map.getBarrel(i));
+			continue;
+		}
+		(entities+lastEntIndex)->size = (barrels+i)->getSize();
+		do {
+			(barrels+i)->setPosition(getRandCoord((barrels+i)->getSize()));
+			(entities+lastEntIndex)->pos = (barrels+i)->getPosition();
+		} while (entityCollisionCheck(entities, lastEntIndex));
+		lastEntIndex++;
+	}
+	for (int i = 0 ; i < numSandbags ; i++ ) {
+		if ( index != NULL ) {
+			(sandbags+i)->setPosition(map.getSandbag(i));
+			continue;
+		}
+		(entities+lastEntIndex)->size = (sandbags+i)->getSize();
+		do {
+			(sandbags+i)->setPosition(getRandCoord((sandbags+i)->getSize()));
+			(entities+lastEntIndex)->pos = (sandbags+i)->getPosition();
+		} while (entityCollisionCheck(entities, lastEntIndex));
+		lastEntIndex++;
+	}
+	for (int i = 0 ; i < numPlayers ; i++ ) {
+		(entities+lastEntIndex)->size = (players+i)->getSize();
+		do {
+			if ( index != NULL ) {
+				(players+i)->setPosition(map.getSpawn(rng.next() % map.getNumSpawns()));
+			} else {
+				(players+i)->setPosition(getRandCoord((players+i)->getSize()));
+			}
+			(entities+lastEntIndex)->pos = (players+i)->getPosition();
+		} while (entityCollisionCheck(entities, lastEntIndex));
+		lastEntIndex++;
+	}
+}
+
+//-> Entities, pools and the grids are reused, so nothing is allocated or loaded.
+//   The generator is seeded before the placement as in the constructor, so the
+//   match is the same as the first match of a game with this seed.
+void Game::reset(const unsigned int &seed)
+{
+	rng.seed(seed);
+	matchSeed = seed;
+	tick = 0;
+	nextBulletId = 0;
+	for ( int i = 0 ; i < numPlayers ; i++ ) {
+		bullets[i].clear();
+		players[i].reset();
+	}
+	for ( int i = 0 ; i < numBarrels ; i++ ) {
+		barrels[i].setVisible(1);
+	}
+	placeEntities();
+	sight.build(sandbags, barrels);
+	scripts.clear();
+	spawnScripts();
+	particles.clear();
+	cancelledBullets = 0;
+	for ( int i = 0 ; i < numBarrels + numPlayers ; i++ ) {
+		records[i].frame = -1;
+		records[i].deaths = 0;
+	}
+	numBulletRects = 0;
+	showMessage = 0;
+	invalidate();
+}
+//---
+
+//-> Placement tries random positions until an entity does not touch the others,
+//   so a crowded arena would never be filled. Sizes are known after the assets
+//   are loaded, so this is checked by the game and not by the ScenarioLoader.
+bool Game::fitsArena(void)
+{
+	const AssetId ids[] = {ASSET_BARREL, ASSET_BAGS, ASSET_SOLDIER};
+	const int counts[] = {numBarrels, numSandbags, numPlayers};
+	double area = 0;
+	for ( int i = 0 ; i < 3 ; i++ ) {
+		sf::Vector2u size = assets.getMasks(ids[i])->getSize() + sf::Vector2u(PADDING, PADDING);
+		if ( size.x >= worldSize.x || size.y >= worldSize.y ) {
+			return 0;
+		}
+		area += CAST_FLOAT(size.x) * size.y * counts[i];
+	}
+	return area <= SCENARIO_MAX_DENSITY * width * height;
+}
+//---
+
+inline void Game::initFontAndText(const int textSize)
+{
+	text = new sf::Text;
+	text->setFont(assets.getFont());
+	text->setCharacterSize(textSize);
+	scoreBoard.init(window, assets.getFont(), textSize, numPlayers);
+}
+
+//-> Headless games have no window, no frame and no text, only the entities.
+void Game::initGameEnv(void)
+{
+	if ( !mapPath.empty() ) {
+		if ( !map.load(mapPath) ) {
+			exit(1);
+		}
+		worldSize = map.getSize();
+		width = worldSize.x;
+		height = worldSize.y;
+		numBarrels = map.getNumBarrels();
+		numSandbags = map.getNumSandbags();
+	}
+	//-> A bullet of the grid has its item, its order entry and at most two buckets of start and cursor.
+	frameArena.init(FRAME_ARENA_SIZE + numPlayers * BULLET_POOL_SIZE * (4 * sizeof(sf::Vertex) + sizeof(hitEvent) +
+																		sizeof(gridBullet) + 5 * sizeof(sf::Uint32)));
+	//---
+	if ( !headless ) {
+		window = new sf::RenderWindow(sf::VideoMode(width, height), "Shooter 2D");
+		workers.start(0);
+		frame = new sf::RenderTexture;
+		frame->create(width, height);
+		frameSprite.setTexture(frame->getTexture(), true);
+	}
+	initAssets();
+	if ( map.isLoaded() && !map.matches(assets) ) {
+		cout << "[ERROR] Map is exported with other assets: " << mapPath << endl;
+		exit(1);
+	}
+	if ( !map.isLoaded() && !fitsArena() ) {
+		cout << "[ERROR] Arena " << width << "x" << height << " is too small for " << numBarrels << " barrels, "
+			 << numSandbags << " sandbags and " << numPlayers << " players." << endl;
+		exit(1);
+	}
+	initEntities();
+	spawnScripts();
+	if ( !telemetryPath.empty() && telemetry.start(telemetryPath) ) {
+		for ( int i = 0 ; i < numPlayers ; i++ ) {
+			players[i].setTelemetry(&telemetry, i);
+			bullets[i].setTelemetry(&telemetry);
+		}
+	}
+	if ( !recordPath.empty() ) {
+		startRecording();
+	}
+	if ( !headless ) {
+		initBackGround();
+		initFontAndText(40);
+		particles.init(PARTICLE_CAPACITY);
+	}
+}
+//---
+
+//-> Sizes and counts are the ones of the game, a map replaces the ones of the scenario.
+void Game::startRecording(void)
+{
+	recordHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, RECORD_MAGIC, 4);
+	header.version = RECORD_VERSION;
+	header.keyframeTicks = RECORD_KEYFRAME_TICKS;
+	header.width = width;
+	header.height = height;
+	header.numBarrels = numBarrels;
+	header.numSandbags = numSandbags;
+	header.numHumans = numHumans;
+	header.numBots = numPlayers - numHumans;
+	header.tickRate = tickRate;
+	header.bulletSpeed = bulletSpeed;
+	header.seed = matchSeed;
+	header.collisionMode = collisionMode;
+	header.bulletCollisions = bulletCollisions;
+	header.numTeams = numTeams;
+	if ( mapPath.size() >= RECORD_MAP_PATH_SIZE ) {
+		cout << "[ERROR] Map path is too long for a recording: " << mapPath << endl;
+		return;
+	}
+	strcpy(header.mapPath, mapPath.c_str());
+	if ( recorder.start(recordPath, header) && keyframe == NULL ) {
+		AllocScope scope(TAG_RECORDING);
+		keyframe = new worldSnapshot;
+	}
+}
+//---
+
+inline void Game::recordTick(const tickInput &input)
+{
+	if ( !recorder.isRunning() ) {
+		return;
+	}
+	if ( recorder.needsKeyframe(tick) ) {
+		captureSnapshot(*keyframe);
+		recorder.writeKeyframe(*keyframe, matchSeed);
+	}
+	recorder.writeInput(input, getHash());
+}
+
+inline void Game::invalidate(void) { fullRedraw = 1; }
+
+//-> Rect is rounded out to whole pixels and clipped to the window. It is merged
+//   into an overlapping dirty rect, if there is no room then the frame is redrawn.
+void Game::addDirty(const sf::FloatRect &rect)
+{
+	if ( fullRedraw ) {
+		return;
+	}
+	float left = floor(rect.left) > 0 ? floor(rect.left) : 0;
+	float top = floor(rect.top) > 0 ? floor(rect.top) : 0;
+	float right = ceil(rect.left + rect.width) < width ? ceil(rect.left + rect.width) : width;
+	float bottom = ceil(rect.top + rect.height) < height ? ceil(rect.top + rect.height) : height;
+	if ( right <= left || bottom <= top ) {
+		return;
+	}
+	sf::FloatRect r(left, top, right - left, bottom - top);
+	for ( int i = 0 ; i < numDirty ; i++ ) {
+		if ( dirty[i].intersects(r) ) {
+			float l = (dirty[i].left < left) ? dirty[i].left : left;
+			float t = (dirty[i].top < top) ? dirty[i].top : top;
+			float rr = (dirty[i].left + dirty[i].width > right) ? dirty[i].left + dirty[i].width : right;
+			float b = (dirty[i].top + dirty[i].height > bottom) ? dirty[i].top + dirty[i].height : bottom;
+			dirty[i] = sf::FloatRect(l, t, rr - l, b - t);
+			return;
+		}
+	}
+	if ( numDirty == DIRTY_MAX_RECTS ) {
+		invalidate();
+		return;
+	}
+	dirty[numDirty++] = r;
+}
+//---
+
+//-> Entities are compared with the records of the last frame. Both old and new
+//   areas of a changed entity are dirty. Records are always updated, so they
+//   are right after a full redraw too.
+void Game::collectDirty(void)
+{
+	const bool effects = governor.getEffects();
+	for ( int i = 0 ; i < numBarrels ; i++ ) {
+		drawRecord &record = records[i];
+		sf::FloatRect bounds = barrels[i].getBounds();
+		int visible = barrels[i].getVisible();
+		if ( record.frame != visible || record.bounds != bounds ) {
+			if ( record.frame == 1 && visible == 0 && effects ) {
+				sf::Vector2f center(bounds.left + bounds.width / 2, bounds.top + bounds.height / 2);
+				particles.spawn(center, PARTICLE_EXPLOSION, sf::Color(255, 170, 40), 260);
+				particles.spawn(center, PARTICLE_DEBRIS, sf::Color(90, 80, 70), 160);
+			}
+			addDirty(record.bounds);
+			addDirty(bounds);
+			record.bounds = bounds;
+			record.frame = visible;
+		}
+	}
+	for ( int i = 0 ; i < numPlayers ; i++ ) {
+		drawRecord &record = records[numBarrels + i];
+		sf::FloatRect bounds = players[i].getBounds();
+		//Effect is drawn where the player was seen last, before it is reborn. Deaths go
+		//back when an older state is applied, then no effect is spawned for them.
+		record.deaths = min(record.deaths, players[i].getDeaths());
+		for ( ; record.deaths < players[i].getDeaths() ; record.deaths++ ) {
+			if ( !effects ) {
+				continue;
+			}
+			particles.spawn(sf::Vector2f(record.bounds.left + record.bounds.width / 2, record.bounds.top + record.bounds.height / 2),
+							PARTICLE_HIT, sf::Color(170, 20, 20), 180);
+		}
+		if ( record.frame != players[i].getFrame() || record.bounds != bounds ) {
+			addDirty(record.bounds);
+			addDirty(bounds);
+			record.bounds = bounds;
+			record.frame = players[i].getFrame();
+		}
+	}
+	//-> Bullets move in every tick, so their old and new areas are always dirty.
+	for ( int i = 0 ; i < numBulletRects ; i++ ) {
+		addDirty(bulletRects[i]);
+	}
+	numBulletRects = 0;
+	for ( int i = 0 ; i < numPlayers ; i++ ) {
+		for ( Bullet *temp = bullets[i].getHead() ; temp != NULL ; temp = temp->next ) {
+			bulletRects[numBulletRects] = temp->getBounds();
+			addDirty(bulletRects[numBulletRects++]);
+		}
+	}
+	//---
+	//-> Particles move in every frame, like the bullets. A frame is a tick.
+	//   Times of the previous frame are complete here, so they are summed first.
+	//   Without effects the particles are removed.
+	particleTime += particles.getUpdateTime() + particles.getDrawTime();
+	addDirty(particles.getBounds());
+	if ( effects ) {
+		particles.update(1.0f / tickRate, &workers);
+		addDirty(particles.getBounds());
+	} else {
+		particles.clear();
+	}
+	//---
+	sf::FloatRect oldScore = scoreBoard.getBounds();
+	if ( tick % governor.getOverlayInterval() == 0 && scoreBoard.update(players) ) {
+		addDirty(oldScore);
+		addDirty(scoreBoard.getBounds());
+	}
+}
+//---
+
+//-> Bullets of all lists share a texture, they are drawn with a single call
+//   from a vertex batch. Other entities are drawn only if they are in the region.
+inline void Game::drawEntities(const sf::FloatRect *const region, ArenaArray<sf::Vertex> &batch)
+{
+	for ( int i = 0 ; i < numBarrels ; i++ ) {
+		if ( region == NULL || region->intersects(barrels[i].getBounds()) ) {
+			barrels[i].paint(*frame);
+		}
+	}
+	for ( int i = 0 ; i < numSandbags ; i++ ) {
+		if ( region == NULL || region->intersects(sandbags[i].getBounds()) ) {
+			sandbags[i].paint(*frame);
+		}
+	}
+	for ( int i = 0 ; i < numPlayers ; i++ ) {
+		if ( region == NULL || region->intersects(players[i].getBounds()) ) {
+			players[i].paint(*frame);
+		}
+	}
+	if ( batch.size() > 0 ) {
+		frame->draw(batch.begin(), batch.size(), sf::Quads, sf::RenderStates(&assets.getTexture(ASSET_BULLET)));
+	}
+	if ( region == NULL || region->intersects(particles.getBounds()) ) {
+		particles.paint(*frame);
+	}
+}
+//---
+
+inline void Game::drawBackground(void) //Background covers the whole frame, so it is not cleared.
+{
+	frame->draw(bgSprite);
+}
+
+inline void Game::drawText(void)
+{
+	if ( showMessage ) {
+		frame->draw(*text);
+	} else {
+		scoreBoard.paint(*frame);
+	}
+}
+
+//-> Region is drawn with a view which has the same size as its viewport, so
+//   nothing is drawn outside of it. NULL region is the whole frame.
+void Game::redraw(const sf::FloatRect *const region, ArenaArray<sf::Vertex> &batch)
+{
+	if ( region != NULL ) {
+		sf::View view(*region);
+		view.setViewport(sf::FloatRect(	region->left / width, region->top / height,
+										region->width / width, region->height / height));
+		frame->setView(view);
+		redrawnArea += (region->width * region->height) / (CAST_FLOAT(width) * height);
+	} else {
+		frame->setView(frame->getDefaultView());
+		redrawnArea += 1;
+	}
+	drawBackground();
+	drawEntities(region, batch);
+	drawText();
+}
+//---
+
+//-> Unchanged frames are not presented. Otherwise dirty regions are redrawn in
+//   the kept frame, and the frame is drawn to the window.
+inline void Game::update(void)
+{
+	AllocScope scope(TAG_RENDER);
+	collectDirty();
+	if ( !fullRedraw && numDirty == 0 && !needPresent ) {
+		skippedFrames++;
+		return;
+	}
+	size_t mark = frameArena.getMark();
+	ArenaArray<sf::Vertex> batch(frameArena, 4 * BULLET_POOL_SIZE * numPlayers);
+	for ( int i = 0 ; i < numPlayers ; i++ ) {
+		bullets[i].paint(batch);
+	}
+	if ( fullRedraw ) {
+		redraw(NULL, batch);
+	} else {
+		for ( int i = 0 ; i < numDirty ; i++ ) {
+			redraw(dirty + i, batch);
+		}
+	}
+	frame->setView(frame->getDefaultView());
+	frame->display();
+	window->draw(frameSprite);
+	window->display();
+	frameArena.release(mark);
+	numDirty = 0;
+	fullRedraw = 0;
+	needPresent = 0;
+	presentedFrames++;
+}
+//---
+
+//-> Fills the snapshot from the entities. Each bullet list is sorted by id, new
+//   bullets are appended, so the lists are merged by taking the smallest head.
+void Game::captureSnapshot(worldSnapshot &snap)
+{
+	snap.tick = tick;
+	snap.rngState = rng.getState();
+	snap.nextBulletId = nextBulletId;
+	snap.np = numPlayers < SNAP_MAX_PLAYERS ? numPlayers : SNAP_MAX_PLAYERS;
+	snap.nb = numBarrels < SNAP_MAX_BARRELS ? numBarrels : SNAP_MAX_BARRELS;
+	for ( int i = 0 ; i < snap.np ; i++ ) {
+		players[i].save(snap.players[i]);
+	}
+	memset(snap.barrelVisible, 0, sizeof(snap.barrelVisible));
+	for ( int i = 0 ; i < snap.nb ; i++ ) {
+		if ( barrels[i].getVisible() ) {
+			snap.barrelVisible[i >> 3] |= 1 << (i & 7);
+		}
+	}
+	Bullet *heads[SNAP_MAX_PLAYERS];
+	for ( int i = 0 ; i < snap.np ; i++ ) {
+		heads[i] = bullets[i].getHead();
+	}
+	snap.nbul = 0;
+	while ( 1 ) {
+		int first = -1;
+		for ( int i = 0 ; i < snap.np ; i++ ) {
+			if ( heads[i] != NULL && (first == -1 || heads[i]->getId() < heads[first]->getId()) ) {
+				first = i;
+			}
+		}
+		if ( first == -1 ) {
+			break;
+		}
+		heads[first]->save(snap.bullets[snap.nbul++], first);
+		heads[first] = heads[first]->next;
+	}
+}
+//---
+
+//-> Terms of the bullets and the barrels are kept by the lists and the barrels,
+//   so only the soldiers are hashed here.
+sf::Uint64 Game::getHash(void)
+{
+	sf::Uint64 hash = StateHash::start(tick, rng.getState(), nextBulletId);
+	playerSnap snap;
+	for ( int i = 0 ; i < numPlayers ; i++ ) {
+		players[i].save(snap);
+		hash = StateHash::add(StateHash::add(hash, StateHash::player(snap)), bullets[i].getHash());
+	}
+	return StateHash::add(hash, hiddenBarrels);
+}
+//---
+
+//-> Spectator side, entities are set to the received snapshot.
+void Game::applySnapshot(const worldSnapshot &snap)
+{
+	if ( snap.np != numPlayers || snap.nb != numBarrels ) {
+		cout << "[ERROR] Snapshot does not match the game." << endl;
+		return;
+	}
+	tick = snap.tick;
+	rng.setState(snap.rngState);
+	for ( int i = 0 ; i < snap.np ; i++ ) {
+		players[i].load(snap.players[i]);
+		bullets[i].clear();
+	}
+	for ( int i = 0 ; i < snap.nb ; i++ ) {
+		barrels[i].setVisible((snap.barrelVisible[i >> 3] >> (i & 7)) & 1);
+	}
+	for ( int i = 0 ; i < snap.nbul ; i++ ) {
+		bullets[snap.bullets[i].owner].load(snap.bullets[i]);
+	}
+	nextBulletId = snap.nextBulletId;
+}
+//---
+
+//-> Fire, walk and then bullets. Same order is used in the local game and in rollback.
+void Game::step(const tickInput &input)
+{
+	AllocScope scope(TAG_SIMULATION);
+	telemetry.setTick(tick);
+	capBullets = input.capBullets;
+	for ( int i = 0 ; i < 2 && i < numHumans ; i++ ) {
+		if ( input.fire[i] && canFire(i) ) {
+			players[i].fire(bullets + i, bulletSpeed);
+		}
+	}
+	for ( int i = 0 ; i < 2 && i < numHumans ; i++ ) {
+		if ( input.move[i] != -1 ) {
+			players[i].walk(18, static_cast<Direction>(input.move[i]), players, barrels, sandbags, numPlayers, numBarrels, numSandbags);
+		}
+	}
+	scripts.run(tick);
+	driveBots();
+	if ( bulletCollisions && layersCollide(LAYER_BULLET, LAYER_BULLET) ) {
+		cancelledBullets += cancelBullets();
+	}
+	//-> Hits are applied after all bullets are moved. A player is reborn once in
+	//   a tick, so only the first hit on a player gives a point.
+	size_t mark = frameArena.getMark();
+	ArenaArray<hitEvent> hits(frameArena, BULLET_POOL_SIZE * numPlayers);
+	const int numEntities = numSandbags + numBarrels + numPlayers;
+	const sf::Uint32 *pairs = NULL;
+	ArenaArray<sf::Uint32> candidates(frameArena, (collisionMode == COLLIDE_SWEEP) ? BROADPHASE_MAX_PAIRS : 0);
+	if ( collisionMode == COLLIDE_SWEEP && findCandidates(candidates) ) {
+		pairs = candidates.begin();
+	}
+	for ( int i = 0 ; i < numPlayers ; i++ ) {
+		bullets[i].update(	players, barrels, sandbags, numPlayers, numBarrels, numSandbags,
+							hits, pairs, candidates.size(), numEntities + i * BULLET_POOL_SIZE);
+	}
+	unsigned int rebornMask = 0;
+	for ( size_t i = 0 ; i < hits.size() ; i++ ) {
+		if ( rebornMask & (1u << hits[i].target) ) {
+			continue;
+		}
+		rebornMask |= 1u << hits[i].target;
+		players[hits[i].target].reborn(players, barrels, sandbags, numPlayers, numBarrels, numSandbags);
+		players[hits[i].shooter].incrementScore();
+	}
+	frameArena.release(mark);
+	//---
+	tick++;
+}
+//---
+
+//-> Bots fire and walk in the same ticks as the keyboard players could. Their
+//   choices are taken from the random generator of the game, which is a part
+//   of the world state, so a tick stays deterministic for rollback and replays.
+//   A bot fires only if it sees the nearest player of another team. Rays of all
+//   bots are cast as a batch from the centers of the soldiers.
+void Game::driveBots(void)
+{
+	if ( botScript != SCRIPT_NONE ) { //Scripted bots are driven by their scripts.
+		return;
+	}
+	if ( tick % FIRE_TICKS == 0 && numPlayers > numHumans ) {
+		const int numBots = numPlayers - numHumans;
+		size_t mark = frameArena.getMark();
+		rayQuery *queries = frameArena.allocArray<rayQuery>(numBots);
+		rayHit *hits = frameArena.allocArray<rayHit>(numBots);
+		if ( queries != NULL && hits != NULL ) {
+			sf::Vector2f centers[SNAP_MAX_PLAYERS];
+			for ( int i = 0 ; i < numPlayers ; i++ ) {
+				sf::FloatRect box = players[i].getOpaqueBox();
+				centers[i] = sf::Vector2f(box.left + box.width / 2, box.top + box.height / 2);
+			}
+			for ( int i = numHumans ; i < numPlayers ; i++ ) {
+				int target = -1;
+				float nearest = 0;
+				const int team = players[i].getTeam();
+				for ( int j = 0 ; j < numPlayers ; j++ ) {
+					sf::Vector2f d = centers[j] - centers[i];
+					if ( j != i && (team < 0 || players[j].getTeam() != team) && (target < 0 || d.x * d.x + d.y * d.y < nearest) ) {
+						target = j;
+						nearest = d.x * d.x + d.y * d.y;
+					}
+				}
+				queries[i - numHumans].from = centers[i];
+				queries[i - numHumans].to = (target < 0) ? centers[i] : centers[target];
+			}
+			sight.sync(barrels);
+			sight.castBatch(queries, hits, numBots, &workers, sightParallelMin);
+		}
+		for ( int i = numHumans ; i < numPlayers ; i++ ) {
+			bool visible = (queries == NULL || hits == NULL || hits[i - numHumans].slot < 0);
+			if ( visible && rng.next() % 2 && canFire(i) ) {
+				players[i].fire(bullets + i, bulletSpeed);
+			}
+		}
+		frameArena.release(mark);
+	}
+	if ( tick % WALK_TICKS == 0 ) {
+		for ( int i = numHumans ; i < numPlayers ; i++ ) {
+			unsigned int dir = rng.next() % 5; //4 means the bot stands.
+			if ( dir < 4 && map.isLoaded() ) { //A bot does not walk into a cell with obstacles.
+				const float ahead[4][2] = {{0, -1}, {0, 1}, {-1, 0}, {1, 0}};
+				sf::FloatRect box = players[i].getOpaqueBox();
+				sf::Vector2f point(	box.left + box.width / 2 + ahead[dir][0] * (box.width / 2 + 18),
+									box.top + box.height / 2 + ahead[dir][1] * (box.height / 2 + 18));
+				dir = map.isWalkable(point) ? dir : 4;
+			}
+			if ( dir < 4 ) {
+				players[i].walk(18, static_cast<Direction>(dir), players, barrels, sandbags, numPlayers, numBarrels, numSandbags);
+			}
+		}
+	}
+}
+//---
+
+//-> Frames of all bots are reserved, so a reset does not allocate.
+void Game::spawnScripts(void)
+{
+	if ( botScript == SCRIPT_NONE ) {
+		return;
+	}
+	scripts.reserve(numPlayers - numHumans);
+	for ( int i = numHumans ; i < numPlayers ; i++ ) {
+		scripts.spawn(patrol(i), tick);
+	}
+}
+
+bool Game::scriptWalk(const int &player, const Direction &dir)
+{
+	sf::Vector2f before = players[player].getPosition();
+	players[player].walk(18, dir, players, barrels, sandbags, numPlayers, numBarrels, numSandbags);
+	return players[player].getPosition() != before;
+}
+
+//-> Walks until the soldier is blocked, then turns clockwise and fires. First
+//   direction depends on the player, so the bots do not walk together.
+Script Game::patrol(const int player)
+{
+	const Direction clockwise[4] = {RIGHT, LEFT, UP, DOWN}; //Indexed by Direction.
+	Direction dir = static_cast<Direction>(player % 4);
+	for ( ; ; ) {
+		int stillWalks = 0;
+		while ( stillWalks < SCRIPT_BLOCKED_WALKS ) {
+			stillWalks = scriptWalk(player, dir) ? 0 : stillWalks + 1;
+			co_await ScriptWait(WALK_TICKS);
+		}
+		dir = clockwise[dir];
+		if ( canFire(player) ) {
+			players[player].fire(bullets + player, bulletSpeed);
+		}
+	}
+}
+//---
+
+inline bool Game::canFire(const int &player)
+{
+	return !capBullets || bullets[player].size() < GOVERNOR_BULLET_CAP;
+}
+
+//-> Serial copy is stepped first with the same input. Frame arena of this game
+//   is reset by the caller.
+bool Game::stepChecked(Game &serial, const tickInput &input)
+{
+	serial.frameArena.reset();
+	serial.step(input);
+	const sf::Uint64 serialHash = serial.getHash();
+	step(input);
+	return getHash() == serialHash;
+}
+//---
+
+//-> Simulation runs in every tick, so its rate does not depend on the load. Bullet
+//   cap of the governor is put into the input, so it is recorded with the tick.
+bool Game::runTick(const tickInput &input)
+{
+	sf::Clock clock;
+	tickInput capped = input;
+	capped.capBullets = governor.getBulletCap();
+	recordTick(capped);
+	step(capped);
+	sf::Int64 tickCost = clock.restart().asMicroseconds();
+	bool rendered = (tick % governor.getRenderInterval() == 0);
+	if ( rendered ) {
+		update();
+	}
+	sf::Int64 renderCost = clock.getElapsedTime().asMicroseconds();
+	governor.record(tick, tickCost, renderCost);
+	if ( telemetry.isRunning() ) {
+		telemetry.record(TEL_TICK, 0, 0, 0, tickCost);
+		if ( rendered ) {
+			telemetry.record(TEL_FRAME, 0, 0, 0, renderCost);
+		}
+	}
+	return rendered;
+}
+//---
+
+//-> A bullet is not larger than a grid cell, so touching bullets are in the
+//   same or in neighbour cells. Grid is a hash of the cells, built with a
+//   counting sort in the frame arena, so a tick costs O(bullets). Bullets are
+//   marked first and removed after the pass, so a bullet which touches two
+//   others removes both of them. Arena is sized for the grid of full pools.
+int Game::cancelBullets(void)
+{
+	int numBullets = 0;
+	for ( int p = 0 ; p < numPlayers ; p++ ) {
+		for ( Bullet *temp = bullets[p].getHead() ; temp != NULL ; temp = temp->next ) {
+			numBullets++;
+		}
+	}
+	if ( numBullets < 2 ) {
+		return 0;
+	}
+	const sf::Vector2u maskSize = assets.getBulletMasks()->getSize();
+	const float cellSize = max(maskSize.x, maskSize.y) + 2; //Opaque boxes are 1 px larger.
+	unsigned int numBuckets = 1;
+	while ( numBuckets < static_cast<unsigned int>(numBullets) ) {
+		numBuckets <<= 1;
+	}
+	size_t mark = frameArena.getMark();
+	gridBullet *items = frameArena.allocArray<gridBullet>(numBullets);
+	sf::Uint32 *order = frameArena.allocArray<sf::Uint32>(numBullets);
+	sf::Uint32 *start = frameArena.allocArray<sf::Uint32>(numBuckets + 1);
+	sf::Uint32 *cursor = frameArena.allocArray<sf::Uint32>(numBuckets);
+	if ( cursor == NULL ) { //Arena is sized for full pools, so it is not reached.
+		frameArena.release(mark);
+		return 0;
+	}
+	int n = 0;
+	for ( int p = 0 ; p < numPlayers ; p++ ) {
+		for ( Bullet *temp = bullets[p].getHead() ; temp != NULL ; temp = temp->next, n++ ) {
+			items[n].bullet = temp;
+			items[n].box = temp->getOpaqueBox();
+			items[n].cellX = static_cast<sf::Int32>(floor(items[n].box.left / cellSize));
+			items[n].cellY = static_cast<sf::Int32>(floor(items[n].box.top / cellSize));
+			items[n].owner = p;
+			items[n].team = players[p].getTeam();
+			items[n].dead = 0;
+		}
+	}
+
+	auto opposing = [](const gridBullet &a, const gridBullet &b) {
+		return a.owner != b.owner && !(teamFiltered(LAYER_BULLET, LAYER_BULLET) && a.team >= 0 && a.team == b.team);
+	};
+	auto bucket = [numBuckets](const sf::Int32 &x, const sf::Int32 &y) {
+		return (static_cast<sf::Uint32>(x) * 73856093u ^ static_cast<sf::Uint32>(y) * 19349663u) & (numBuckets - 1);
+	};
+	memset(start, 0, (numBuckets + 1) * sizeof(sf::Uint32));
+	for ( int i = 0 ; i < numBullets ; i++ ) {
+		start[bucket(items[i].cellX, items[i].cellY) + 1]++;
+	}
+	for ( unsigned int h = 0 ; h < numBuckets ; h++ ) {
+		start[h + 1] += start[h];
+		cursor[h] = start[h];
+	}
+	for ( int i = 0 ; i < numBullets ; i++ ) {
+		order[cursor[bucket(items[i].cellX, items[i].cellY)]++] = i;
+	}
+	for ( int i = 0 ; i < numBullets ; i++ ) {
+		for ( int dy = -1 ; dy <= 1 ; dy++ ) {
+			for ( int dx = -1 ; dx <= 1 ; dx++ ) {
+				const sf::Int32 x = items[i].cellX + dx, y = items[i].cellY + dy;
+				const sf::Uint32 h = bucket(x, y);
+				for ( sf::Uint32 k = start[h] ; k < start[h + 1] ; k++ ) {
+					gridBullet &other = items[order[k]];
+					if ( static_cast<int>(order[k]) <= i || other.cellX != x || other.cellY != y ||
+						 !opposing(items[i], other) || !other.box.intersects(items[i].box) ) {
+						continue;
+					}
+					if ( isCollide(items[i].bullet->getMask(), items[i].bullet->getFixedMaskPos(), other.bullet->getMask(), other.bullet->getFixedMaskPos()) ) {
+						items[i].dead = 1;
+						other.dead = 1;
+					}
+				}
+			}
+		}
+	}
+
+	int removed = 0;
+	for ( int i = 0 ; i < numBullets ; i++ ) {
+		if ( items[i].dead ) {
+			bullets[items[i].owner].remove(items[i].bullet);
+			removed++;
+		}
+	}
+	frameArena.release(mark);
+	return removed;
+}
+//---
+
+//-> Hidden barrels are not set, so their slots are removed from the broad phase.
+//   If the pairs do not fit, then the tick falls back to brute force.
+bool Game::findCandidates(ArenaArray<sf::Uint32> &pairs)
+{
+	const int numEntities = numSandbags + numBarrels + numPlayers;
+	broadPhase.begin();
+	for ( int i = 0 ; i < numSandbags ; i++ ) {
+		broadPhase.setBox(i, sandbags[i].getOpaqueBox());
+	}
+	for ( int i = 0 ; i < numBarrels ; i++ ) {
+		if ( barrels[i].getVisible() ) {
+			broadPhase.setBox(numSandbags + i, barrels[i].getOpaqueBox());
+		}
+	}
+	for ( int i = 0 ; i < numPlayers ; i++ ) {
+		broadPhase.setBox(numSandbags + numBarrels + i, players[i].getOpaqueBox());
+	}
+	for ( int i = 0 ; i < numPlayers ; i++ ) {
+		for ( Bullet *temp = bullets[i].getHead() ; temp != NULL ; temp = temp->next ) {
+			broadPhase.setBox(numEntities + i * BULLET_POOL_SIZE + bullets[i].getPoolIndex(temp), temp->getOpaqueBox());
+		}
+	}
+	return broadPhase.query(numEntities, pairs);
+}
+//---
+
+void Game::setCollisionMode(const CollisionMode &mode)
+{
+	if ( mode == COLLIDE_SWEEP && numSandbags + numBarrels + numPlayers * (1 + BULLET_POOL_SIZE) > BROADPHASE_MAX_SLOTS ) {
+		cout << "[ERROR] Too many entities for the sweep broad phase, brute force is used." << endl;
+		collisionMode = COLLIDE_BRUTE;
+		return;
+	}
+	collisionMode = mode;
+}
+
+void Game::run2player(void)
+{
+	if ( numHumans > 2 || headless ) {
+		cout << "[ERROR] This method should be run with a window and at most 2 keyboard players." << endl;
+		return;
+	}
+
+	initGameEnv();
+
+	//-> Keys are read by the input thread, window events are used only for close and focus.
+	const sf::Keyboard::Key keys[] = {	sf::Keyboard::Up, sf::Keyboard::Down, sf::Keyboard::Right, sf::Keyboard::Left,
+										sf::Keyboard::W, sf::Keyboard::S, sf::Keyboard::D, sf::Keyboard::A,
+										sf::Keyboard::Enter, sf::Keyboard::Space, sf::Keyboard::Y, sf::Keyboard::N };
+	InputThread input;
+	LatencyMeter latency;
+	TickAllocStats tickAllocs;
+	inputEvent key;
+	input.start(keys, sizeof(keys) / sizeof(keys[0]));
+	//---
+
+	sf::Event event;
+	int pl1move = -1, pl2move = -1; //Holds movement dir of players
+	int pl1fire = -1, pl2fire = -1; //Holds fire situation of players
+	int plWait = 0; //Ticks since the last walk input.
+	int fireWait = 0; //Ticks since the last fire input.
+	//-> Ticks are scheduled by the clock. If the game falls behind more than a few
+	//   ticks, then the schedule is moved instead of simulating all of them at once.
+	sf::Clock tickClock;
+	const sf::Int64 tickTime = 1000000 / tickRate;
+	sf::Int64 nextTick = 0;
+	governor.init(tickTime);
+	//---
+
+	while ( window->isOpen() ) {
+
+		//-> Transient data of the previous tick is released.
+		frameArena.reset();
+		//---
+
+		while (window->pollEvent(event)) {
+			if ( event.type == sf::Event::Closed ) { //Handle the close event.
+				window->close();
+			} else if ( event.type == sf::Event::LostFocus ) {
+				input.setFocused(0);
+			} else if ( event.type == sf::Event::GainedFocus ) {
+				input.setFocused(1);
+				needPresent = 1;
+			}
+		}
+
+		//-> Wait section. Fire and walk inputs are given to the tick in which their
+		//   waits are over. Until the next tick the thread sleeps, at most 1 ms so
+		//   window events are not delayed.
+		sf::Int64 now = tickClock.getElapsedTime().asMicroseconds();
+		if ( now < nextTick ) {
+			sf::sleep(sf::microseconds(min<sf::Int64>(nextTick - now, 1000)));
+		} else {
+			nextTick = (now - nextTick > 4 * tickTime) ? now + tickTime : nextTick + tickTime;
+			plWait++;
+			fireWait++;
+			//-> A tick takes the key events which are captured before it, later
+			//   events stay in the queue for the next tick.
+			sf::Int64 inputTime = input.now();
+			while ( input.pop(key, inputTime) ) {
+				latency.consumed(key.time);
+				//-> Players' variables are set according to the key press.
+				if ( key.pressed ) {
+					switch (key.key) {
+						case sf::Keyboard::Up:
+							pl1move = UP;
+							break;
+						case sf::Keyboard::Down:
+							pl1move = DOWN;
+							break;
+						case sf::Keyboard::Right:
+							pl1move = RIGHT;
+							break;
+						case sf::Keyboard::Left:
+							pl1move = LEFT;
+							break;
+						case sf::Keyboard::W:
+							pl2move = UP;
+							break;
+						case sf::Keyboard::S:
+							pl2move = DOWN;
+							break;
+						case sf::Keyboard::D:
+							pl2move = RIGHT;
+							break;
+						case sf::Keyboard::A:
+							pl2move = LEFT;
+							break;
+						//-> If pl(x)fire is not -1 then new fire are prevented.
+						//   This means user fires just one bullet with the fire key.
+						case sf::Keyboard::Enter:
+							if ( pl1fire == -1 ) pl1fire = 1;
+							break;
+						case sf::Keyboard::Space:
+							if ( pl2fire == -1 ) pl2fire = 1;
+							break;
+						//---
+						default:
+							break;
 					}
-					break;
+				//---
+				//-> A keyrelease event wipes out its key press event.
+				} else {
+					switch (key.key) {
+						//-> One player can press two movement keys, then release the old key,
+						//   so in this situation soldier should not stop. Here multiple key press
+						//   effects are removed with if blocks.
+						case sf::Keyboard::Up:
+							if (pl1move == UP) pl1move = -1;
+							break;
+						case sf::Keyboard::Down:
+							if (pl1move == DOWN) pl1move = -1;
+							break;
+						case sf::Keyboard::Right:
+							if (pl1move == RIGHT) pl1move = -1;
+							break;
+						case sf::Keyboard::Left:
+							if (pl1move == LEFT) pl1move = -1;
+							break;
+						case sf::Keyboard::W:
+							if (pl2move == UP) pl2move = -1;
+							break;
+						case sf::Keyboard::S:
+							if (pl2move == DOWN) pl2move = -1;
+							break;
+						case sf::Keyboard::D:
+							if (pl2move == RIGHT) pl2move = -1;
+							break;
+						case sf::Keyboard::A:
+							if (pl2move == LEFT) pl2move = -1;
+							break;
+						//---
+						//-> Every user fire just one bullet at any keypress because
+						//   if pl(x)fire is not -1 then fire keypress is passed.
+						//   A tap which is released before its fire wait is over
+						//   is kept as 2, so it is not lost.
+						case sf::Keyboard::Enter:
+							pl1fire = (pl1fire == 1) ? 2 : -1;
+							break;
+						case sf::Keyboard::Space:
+							pl2fire = (pl2fire == 1) ? 2 : -1;
+							break;
+						//---
+						default:
+							break;
+					}
+				}
+				//---
 			}
-			break;
-		case 1:
-			switch (dir) {
-				case UP:
-				case LEFT:
-					state = 0;
-					oldDir = RIGHT;
+			//---
+
+			tickInput stepInput = {{-1, -1}, {0, 0}, 0};
+			//Fire block just fires the bullet.
+			if ( fireWait >= FIRE_TICKS ) {
+				if ( pl1fire == 1 || pl1fire == 2 ) {
+					stepInput.fire[0] = 1;
+					pl1fire = (pl1fire == 1) ? 0 : -1;
+				}
+				if ( pl2fire == 1 || pl2fire == 2 ) {
+					stepInput.fire[1] = 1;
+					pl2fire = (pl2fire == 1) ? 0 : -1;
+				}
+				fireWait = 0;
+			}
+			if ( plWait >= WALK_TICKS ) {
+				stepInput.move[0] = pl1move;
+				stepInput.move[1] = pl2move;
+				plWait = 0;
+			}
+			tickAllocs.begin();
+			if ( runTick(stepInput) ) {
+				latency.presented(input.now());
+			}
+			tickAllocs.end();
+			if ( duration != 0 && tick >= duration ) {
+				window->close();
+			}
+		}
+		//---
+
+		//-> Score check, to decide whether a player is won or not.
+		int winner = -1;
+		for ( int i = 0 ; i < numPlayers && winner == -1 ; i++ ) {
+			if ( players[i].getScore() >= WIN_SCORE ) {
+				winner = i;
+			}
+		}
+		if ( winner != -1 ) {
+			//-> Winner text
+			text->setString("Player " + to_string(winner + 1) + " wins,\nstart over? (Y/N)");
+			text->setPosition((width - text->getLocalBounds().width)/2, (height - 2*text->getLocalBounds().height)/2);
+			showMessage = 1;
+			invalidate();
+			//---
+
+			//-> Until a player press y or n keys or until window is closed.
+			//   All queued events are read in every frame.
+			int answer = 0;
+			while ( window->isOpen() && answer == 0 ) {
+				update();
+				sf::sleep(sf::milliseconds(1)); //Message is not changed, frames after the first are skipped.
+				while (window->pollEvent(event)) {
+					if ( event.type == sf::Event::Closed ) {
+						window->close();
+					} else if ( event.type == sf::Event::LostFocus ) {
+						input.setFocused(0);
+					} else if ( event.type == sf::Event::GainedFocus ) {
+						input.setFocused(1);
+						needPresent = 1;
+					}
+				}
+				while ( answer == 0 && input.pop(key, input.now()) ) {
+					if ( key.pressed && key.key == sf::Keyboard::Y ) {
+						answer = 1;
+					} else if ( key.pressed && key.key == sf::Keyboard::N ) {
+						answer = -1;
+					}
+				}
+			}
+			//-> If y is pressed, then the match is reset in place with the next seed.
+			//   And also default variables are assigned to player variables and wait variables.
+			if ( answer == 1 ) {
+				pl1move = -1;
+				pl2move = -1;
+				pl1fire = -1;
+				pl2fire = -1;
+				plWait = 0;
+				fireWait = 0;
+				sf::Clock resetClock;
+				reset(rng.next()); //Whole frame is redrawn after it.
+				cout << "[INFO] Match is reset in " << resetClock.getElapsedTime().asMicroseconds() << " us." << endl;
+			//---
+			//-> Else close the window.
+			} else if ( answer == -1 ) {
+				window->close();
+			}
+			//---
+			//---
+		}
+		//---
+	}
+
+	input.stop();
+	latency.print();
+	cout << "[RENDER] " << presentedFrames << " frames presented, " << skippedFrames << " unchanged frames skipped, particles "
+		 << (presentedFrames ? CAST_FLOAT(particleTime) / presentedFrames : 0) << " us/frame." << endl;
+	governor.print();
+	if ( telemetry.isRunning() ) {
+		telemetry.stop();
+		telemetry.print();
+	}
+	if ( recorder.isRunning() ) {
+		recorder.stop();
+		recorder.print();
+	}
+	frameArena.print();
+	tickAllocs.print();
+	AllocTracker::report(0);
+}
+
+//-> Recording is played with the drawing of the game. Space pauses, Left and Right
+//   seek RECORD_SEEK_SECONDS, Up and Down double and halve the speed. Ticks are
+//   simulated from the keyframes, so a seek costs at most a block of ticks.
+void Game::runReplay(void)
+{
+	if ( headless ) {
+		cout << "[ERROR] Recordings are played in a window." << endl;
+		return;
+	}
+	RecordReader reader;
+	if ( !reader.open(replayPath) ) {
+		return;
+	}
+
+	initGameEnv();
+
+	const sf::Keyboard::Key keys[] = {sf::Keyboard::Up, sf::Keyboard::Down, sf::Keyboard::Right, sf::Keyboard::Left, sf::Keyboard::Space};
+	InputThread input;
+	inputEvent key;
+	input.start(keys, sizeof(keys) / sizeof(keys[0]));
+
+	sf::Event event;
+	unsigned int position = 0;
+	int speedShift = 0; //Speed is 2^speedShift.
+	bool paused = 0;
+	double due = 0; //Ticks to simulate, they are added by the passed time.
+	const unsigned int seekTicks = RECORD_SEEK_SECONDS * tickRate;
+	bool corrupted = !seekReplay(reader, position, 0);
+	sf::Clock clock;
+
+	while ( window->isOpen() && !corrupted ) {
+
+		frameArena.reset();
+
+		while (window->pollEvent(event)) {
+			if ( event.type == sf::Event::Closed ) {
+				window->close();
+			} else if ( event.type == sf::Event::LostFocus ) {
+				input.setFocused(0);
+			} else if ( event.type == sf::Event::GainedFocus ) {
+				input.setFocused(1);
+				needPresent = 1;
+			}
+		}
+
+		//-> Controls, the position is printed after every change.
+		bool changed = 0;
+		while ( input.pop(key, input.now()) && !corrupted ) {
+			if ( !key.pressed ) {
+				continue;
+			}
+			unsigned int target = position;
+			switch (key.key) {
+				case sf::Keyboard::Space:
+					paused = !paused;
 					break;
-				case DOWN:
-				case RIGHT:
-					state = 2;
-					oldDir = UP;
+				case sf::Keyboard::Up:
+					speedShift = min(speedShift + 1, RECORD_MAX_SPEED_SHIFT);
+					break;
+				case sf::Keyboard::Down:
+					speedShift = max(speedShift - 1, RECORD_MIN_SPEED_SHIFT);
+					break;
+				case sf::Keyboard::Right:
+					target = min(position + seekTicks, reader.getNumTicks());
+					break;
+				case sf::Keyboard::Left:
+					target = (position > seekTicks) ? position - seekTicks : 0;
 					break;
+				default:
+					break;
+			}
+			if ( target != position ) {
+				corrupted = !seekReplay(reader, position, target);
+			}
+			changed = 1;
+			due = 0;
+		}
+		if ( changed ) {
+			cout << "[REPLAY] " << CAST_FLOAT(position) / tickRate << " s of " << CAST_FLOAT(reader.getNumTicks()) / tickRate
+				 << " s, speed " << ldexp(1.0, speedShift) << "x" << (paused ? ", paused" : "") << "." << endl;
+		}
+		//---
+
+		//-> Ticks of the passed time are simulated. A slow frame does not pile up
+		//   more than a block of ticks.
+		double passed = clock.restart().asMicroseconds();
+		if ( !paused ) {
+			due = min(due + passed * tickRate * ldexp(1.0, speedShift) / 1000000, static_cast<double>(reader.getKeyframeTicks()));
+			while ( due >= 1 && position < reader.getNumTicks() && !corrupted ) {
+				corrupted = !stepReplay(reader, position);
+				due -= 1;
+			}
+		}
+		//---
+
+		update();
+		sf::sleep(sf::milliseconds(1));
+	}
+
+	input.stop();
+	cout << "[RENDER] " << presentedFrames << " frames presented, " << skippedFrames << " unchanged frames skipped." << endl;
+}
+
+//-> A block is started from its keyframe. It is the same state as the simulated
+//   one, unless the match is reset in the first tick of the block. A tick whose
+//   state does not have the recorded hash stops the replay, as a corrupted block.
+bool Game::stepReplay(RecordReader &reader, unsigned int &position)
+{
+	if ( position >= reader.getNumTicks() ) {
+		return 0;
+	}
+	if ( !reader.hasTick(position) ) {
+		if ( !reader.loadBlock(reader.findBlock(position)) ) {
+			return 0;
+		}
+		applyKeyframe(reader);
+	}
+	const recordInput &entry = reader.getInput(position);
+	if ( entry.hash != static_cast<sf::Uint32>(getHash()) ) {
+		cout << "[ERROR] Replay differs from the recorded game at tick " << position << "." << endl;
+		return 0;
+	}
+	step(entry.input);
+	position++;
+	return 1;
+}
+
+//-> A near tick ahead is reached by simulating, others from the keyframe of their block.
+bool Game::seekReplay(RecordReader &reader, unsigned int &position, const unsigned int &target)
+{
+	if ( reader.getBlock() < 0 || target < position || target - position >= reader.getKeyframeTicks() ) {
+		if ( !reader.loadBlock(reader.findBlock(target)) ) {
+			return 0;
+		}
+		applyKeyframe(reader);
+		position = reader.getBlockStart();
+	}
+	while ( position < target ) {
+		if ( !stepReplay(reader, position) ) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+//-> Obstacles are not in the keyframes, they are placed again if the keyframe is from another match.
+void Game::applyKeyframe(RecordReader &reader)
+{
+	if ( reader.getMatchSeed() != matchSeed ) {
+		reset(reader.getMatchSeed());
+	}
+	applySnapshot(reader.getKeyframe());
+	particles.clear();
+	invalidate();
+}
+//---
+
+bool Game::exportMap(void)
+{
+	initGameEnv();
+	sf::Clock clock;
+	bool saved = GameMap::save(exportPath, worldSize, barrels, sandbags, numBarrels, numSandbags, assets);
+	cout << "[INFO] Map of " << numBarrels + numSandbags << " obstacles is built in " << clock.getElapsedTime().asMicroseconds() / 1000.0 << " ms." << endl;
+	return saved;
+}
+
+//-> Ticks are simulated back to back, so the tick rate of the scenario is not
+//   used. Throughput and the scores are printed at the end.
+void Game::runHeadless(Game *const serial)
+{
+	if ( !headless || numHumans != 0 || duration == 0 ) {
+		cout << "[ERROR] This method should be run for headless scenarios with only bots and a duration." << endl;
+		return;
+	}
+
+	initGameEnv();
+	//-> Sight rays of this game are cast on the worker pool even for a few bots,
+	//   the serial copy casts them in the tick thread.
+	if ( serial != NULL ) {
+		serial->initGameEnv();
+		workers.start(max(2u, thread::hardware_concurrency()));
+		sightParallelMin = 1;
+	}
+	//---
+
+	TickAllocStats tickAllocs;
+	const tickInput idle = {{-1, -1}, {0, 0}, 0};
+	sf::Clock clock;
+	const bool timed = telemetry.isRunning(); //Ticks are timed only for the telemetry.
+	sf::Clock tickClock;
+	while ( tick < duration ) {
+		frameArena.reset();
+		tickAllocs.begin();
+		if ( timed ) {
+			tickClock.restart();
+		}
+		recordTick(idle);
+		if ( serial == NULL ) {
+			step(idle);
+		} else if ( !stepChecked(*serial, idle) ) {
+			cout << "[ERROR] Serial and parallel games differ after tick " << tick - 1 << "." << endl;
+			break;
+		}
+		if ( timed ) {
+			telemetry.record(TEL_TICK, 0, 0, 0, tickClock.getElapsedTime().asMicroseconds());
+		}
+		tickAllocs.end();
+	}
+	sf::Int64 time = clock.getElapsedTime().asMicroseconds();
+	if ( timed ) {
+		telemetry.stop();
+		telemetry.print();
+	}
+	if ( recorder.isRunning() ) {
+		recorder.stop();
+		recorder.print();
+	}
+
+	if ( serial != NULL && tick == duration ) {
+		cout << "[CHECK] Serial and parallel games are the same in " << duration << " ticks." << endl;
+	}
+	cout << "[HEADLESS] " << tick << " ticks in " << time / 1000.0 << " ms, "
+		 << (time > 0 ? tick * 1000000.0 / time : 0) << " ticks/s, ";
+	if ( bulletCollisions ) {
+		cout << cancelledBullets << " bullets cancelled, ";
+	}
+	cout << "scores:";
+	for ( int i = 0 ; i < numPlayers ; i++ ) {
+		cout << " " << players[i].getScore();
+	}
+	cout << endl;
+	frameArena.print();
+	tickAllocs.print();
+	AllocTracker::report(0);
+}
+//---
+
+//////////////////////////////////// Definitions of RollbackSession Class
+RollbackSession::RollbackSession() :	game(NULL),
+										localPlayer(0),
+										currentTick(0),
+										confirmedTick(0),
+										states(NULL),
+										rollbackFrom(0),
+										rollbacks(0),
+										resimulatedTicks(0) {}
+
+RollbackSession::~RollbackSession() { delete [] states; }
+
+//-> States are allocated once here, saving a tick copies the world into them.
+void RollbackSession::init(Game *const game, const int &localPlayer)
+{
+	AllocScope scope(TAG_ROLLBACK);
+	this->game = game;
+	this->localPlayer = localPlayer;
+	if ( states == NULL ) {
+		states = new worldSnapshot[ROLLBACK_MAX_FRAMES + 1];
+	}
+	game->captureSnapshot(states[0]);
+	currentTick = states[0].tick;
+	confirmedTick = currentTick;
+	rollbackFrom = currentTick;
+	rollbacks = 0;
+	resimulatedTicks = 0;
+	lastRemote.move[0] = lastRemote.move[1] = -1;
+	lastRemote.fire[0] = lastRemote.fire[1] = 0;
+	lastRemote.capBullets = 0;
+}
+//---
+
+//-> Remote part of the input is the received one if it is known. Otherwise
+//   last known movement is repeated, fire is not predicted because a fire is a
+//   single key press. Bullet cap is given by player 0, a known one is repeated.
+void RollbackSession::predict(tickInput &input, const unsigned int &tick)
+{
+	int remote = 1 - localPlayer;
+	const tickInput &known = (tick < confirmedTick) ? remoteInputs[tick % (2 * (ROLLBACK_MAX_FRAMES + 1))] : lastRemote;
+	input.move[remote] = known.move[remote];
+	input.fire[remote] = (tick < confirmedTick) ? known.fire[remote] : 0;
+	if ( remote == 0 ) {
+		input.capBullets = known.capBullets;
+	}
+}
+//---
+
+bool RollbackSession::advance(const tickInput &local)
+{
+	resimulate();
+	if ( currentTick - confirmedTick >= ROLLBACK_MAX_FRAMES ) {
+		return 0;
+	}
+	int slot = currentTick % (ROLLBACK_MAX_FRAMES + 1);
+	game->captureSnapshot(states[slot]);
+	tickInput &input = inputs[slot];
+	input.move[localPlayer] = local.move[localPlayer];
+	input.fire[localPlayer] = local.fire[localPlayer];
+	if ( localPlayer == 0 ) {
+		input.capBullets = local.capBullets;
+	}
+	predict(input, currentTick);
+	game->step(input);
+	currentTick++;
+	rollbackFrom = currentTick;
+	return 1;
+}
+
+//-> If the received input is different from the one used in the simulation,
+//   the tick is marked for re-simulation.
+bool RollbackSession::addRemoteInput(const unsigned int &tick, const tickInput &remote)
+{
+	if ( tick != confirmedTick || tick >= currentTick + ROLLBACK_MAX_FRAMES ) {
+		return 0;
+	}
+	int r = 1 - localPlayer;
+	remoteInputs[tick % (2 * (ROLLBACK_MAX_FRAMES + 1))] = remote;
+	lastRemote = remote;
+	confirmedTick++;
+	if ( tick < currentTick ) {
+		const tickInput &used = inputs[tick % (ROLLBACK_MAX_FRAMES + 1)];
+		const bool capChanged = (r == 0 && used.capBullets != remote.capBullets);
+		if ( (used.move[r] != remote.move[r] || used.fire[r] != remote.fire[r] || capChanged) && tick < rollbackFrom ) {
+			rollbackFrom = tick;
+		}
+	}
+	return 1;
+}
+//---
+
+//-> World is restored to the first mispredicted tick and all ticks after it are
+//   simulated again with the corrected inputs. States are saved again while simulating.
+void RollbackSession::resimulate(void)
+{
+	if ( rollbackFrom >= currentTick ) {
+		return;
+	}
+	rollbacks++;
+	game->applySnapshot(states[rollbackFrom % (ROLLBACK_MAX_FRAMES + 1)]);
+	for ( unsigned int t = rollbackFrom ; t < currentTick ; t++ ) {
+		int slot = t % (ROLLBACK_MAX_FRAMES + 1);
+		if ( t != rollbackFrom ) {
+			game->captureSnapshot(states[slot]);
+		}
+		predict(inputs[slot], t);
+		game->step(inputs[slot]);
+		resimulatedTicks++;
+	}
+	rollbackFrom = currentTick;
+}
+//---
+
+inline unsigned int RollbackSession::getTick(void) { return currentTick; }
+
+inline unsigned int RollbackSession::getRollbacks(void) { return rollbacks; }
+
+inline unsigned int RollbackSession::getResimulatedTicks(void) { return resimulatedTicks; }
+
+//-> Exact comparison of two worlds, used to check determinism.
+bool equalSnapshots(const worldSnapshot &a, const worldSnapshot &b)
+{
+	if ( a.tick != b.tick || a.rngState != b.rngState || a.nextBulletId != b.nextBulletId ||
+		 a.np != b.np || a.nb != b.nb || a.nbul != b.nbul ||
+		 memcmp(a.barrelVisible, b.barrelVisible, sizeof(a.barrelVisible)) != 0 ) {
+		return 0;
+	}
+	for ( int i = 0 ; i < a.np ; i++ ) {
+		const playerSnap &p = a.players[i], &q = b.players[i];
+		if ( p.pos != q.pos || p.state != q.state || p.s != q.s || p.oldDir != q.oldDir || p.score != q.score || p.deaths != q.deaths ) {
+			return 0;
+		}
+	}
+	for ( int i = 0 ; i < a.nbul ; i++ ) {
+		const bulletSnap &p = a.bullets[i], &q = b.bullets[i];
+		if ( p.id != q.id || p.owner != q.owner || p.dir != q.dir || p.speed != q.speed ||
+			 p.age != q.age || p.spawnPos != q.spawnPos ) {
+			return 0;
+		}
+	}
+	return 1;
+}
+//---
+
+
+//////////////////////////////////// Benchmarks
+int runBenchmark(const string &name)
+{
+	if ( name == "snapshot" ) {
+		return benchSnapshot();
+	}
+	if ( name == "rollback" ) {
+		return benchRollback();
+	}
+	if ( name == "assets" ) {
+		return benchAssets();
+	}
+	if ( name == "alloc" ) {
+		return benchAlloc();
+	}
+	if ( name == "render" ) {
+		return benchRender();
+	}
+	if ( name == "broadphase" ) {
+		return benchBroadphase();
+	}
+	if ( name == "map" ) {
+		return benchMap();
+	}
+	if ( name == "bullets" ) {
+		return benchBullets();
+	}
+	if ( name == "particles" ) {
+		return benchParticles();
+	}
+	if ( name == "raycast" ) {
+		return benchRaycast();
+	}
+	if ( name == "reset" ) {
+		return benchReset();
+	}
+	if ( name == "governor" ) {
+		return benchGovernor();
+	}
+	if ( name == "telemetry" ) {
+		return benchTelemetry();
+	}
+	if ( name == "replay" ) {
+		return benchReplay();
+	}
+	if ( name == "scripts" ) {
+		return benchScripts();
+	}
+	if ( name == "interest" ) {
+		return benchInterest();
+	}
+	if ( name == "hash" ) {
+		return benchHash();
+	}
+	if ( name == "fixed" ) {
+		return benchFixed();
+	}
+	cout << "[ERROR] Unknown benchmark: " << name << endl;
+	return 1;
+}
+
+//-> Synthetic 2 player match: soldiers walk and fire, bullets fly until they leave the
+//   window or hit something. Every tick the world is encoded against the snapshot acknowledged
+//   "ackLag" ticks ago and decoded by the receiver. Decoded world is compared with the sender's.
+int benchSnapshot(void)
+{
+	const int numTicks = 200000;
+	const int ackLag = 3;
+	const int w = 1024, h = 746;
+	static worldSnapshot sent[ackLag + 1];
+	static worldSnapshot received[ackLag + 1];
+	unsigned char packet[4096];
+	unsigned char fullPacket[4096];
+	unsigned long long deltaBytes = 0, fullBytes = 0, encodeNs = 0, decodeNs = 0;
+	int errors = 0;
+	unsigned int nextId = 0;
+
+	srand(1);
+	worldSnapshot *cur = &sent[0];
+	*cur = worldSnapshot();
+	cur->np = 2;
+	cur->nb = 5;
+	cur->barrelVisible[0] = 0x1f;
+	for ( int i = 0 ; i < cur->np ; i++ ) {
+		cur->players[i].pos = sf::Vector2f(rand() % w, rand() % h);
+		cur->players[i].oldDir = -1;
+	}
+	received[0] = *cur;
+
+	for ( int t = 1 ; t <= numTicks ; t++ ) {
+		worldSnapshot *prev = &sent[(t - 1) % (ackLag + 1)];
+		cur = &sent[t % (ackLag + 1)];
+		*cur = *prev;
+		cur->tick = t;
+		//-> Simulation of the world. Bullets move once in a tick, then soldiers walk and fire.
+		int alive = 0;
+		for ( int i = 0 ; i < cur->nbul ; i++ ) {
+			bulletSnap b = cur->bullets[i];
+			b.age++;
+			sf::Vector2f pos = SnapshotCodec::bulletPosition(b);
+			if ( pos.x < 0 || pos.y < 0 || pos.x > w || pos.y > h ) {
+				continue;
 			}
-			break;
-		case 2:
-			switch (dir) {
-				case UP:
-					state = 1;
-					break;
-				case DOWN:
-					s = 1;
-					state = 3;
-					break;
-				case LEFT:
-					if ( oldDir == UP ) {
-						state = 1;
-					} else if ( oldDir == DOWN ) {
-						s = 1;
-						state = 3;
-					}
-					break;
-				case RIGHT:
-					if ( s == 0 ) {
-						s = 1;
-						state = 10;
-						velocityVector.x += speed;
-						velocityVector.y += 0;
-					} else if ( s == 1 ) {
-						s = 0;
-						state = 9;
-						velocityVector.x += speed;
-						velocityVector.y += 0;
-					}
-					break;
+			if ( rand() % 200 == 0 ) { //Hit
+				cur->players[b.owner].score++;
+				cur->players[(b.owner + 1) % cur->np].deaths++;
+				int barrel = rand() % cur->nb;
+				cur->barrelVisible[barrel >> 3] &= ~(1 << (barrel & 7));
+				continue;
 			}
-			break;
-		case 3:
-			switch (dir) {
-				case UP:
-				case RIGHT:
-					state = 2;
-					oldDir = DOWN;
-					break;
-				case DOWN:
-					velocityVector.x += 0;
-					velocityVector.y += speed;
-				case LEFT:
-					state = 4;
-					oldDir = RIGHT;
-					break;
+			cur->bullets[alive++] = b;
+		}
+		cur->nbul = alive;
+		for ( int i = 0 ; i < cur->np ; i++ ) {
+			playerSnap &p = cur->players[i];
+			if ( rand() % 3 == 0 ) {
+				p.state = rand() % 14;
+				p.s = rand() % 2;
+				p.pos.x += (rand() % 3 - 1) * 18;
+				p.pos.y += (rand() % 3 - 1) * 18;
 			}
-			break;
-		case 4:
-			switch (dir) {
-				case RIGHT:
-					state = 3;
-					s = 1;
-					break;
-				case LEFT:
-					state = 5;
-					break;
-				case UP:
-					if ( oldDir == RIGHT ) {
-						state = 3;
-						s = 1;
-					} else if ( oldDir == LEFT ) {
-						state = 5;
-					}
-					break;
-				case DOWN:
-					if ( s == 0 ) {
-						state = 3;
-						s = 1;
-						velocityVector.x += 0;
-						velocityVector.y += speed;
-					} else if ( s == 1 ) {
-						state = 11;
-						s = 0;
-						velocityVector.x += 0;
-						velocityVector.y += speed;
-					}
-					break;
+			if ( rand() % 500 == 0 ) { //Reborn
+				p.pos = sf::Vector2f(rand() % w, rand() % h);
 			}
-			break;
-		case 5:
-			switch (dir) {
-				case UP:
-				case LEFT:
-					state = 6;
-					oldDir = DOWN;
-					break;
-				case DOWN:
-				case RIGHT:
-					state = 4;
-					oldDir = LEFT;
-					break;
+			if ( rand() % 20 == 0 && cur->nbul < SNAP_MAX_BULLETS ) {
+				bulletSnap &b = cur->bullets[cur->nbul++];
+				b.id = nextId++;
+				b.owner = i;
+				b.dir = static_cast<Direction>(rand() % 4);
+				b.speed = 18;
+				b.age = 0;
+				b.spawnPos = p.pos;
 			}
-			break;
-		case 6:
-			switch (dir) {
-				case UP:
-					state = 7;
-					s = 1;
-					break;
-				case DOWN:
-					state = 5;
-					break;
-				case RIGHT:
-					if ( oldDir == DOWN ) {
-						state = 5;
-					} else if ( oldDir == UP ) {
-						state = 7;
-						s = 1;
-					}
-					break;
-				case LEFT:
-					if ( s == 0 ) {
-						state = 13;
-						s = 1;
-						velocityVector.x += -1 * speed;
-						velocityVector.y += 0;
-					} else if ( s == 1 ) {
-						state = 12;
-						s = 0;
-						velocityVector.x += -1 * speed;
-						velocityVector.y += 0;
-					}
-					break;
+		}
+		//---
+
+		const worldSnapshot *sentBase = t > ackLag ? &sent[(t - ackLag) % (ackLag + 1)] : &sent[0];
+		const worldSnapshot *receivedBase = t > ackLag ? &received[(t - ackLag) % (ackLag + 1)] : &received[0];
+		if ( t <= ackLag ) {
+			sentBase = NULL;
+			receivedBase = NULL;
+		}
+		worldSnapshot &out = received[t % (ackLag + 1)];
+
+		auto start = chrono::steady_clock::now();
+		unsigned int size = SnapshotCodec::encode(*cur, sentBase, packet, sizeof(packet));
+		auto mid = chrono::steady_clock::now();
+		bool decoded = SnapshotCodec::decode(packet, size, receivedBase, out);
+		auto end = chrono::steady_clock::now();
+		encodeNs += chrono::duration_cast<chrono::nanoseconds>(mid - start).count();
+		decodeNs += chrono::duration_cast<chrono::nanoseconds>(end - mid).count();
+		deltaBytes += size;
+		fullBytes += SnapshotCodec::encode(*cur, NULL, fullPacket, sizeof(fullPacket));
+
+		//-> Receiver should see the quantized world of the sender.
+		if ( !decoded || out.nbul != cur->nbul || memcmp(out.barrelVisible, cur->barrelVisible, sizeof(out.barrelVisible)) != 0 ) {
+			errors++;
+			continue;
+		}
+		for ( int i = 0 ; i < cur->np ; i++ ) {
+			if ( fabs(out.players[i].pos.x - cur->players[i].pos.x) > 0.5f / SNAP_POS_SCALE ||
+				 fabs(out.players[i].pos.y - cur->players[i].pos.y) > 0.5f / SNAP_POS_SCALE ||
+				 out.players[i].state != cur->players[i].state ||
+				 out.players[i].score != cur->players[i].score || out.players[i].deaths != cur->players[i].deaths ) {
+				errors++;
 			}
-			break;
-		case 7:
-			switch (dir) {
-				case UP:
-					velocityVector.x += 0;
-					velocityVector.y += -1 * speed;
-				case RIGHT:
-					state = 0;
-					oldDir = LEFT;
-					break;
-				case DOWN:
-				case LEFT:
-					state = 6;
-					oldDir = UP;
-					break;
+		}
+		for ( int i = 0 ; i < cur->nbul ; i++ ) {
+			if ( out.bullets[i].id != cur->bullets[i].id || out.bullets[i].age != cur->bullets[i].age ) {
+				errors++;
 			}
-			break;
-		case 8:
-			velocityVector.x += 0;
-			velocityVector.y += -1 * speed;
-			state = 0;
-			break;
-		case 9:
-			velocityVector.x += speed;
-			velocityVector.y += 0;
-			state = 2;
-			break;
-		case 10:
-			velocityVector.x += speed;
-			velocityVector.y += 0;
-			state = 2;
-			break;
-		case 11:
-			velocityVector.x += 0;
-			velocityVector.y += speed;
-			state = 4;
-			break;
-		case 12:
-			velocityVector.x += -1 * speed;
-			velocityVector.y += 0;
-			state = 6;
-			break;
-		case 13:
-			velocityVector.x += -1 * speed;
-			velocityVector.y += 0;
-			state = 6;
-			break;
-		default:
-			break;
+		}
+		//---
+	}
+
+	cout << "[BENCH] snapshot: ticks=" << numTicks
+		 << " delta=" << CAST_FLOAT(deltaBytes) / numTicks << " bytes/tick"
+		 << " full=" << CAST_FLOAT(fullBytes) / numTicks << " bytes/tick"
+		 << " encode=" << CAST_FLOAT(encodeNs) / numTicks / 1000 << " us/tick"
+		 << " decode=" << CAST_FLOAT(decodeNs) / numTicks / 1000 << " us/tick"
+		 << " errors=" << errors << endl;
+	return errors != 0;
+}
+//---
+
+//-> np is the number of keyboard players, 0 to 2 as in a validated scenario.
+//   Benchmarks which need more players add bots.
+scenario benchScenario(const int &w, const int &h, const int &nb, const int &ns, const int &np)
+{
+	scenario config;
+	ScenarioLoader::setDefaults(config);
+	config.width = w;
+	config.height = h;
+	config.numBarrels = nb;
+	config.numSandbags = ns;
+	config.numHumans = np;
+	config.seed = 1;
+	return config;
+}
+//---
+
+//-> Inputs of a 2 player match with the cadence of run2player: fire every 4 ticks
+//   and walk every 12 ticks. Same seed gives same inputs.
+static tickInput benchInput(Random &rng, const unsigned int &tick)
+{
+	tickInput input = {{-1, -1}, {0, 0}, 0};
+	for ( int i = 0 ; i < 2 ; i++ ) {
+		unsigned int r = rng.next();
+		if ( tick % 4 == 0 && r % 3 == 0 ) {
+			input.fire[i] = 1;
+		}
+		if ( tick % 12 == 0 && (r >> 8) % 4 != 0 ) {
+			input.move[i] = (r >> 16) % 4;
+		}
+	}
+	return input;
+}
+//---
+
+//-> The game is run once with all inputs known, then same match is run with a
+//   rollback session where remote inputs arrive "delay" ticks late. Both runs
+//   should end in the same world. Save/restore of the world and the re-simulation
+//   speed are measured.
+int benchRollback(void)
+{
+	const unsigned int numTicks = 20000;
+	const unsigned int delay = 5;
+	const int repeat = 10000;
+	static worldSnapshot start, saved, direct, rolled;
+
+	Game game(benchScenario(1024, 746, 5, 5, 2));
+	game.rng.seed(1);
+	game.initGameEnv();
+	game.captureSnapshot(start);
+
+	//-> Direct run, every input is known.
+	Random inputRng;
+	inputRng.seed(2);
+	auto t0 = chrono::steady_clock::now();
+	for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+		game.step(benchInput(inputRng, t));
 	}
+	auto t1 = chrono::steady_clock::now();
+	game.captureSnapshot(direct);
 	//---
 
-	sf::Vector2f newPos = getPosition() + velocityVector;
-	sf::Vector2u curSize = getSize();
-	//-> Collision check of the given soldier with barrels sandbags and other soldier(s).
-	for ( int i = 0 ; i < nb ; i++ ) {
-		if ( barrels[i].getVisible() == 0 ) {
-			continue;
+	//-> Save and restore cost, world is full of bullets.
+	for ( unsigned int t = 0 ; t < 64 ; t++ ) {
+		tickInput input = {{-1, -1}, {1, 1}, 0};
+		game.step(input);
+	}
+	game.captureSnapshot(saved);
+	auto t2 = chrono::steady_clock::now();
+	for ( int i = 0 ; i < repeat ; i++ ) {
+		game.captureSnapshot(saved);
+	}
+	auto t3 = chrono::steady_clock::now();
+	for ( int i = 0 ; i < repeat ; i++ ) {
+		game.applySnapshot(saved);
+	}
+	auto t4 = chrono::steady_clock::now();
+	//---
+
+	//-> Rollback run, local player is 0 and inputs of player 1 are late.
+	game.applySnapshot(start);
+	inputRng.seed(2);
+	tickInput *allInputs = new tickInput[numTicks];
+	for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+		allInputs[t] = benchInput(inputRng, t);
+	}
+	RollbackSession session;
+	session.init(&game, 0);
+	unsigned int delivered = 0;
+	auto t5 = chrono::steady_clock::now();
+	for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+		while ( !session.advance(allInputs[t]) ) {
+			session.addRemoteInput(start.tick + delivered, allInputs[delivered]);
+			delivered++;
 		}
-		if ( isCollide(newPos, curSize, barrels[i].getPosition(), barrels[i].getSize()) ) {
-			return;
-		} else {
-			continue;
+		while ( delivered + delay <= t ) {
+			session.addRemoteInput(start.tick + delivered, allInputs[delivered]);
+			delivered++;
 		}
 	}
-	
-	for ( int i = 0 ; i < ns ; i++ ) {
-		if ( isCollide(newPos, curSize, sandbags[i].getPosition(), sandbags[i].getSize()) ) {
-			return;
-		} else {
-			continue;
+	while ( delivered < numTicks ) {
+		session.addRemoteInput(start.tick + delivered, allInputs[delivered]);
+		delivered++;
+	}
+	session.resimulate();
+	auto t6 = chrono::steady_clock::now();
+	game.captureSnapshot(rolled);
+	delete [] allInputs;
+	//---
+
+	double stepUs = chrono::duration_cast<chrono::nanoseconds>(t1 - t0).count() / 1000.0 / numTicks;
+	double saveUs = chrono::duration_cast<chrono::nanoseconds>(t3 - t2).count() / 1000.0 / repeat;
+	double restoreUs = chrono::duration_cast<chrono::nanoseconds>(t4 - t3).count() / 1000.0 / repeat;
+	double sessionUs = chrono::duration_cast<chrono::nanoseconds>(t6 - t5).count() / 1000.0;
+	unsigned int simulated = numTicks + session.getResimulatedTicks();
+	bool same = equalSnapshots(direct, rolled);
+	cout << "[BENCH] rollback: bullets=" << saved.nbul
+		 << " save=" << saveUs << " us"
+		 << " restore=" << restoreUs << " us"
+		 << " step=" << stepUs << " us/tick" << endl;
+	cout << "[BENCH] rollback: ticks=" << numTicks << " delay=" << delay
+		 << " rollbacks=" << session.getRollbacks()
+		 << " resimulated=" << session.getResimulatedTicks()
+		 << " throughput=" << simulated / sessionUs * 1e6 << " ticks/s"
+		 << " deterministic=" << (same ? "yes" : "NO") << endl;
+	return same ? 0 : 1;
+}
+//---
+
+//-> Loads the assets from the loose files and from the archive. Each path is
+//   loaded "repeat" times, time of the first load and the average time are
+//   reported with the resident memory after the first load. Archive is packed
+//   first if it does not exist.
+int benchAssets(void)
+{
+	const int repeat = 10;
+	ifstream archive(ASSET_ARCHIVE_PATH);
+	if ( !archive && !AssetStore::pack("textures/", "./font.ttf", ASSET_ARCHIVE_PATH) ) {
+		return 1;
+	}
+	for ( int path = 0 ; path < 2 ; path++ ) {
+		long residentBefore = residentKB();
+		double firstMs = 0, totalMs = 0;
+		long residentAfter = 0;
+		for ( int i = 0 ; i < repeat ; i++ ) {
+			AssetStore *store = new AssetStore;
+			sf::Clock clock;
+			bool loaded = (path == 0) ? store->loadFiles("textures/", "./font.ttf") : store->loadArchive(ASSET_ARCHIVE_PATH);
+			double ms = clock.getElapsedTime().asMicroseconds() / 1000.0;
+			if ( !loaded ) {
+				delete store;
+				return 1;
+			}
+			if ( i == 0 ) {
+				firstMs = ms;
+				residentAfter = residentKB();
+			}
+			totalMs += ms;
+			delete store;
 		}
+		cout << "[BENCH] assets: " << (path == 0 ? "loose files" : "archive")
+			 << " first=" << firstMs << " ms avg=" << totalMs / repeat << " ms"
+			 << " resident=+" << residentAfter - residentBefore << " KB" << endl;
+	}
+	return 0;
+}
+//---
+
+//-> Steady-state ticks (simulation and rendering) should not allocate. After a
+//   warmup, every allocation in a tick is a regression and the benchmark fails.
+int benchAlloc(void)
+{
+	const unsigned int warmupTicks = 600;
+	const unsigned int numTicks = 20000;
+	if ( !AllocTracker::enabled() ) {
+		cout << "[ERROR] Allocation tracking is disabled, build with \"make ALLOC_TRACKING=1\"." << endl;
+		return 1;
+	}
+	Game game(benchScenario(1024, 746, 5, 5, 2));
+	game.rng.seed(1);
+	game.initGameEnv();
+	Random inputRng;
+	inputRng.seed(3);
+	for ( unsigned int t = 0 ; t < warmupTicks ; t++ ) {
+		game.step(benchInput(inputRng, t));
+		game.update();
 	}
+	TickAllocStats stats;
+	for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+		stats.begin();
+		game.step(benchInput(inputRng, warmupTicks + t));
+		game.update();
+		stats.end();
+	}
+	stats.print();
+	game.frameArena.print();
+	unsigned long long before = AllocTracker::getAllocations();
+	game.reset(7);
+	unsigned long long resetAllocs = AllocTracker::getAllocations() - before;
+	AllocTracker::report(0);
+	cout << "[BENCH] alloc: allocating ticks=" << stats.getAllocatingTicks() << ", allocations of a reset=" << resetAllocs << endl;
+	return stats.getAllocatingTicks() != 0 || resetAllocs != 0;
+}
+//---
 
-	for ( int i = 0 ; i < np ; i++ ) {
-		if ( (players+i) == this ) { //To prevent check of same soldier.
-			continue;
+//-> Presented frames and redrawn area while players are active and while
+//   nobody plays. An idle game must not present frames after its bullets are gone.
+int benchRender(void)
+{
+	const unsigned int numTicks = 5000;
+	Game game(benchScenario(1024, 746, 5, 5, 2));
+	game.rng.seed(1);
+	game.initGameEnv();
+	Random inputRng;
+	inputRng.seed(3);
+	int fail = 0;
+	for ( int phase = 0 ; phase < 2 ; phase++ ) {
+		unsigned int presented = game.presentedFrames, skipped = game.skippedFrames;
+		double area = game.redrawnArea;
+		sf::Clock clock;
+		for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+			tickInput idle = {{-1, -1}, {0, 0}, 0};
+			game.step(phase == 0 ? benchInput(inputRng, t) : idle);
+			game.update();
 		}
-		if ( isCollide(newPos, curSize, players[i].getPosition(), players[i].getSize()) ) {
-			return;
-		} else {
-			continue;
+		double us = clock.getElapsedTime().asMicroseconds() / CAST_FLOAT(numTicks);
+		presented = game.presentedFrames - presented;
+		skipped = game.skippedFrames - skipped;
+		area = game.redrawnArea - area;
+		cout << "[BENCH] render " << (phase == 0 ? "active" : "idle") << ": presented=" << presented
+			 << " skipped=" << skipped << " redrawn=" << (presented ? 100 * area / presented : 0)
+			 << "% of frame, " << us << " us/tick" << endl;
+		if ( phase == 1 && skipped < numTicks / 2 ) {
+			cout << "[ERROR] Idle frames are presented." << endl;
+			fail = 1;
+		}
+	}
+	return fail;
+}
+//---
+
+//-> Dense scene, every player walks and fires. Actions of the players are recorded
+//   first, then the same scene is played with brute force and with sweep. Players
+//   are bots, so step() adds their own actions. Both should end in the same world,
+//   step() time is compared.
+int benchBroadphase(void)
+{
+	const unsigned int numTicks = 2000;
+	const int np = 16, nb = 12, ns = 12;
+	vector<signed char> moves(numTicks * np);
+	vector<unsigned char> fires(numTicks * np);
+	Random sceneRng;
+	sceneRng.seed(11);
+	for ( unsigned int i = 0 ; i < numTicks * np ; i++ ) {
+		moves[i] = (sceneRng.next() % 3 == 0) ? -1 : static_cast<signed char>(sceneRng.next() % 4);
+		fires[i] = (sceneRng.next() % 2 == 0);
+	}
+	worldSnapshot *results = new worldSnapshot[2];
+	double us[2];
+	for ( int mode = 0 ; mode < 2 ; mode++ ) {
+		scenario config = benchScenario(1600, 1200, nb, ns, 0);
+		config.numBots = np;
+		Game game(config);
+		game.rng.seed(1);
+		game.initGameEnv();
+		game.setCollisionMode(mode == 0 ? COLLIDE_BRUTE : COLLIDE_SWEEP);
+		const tickInput idle = {{-1, -1}, {0, 0}, 0};
+		unsigned long long bulletTicks = 0;
+		sf::Int64 time = 0;
+		for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+			for ( int p = 0 ; p < np ; p++ ) {
+				if ( moves[t * np + p] != -1 ) {
+					game.players[p].walk(18, static_cast<Direction>(moves[t * np + p]), game.players, game.barrels, game.sandbags, np, nb, ns);
+				}
+				if ( fires[t * np + p] ) {
+					game.players[p].fire(game.bullets + p, 18);
+				}
+			}
+			game.frameArena.reset();
+			sf::Clock clock;
+			game.step(idle);
+			time += clock.getElapsedTime().asMicroseconds();
+			for ( int p = 0 ; p < np ; p++ ) {
+				for ( Bullet *temp = game.bullets[p].getHead() ; temp != NULL ; temp = temp->next ) {
+					bulletTicks++;
+				}
+			}
 		}
+		game.captureSnapshot(results[mode]);
+		us[mode] = CAST_FLOAT(time) / numTicks;
+		cout << "[BENCH] broadphase " << (mode == 0 ? "brute" : "sweep") << ": " << us[mode] << " us/tick, "
+			 << CAST_FLOAT(bulletTicks) / numTicks << " bullets/tick";
+		if ( mode == 1 ) {
+			cout << ", " << CAST_FLOAT(game.broadPhase.getMoves()) / numTicks << " sort moves/tick";
+		}
+		cout << endl;
 	}
-	//---
-
-	//-> This if block prevent the soldier from go beyond the window limit.
-	if ( (newPos.x >= -(CAST_FLOAT(curSize.x)/2)) && //Left window limit
-		 (newPos.y >= -(CAST_FLOAT(curSize.y)/2)) && //Up window limit
-		 (newPos.x < window->getSize().x - (curSize.x)) && //Right window limit
-		 (newPos.y < window->getSize().y - (curSize.y)) // Bottom window limit
-		 ) {
-		sprite.move(velocityVector); //If there is no collision then soldier will move
-	}
-	//---
+	bool same = equalSnapshots(results[0], results[1]);
+	delete [] results;
+	cout << "[BENCH] broadphase: speedup=" << us[0] / us[1] << " same=" << (same ? "yes" : "no") << endl;
+	return same ? 0 : 1;
 }
+//---
 
-inline sf::Vector2u Player::getSize()
+//-> A 10k obstacle arena is placed randomly and exported, then it is loaded
+//   from the map file. Both games should have the same obstacles. Bots play
+//   in both arenas, without and with the spatial index of the map.
+int benchMap(void)
 {
-	sf::Vector2u size = textures[state].getSize();
-	size.x -= xy_offset.x;
-	size.y -= xy_offset.y;
-	return size;
+	const char *const path = "bench.map";
+	const unsigned int numTicks = 500;
+	scenario config = benchScenario(20000, 20000, 200, 9800, 0);
+	config.numBots = 16;
+	config.headless = 1;
+	Game *games[2];
+	double initMs[2], tickUs[2];
+	for ( int i = 0 ; i < 2 ; i++ ) {
+		config.mapPath = (i == 0) ? "" : path;
+		games[i] = new Game(config);
+		sf::Clock clock;
+		games[i]->initGameEnv();
+		initMs[i] = clock.getElapsedTime().asMicroseconds() / 1000.0;
+		if ( i == 0 && !GameMap::save(path, games[0]->worldSize, games[0]->barrels, games[0]->sandbags, games[0]->numBarrels, games[0]->numSandbags, games[0]->assets) ) {
+			delete games[0];
+			return 1;
+		}
+	}
+	sf::Clock loadClock;
+	GameMap loaded;
+	loaded.load(path);
+	double loadMs = loadClock.getElapsedTime().asMicroseconds() / 1000.0;
+	bool same = (games[1]->numBarrels == games[0]->numBarrels && games[1]->numSandbags == games[0]->numSandbags);
+	for ( int i = 0 ; i < games[0]->numBarrels && same ; i++ ) {
+		same = (games[0]->barrels[i].getPosition() == games[1]->barrels[i].getPosition());
+	}
+	for ( int i = 0 ; i < games[0]->numSandbags && same ; i++ ) {
+		same = (games[0]->sandbags[i].getPosition() == games[1]->sandbags[i].getPosition());
+	}
+	const tickInput idle = {{-1, -1}, {0, 0}, 0};
+	for ( int i = 0 ; i < 2 ; i++ ) {
+		sf::Clock clock;
+		for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+			games[i]->frameArena.reset();
+			games[i]->step(idle);
+		}
+		tickUs[i] = CAST_FLOAT(clock.getElapsedTime().asMicroseconds()) / numTicks;
+		delete games[i];
+	}
+	unlink(path);
+	cout << "[BENCH] map: random placement=" << initMs[0] << " ms, map load=" << loadMs << " ms, game init from map=" << initMs[1] << " ms" << endl;
+	cout << "[BENCH] map: step without index=" << tickUs[0] << " us/tick, with index=" << tickUs[1] << " us/tick, same=" << (same ? "yes" : "no") << endl;
+	return same ? 0 : 1;
 }
+//---
 
-inline void Player::paint() //Set state texture and paint user.
+//-> 16 players fire in every tick and walk randomly in an open arena. Before
+//   every tick the bullets which touch an opposing bullet are counted by testing
+//   all pairs, then the grid pass removes them. Counts should be the same.
+int benchBullets(void)
 {
-	sprite.setTexture(textures[state]);
-	window->draw(sprite);
-}
+	const unsigned int numTicks = 1000;
+	const int np = 16;
+	scenario config = benchScenario(4000, 3000, 0, 0, 0);
+	config.numBots = np;
+	config.headless = 1;
+	Game game(config);
+	game.initGameEnv();
+	Random moveRng;
+	moveRng.seed(5);
+	const tickInput idle = {{-1, -1}, {0, 0}, 0};
+	vector<Bullet *> live;
+	vector<int> owners;
+	vector<char> touched;
+	unsigned long long numBullets = 0, removed = 0;
+	sf::Int64 naiveTime = 0, gridTime = 0;
+	bool same = 1;
+	for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+		for ( int p = 0 ; p < np ; p++ ) {
+			game.players[p].fire(game.bullets + p, 18);
+			if ( moveRng.next() % 2 ) {
+				game.players[p].walk(18, static_cast<Direction>(moveRng.next() % 4), game.players, game.barrels, game.sandbags, np, 0, 0);
+			}
+		}
+		live.clear();
+		owners.clear();
+		for ( int p = 0 ; p < np ; p++ ) {
+			for ( Bullet *temp = game.bullets[p].getHead() ; temp != NULL ; temp = temp->next ) {
+				live.push_back(temp);
+				owners.push_back(p);
+			}
+		}
+		numBullets += live.size();
 
-//////////////////////////////////// Definitions of Game Class
-Game::Game(	const float &speed,
-			const int &w,
-			const int &h,
-			const int &nb,
-			const int &ns,
-			const int &np)	:	speed(speed),
-								numBarrels(nb),
-								numSandbags(ns),
-								numPlayers(np),
-								width(w),
-								height(h)
-{
-srand(time(NULL)); //Seed the random number generator.
-}
+		sf::Clock naiveClock;
+		touched.assign(live.size(), 0);
+		for ( size_t i = 0 ; i < live.size() ; i++ ) {
+			for ( size_t j = i + 1 ; j < live.size() ; j++ ) {
+				if ( owners[i] != owners[j] && isCollide(live[i]->getMask(), live[i]->getFixedMaskPos(), live[j]->getMask(), live[j]->getFixedMaskPos()) ) {
+					touched[i] = 1;
+					touched[j] = 1;
+				}
+			}
+		}
+		int expected = count(touched.begin(), touched.end(), 1);
+		naiveTime += naiveClock.getElapsedTime().asMicroseconds();
 
-Game::~Game() //Clear the memory.
-{
-	delete [] barrels;
-	delete [] sandbags;
-	delete [] players;
-	delete [] bullets;
-	delete text;
-	delete font;
-	delete window;
+		game.frameArena.reset();
+		sf::Clock gridClock;
+		int cancelled = game.cancelBullets();
+		gridTime += gridClock.getElapsedTime().asMicroseconds();
+		same = same && (cancelled == expected);
+		//-> Lists keep their order, so the left bullets are walked along the live ones.
+		//   Skipped ones are removed by the grid and should be touched in all pairs.
+		size_t k = 0;
+		for ( int p = 0 ; p < np ; p++ ) {
+			for ( Bullet *temp = game.bullets[p].getHead() ; temp != NULL ; temp = temp->next, k++ ) {
+				while ( k < live.size() && live[k] != temp ) {
+					same = same && touched[k++];
+				}
+				same = same && k < live.size() && !touched[k];
+			}
+		}
+		while ( k < live.size() ) {
+			same = same && touched[k++];
+		}
+		//---
+		removed += cancelled;
+		game.step(idle);
+	}
+	cout << "[BENCH] bullets: " << CAST_FLOAT(numBullets) / numTicks << " bullets/tick, " << CAST_FLOAT(removed) / numTicks << " cancelled/tick" << endl;
+	cout << "[BENCH] bullets: all pairs=" << CAST_FLOAT(naiveTime) / numTicks << " us/tick, grid=" << CAST_FLOAT(gridTime) / numTicks
+		 << " us/tick, same=" << (same ? "yes" : "no") << endl;
+	return same ? 0 : 1;
 }
+//---
 
-//-> 1 means there is a collision, 0 means no collision.
-bool Game::entityCollisionCheck(entityArray *const entities, const unsigned int &lastEntIndex)
+//-> 100k particles are kept alive, explosions are spawned when some of them
+//   die. Update and draw times are compared with the frame time of 60 fps,
+//   in the calling thread and on the worker pool.
+int benchParticles(void)
 {
-	//-> Compare the new entity location with older entities to prevent collision.
-	sf::Vector2u extend(PADDING, PADDING);
-	for (unsigned int i = 0 ; i < lastEntIndex ; i++) {
-		if ( isCollide(entities[i].pos, entities[i].size + extend, entities[lastEntIndex].pos, entities[lastEntIndex].size + extend) ) {
-			return 1;
-		} else {
-			continue;
+	const unsigned int numFrames = 300;
+	const size_t numLive = 100000;
+	WorkerPool pool;
+	pool.start(0);
+	sf::RenderTexture frame;
+	frame.create(1024, 746);
+	Random sceneRng;
+	double frameUs[2];
+	for ( int mode = 0 ; mode < 2 ; mode++ ) {
+		ParticleSystem particles;
+		particles.init(PARTICLE_CAPACITY);
+		sceneRng.seed(4);
+		sf::Int64 updateTime = 0, drawTime = 0;
+		unsigned long long live = 0;
+		for ( unsigned int t = 0 ; t < numFrames ; t++ ) {
+			while ( particles.size() < numLive ) {
+				sf::Vector2f center(sceneRng.next() % 1024, sceneRng.next() % 746);
+				particles.spawn(center, PARTICLE_EXPLOSION, sf::Color(255, 170, 40), 260);
+			}
+			particles.update(1.0f / TICK_RATE, mode == 0 ? NULL : &pool);
+			particles.paint(frame);
+			updateTime += particles.getUpdateTime();
+			drawTime += particles.getDrawTime();
+			live += particles.size();
 		}
+		frameUs[mode] = CAST_FLOAT(updateTime + drawTime) / numFrames;
+		cout << "[BENCH] particles " << (mode == 0 ? "serial" : "workers (" + to_string(pool.size()) + ")") << ": "
+			 << live / numFrames << " live, update=" << CAST_FLOAT(updateTime) / numFrames << " us/frame, draw="
+			 << CAST_FLOAT(drawTime) / numFrames << " us/frame" << endl;
 	}
-	return 0;
+	bool fits = min(frameUs[0], frameUs[1]) < 1000000.0 / 60;
+	cout << "[BENCH] particles: fits 60 fps=" << (fits ? "yes" : "no") << endl;
+	return fits ? 0 : 1;
 }
+//---
 
-inline void Game::initBackGround(void)
+//-> 100 bots check 10 targets in every tick, in a crowded arena. A barrel is
+//   destroyed in every 5 ticks, so the grid is synced incrementally. Each ray is
+//   also tested against all opaque obstacles and the hits should be the same.
+int benchRaycast(void)
 {
-	if (!bgTexture.loadFromFile("textures/grass.png")) {
-		cout << "[ERROR] Texture loading error." << endl;
-		exit(1);
+	const unsigned int numTicks = 500;
+	const size_t numRays = 1000;
+	scenario config = benchScenario(4000, 3000, 100, 250, 0);
+	config.numBots = 16;
+	config.headless = 1;
+	Game game(config);
+	game.initGameEnv();
+	const int ns = game.numSandbags;
+	const int nb = game.numBarrels;
+	vector<sf::FloatRect> boxes;
+	for ( int i = 0 ; i < ns ; i++ ) {
+		boxes.push_back(game.sandbags[i].getOpaqueBox());
 	}
-	
-	//-> If created sprite larger than texture, than repeat texture to fill sprite.
-	bgTexture.setRepeated(true); 
-	//---
-	
-	bgSprite.setTexture(bgTexture);
-	
-	//-> Sprite will be same width and height with window. In case of the larger
-	//   sprite, then texture repeatedly fill the sprite area.
-	bgSprite.setTextureRect(sf::IntRect(0, 0, width, height));
-	//---
-}
+	for ( int i = 0 ; i < nb ; i++ ) {
+		boxes.push_back(game.barrels[i].getOpaqueBox());
+	}
+	WorkerPool pool;
+	pool.start(0);
+	Random rayRng;
+	rayRng.seed(7);
+	vector<rayQuery> queries(numRays);
+	vector<rayHit> bruteHits(numRays), gridHits(numRays), poolHits(numRays);
+	sf::Int64 bruteTime = 0, gridTime = 0, poolTime = 0, syncTime = 0;
+	unsigned long long blocked = 0;
+	bool same = 1;
+	for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+		if ( t % 5 == 0 ) {
+			game.barrels[rayRng.next() % nb].setVisible(0);
+		}
+		sf::Clock syncClock;
+		game.sight.sync(game.barrels);
+		syncTime += syncClock.getElapsedTime().asMicroseconds();
+		for ( size_t r = 0 ; r < numRays ; r++ ) {
+			queries[r].from = sf::Vector2f(rayRng.next() % game.worldSize.x, rayRng.next() % game.worldSize.y);
+			queries[r].to = queries[r].from + sf::Vector2f(CAST_FLOAT(rayRng.next() % 3001) - 1500, CAST_FLOAT(rayRng.next() % 3001) - 1500);
+		}
 
-inline sf::Vector2f Game::getRandCoord(const sf::Vector2u &textureSize)
-{
-	//-> Create a random x and y according to the game width and height and also
-	//   texture of the entities width and height.
-	sf::Vector2f randCoord;
-	randCoord.x = rand() % (width - textureSize.x);
-	randCoord.y = rand() % (height - textureSize.y);
-	//---
-	return randCoord;
+		sf::Clock bruteClock;
+		for ( size_t r = 0 ; r < numRays ; r++ ) {
+			rayHit hit = {-1, 1};
+			const sf::Vector2f dir = queries[r].to - queries[r].from;
+			for ( int slot = 0 ; slot < ns + nb ; slot++ ) {
+				float d;
+				if ( (slot < ns || game.barrels[slot - ns].getVisible()) && RaycastGrid::intersect(boxes[slot], queries[r].from, dir, d)
+					 && (hit.slot < 0 || d < hit.t) ) {
+					hit.slot = slot;
+					hit.t = d;
+				}
+			}
+			bruteHits[r] = hit;
+		}
+		bruteTime += bruteClock.getElapsedTime().asMicroseconds();
+
+		sf::Clock gridClock;
+		game.sight.castBatch(&queries[0], &gridHits[0], numRays, NULL);
+		gridTime += gridClock.getElapsedTime().asMicroseconds();
+		sf::Clock poolClock;
+		game.sight.castBatch(&queries[0], &poolHits[0], numRays, &pool);
+		poolTime += poolClock.getElapsedTime().asMicroseconds();
+		for ( size_t r = 0 ; r < numRays ; r++ ) {
+			same = same && bruteHits[r].slot == gridHits[r].slot && bruteHits[r].t == gridHits[r].t
+				   && gridHits[r].slot == poolHits[r].slot && gridHits[r].t == poolHits[r].t;
+			blocked += gridHits[r].slot >= 0;
+		}
+	}
+	cout << "[BENCH] raycast: " << numRays << " rays/tick, " << ns + nb << " obstacles, " << 100.0 * blocked / (CAST_FLOAT(numRays) * numTicks)
+		 << "% blocked, " << game.sight.getUpdatedCells() << " cells synced in " << syncTime << " us" << endl;
+	cout << "[BENCH] raycast: all obstacles=" << CAST_FLOAT(bruteTime) / numTicks << " us/tick, grid=" << CAST_FLOAT(gridTime) / numTicks
+		 << " us/tick, grid on " << pool.size() << " workers=" << CAST_FLOAT(poolTime) / numTicks << " us/tick, same=" << (same ? "yes" : "no") << endl;
+	return same ? 0 : 1;
 }
+//---
 
-inline void Game::initEntities(void)
+//-> Bots play a match, then it is reset with a seed. The reset match should be
+//   the same as the first match of a new game with that seed, also after it is
+//   played. Then the reset is timed against deleting and creating the entities.
+int benchReset(void)
 {
-	//-> Memory allocations of entities.
-	barrels = new Barrel[numBarrels];
-	sandbags = new Sandbag[numSandbags];
-	players = new Player[numPlayers];
-	bullets = new BulletList[numPlayers];
-	//---
-
-	//-> This part created for the collision check.
-	//   Size of entity texture and position of entity will be saved to the array.
-	//   And also last saved item index will count.
-	entityArray *entities = new entityArray[numBarrels + numSandbags + numPlayers];
-	unsigned int lastEntIndex = 0;
-	//---
+	const unsigned int numTicks = 600;
+	const unsigned int numResets = 200;
+	scenario config = benchScenario(1600, 1200, 20, 20, 0);
+	config.numBots = 8;
+	config.seed = 3;
+	config.headless = 1;
+	const tickInput idle = {{-1, -1}, {0, 0}, 0};
+	worldSnapshot start[2], end[2];
 
-	//-> Initialize the barrel, sandbag and player according to its numbers.
-	//   In every step, firstly entity is initialized at (0,0) location, then
-	//   texture size of this entity is saved to the "entites" array, than
-	//   this item is moved to a random coordinate and also this coordinate
-	//   is saved to the "entities" array. Then collision check is applied
-	//   to the given "entities" array. lastEntIndex is the index of the
-	//   new saved entitiy in the "entities" array.
-	for (int i = 0 ; i < numBarrels ; i++ ) {
-		(barrels+i)->init(window, "textures/barrel.png", sf::Vector2f(0,0), sf::Vector2u(5, 38));
-		(entities+lastEntIndex)->size = (barrels+i)->getSize();
-		do {
-			(barrels+i)->setPosition(getRandCoord((barrels+i)->getSize()));
-			(entities+lastEntIndex)->pos = (barrels+i)->getPosition();
-		} while (entityCollisionCheck(entities, lastEntIndex));
-		lastEntIndex++;
-	}
-	for (int i = 0 ; i < numSandbags ; i++ ) {
-		(sandbags+i)->init(window, "textures/bags.png", sf::Vector2f(0,0), sf::Vector2u(5, 28)); 
-		(entities+lastEntIndex)->size = (sandbags+i)->getSize();
-		do {
-			(sandbags+i)->setPosition(getRandCoord((sandbags+i)->getSize()));
-			(entities+lastEntIndex)->pos = (sandbags+i)->getPosition();
-		} while (entityCollisionCheck(entities, lastEntIndex));
-		lastEntIndex++;
+	Game game(config);
+	game.initGameEnv();
+	for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+		game.step(idle);
 	}
-	for (int i = 0 ; i < numPlayers ; i++ ) {
-		(players+i)->init(window, "textures/", 14, sf::Vector2f(0,0), sf::Vector2u(50,50)); 
-		(bullets+i)->init(window, "textures/bullet.png", (players+i));
-		(entities+lastEntIndex)->size = (players+i)->getSize();
-		do {
-			(players+i)->setPosition(getRandCoord((players+i)->getSize()));
-			(entities+lastEntIndex)->pos = (players+i)->getPosition();
-		} while (entityCollisionCheck(entities, lastEntIndex));
-		lastEntIndex++;
+	game.reset(config.seed);
+	game.captureSnapshot(start[0]);
+	for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+		game.step(idle);
 	}
-	//---
-
-	//-> "entites" array is not the attribute of the class, it is
-	//   created in this method and so deleted in this method.
-	delete [] entities;
-	//---
-}
+	game.captureSnapshot(end[0]);
 
-inline void Game::initFontAndText(const string &fontPath, const int textSize)
-{
-	font = new sf::Font;
-	text = new sf::Text;
-	if (!font->loadFromFile(fontPath)) {
-		cout << "[ERROR] Font loading error." << endl;
+	Game fresh(config);
+	fresh.initGameEnv();
+	fresh.captureSnapshot(start[1]);
+	for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+		fresh.step(idle);
 	}
-	text->setFont(*font);
-	text->setCharacterSize(textSize);
-}
+	fresh.captureSnapshot(end[1]);
+	bool same = equalSnapshots(start[0], start[1]) && equalSnapshots(end[0], end[1]);
 
-void Game::initGameEnv(void)
-{
-	window = new sf::RenderWindow(sf::VideoMode(width, height), "Shooter 2D");
-	initBackGround();
-	initEntities();
-	initFontAndText("./font.ttf", 40);
+	sf::Clock resetClock;
+	for ( unsigned int i = 0 ; i < numResets ; i++ ) {
+		game.reset(i + 1);
+	}
+	float resetUs = CAST_FLOAT(resetClock.getElapsedTime().asMicroseconds()) / numResets;
+	sf::Clock initClock;
+	for ( unsigned int i = 0 ; i < numResets ; i++ ) {
+		delete [] fresh.sandbags;
+		delete [] fresh.barrels;
+		delete [] fresh.bullets;
+		delete [] fresh.players;
+		delete [] fresh.records;
+		delete [] fresh.bulletRects;
+		delete [] fresh.placement;
+		fresh.initEntities();
+	}
+	float initUs = CAST_FLOAT(initClock.getElapsedTime().asMicroseconds()) / numResets;
+	cout << "[BENCH] reset: in place=" << resetUs << " us, delete and init=" << initUs << " us, same as a new game=" << (same ? "yes" : "no") << endl;
+	return (same && resetUs < 1000) ? 0 : 1;
 }
+//---
 
-inline void Game::drawEntities(void)
+//-> The tick budget of the governor is made too small, so every tick is over it,
+//   then it is made large again. The game should degrade through all levels and
+//   recover to the normal level, while the simulation runs every tick. The match
+//   is recorded, a replay without the governor should give the same world.
+int benchGovernor(void)
 {
-	for ( int i = 0 ; i < numBarrels ; i++ ) {
-		barrels[i].paint();
+	const unsigned int numTicks = 800;
+	const string path = "/tmp/shooter-governor.rec";
+	scenario config = benchScenario(1600, 1200, 10, 10, 2);
+	config.numBots = 6;
+	config.bulletSpeed = 2; //Bullets fly long, so the cap is reached.
+	config.recordPath = path;
+	Game game(config);
+	game.initGameEnv();
+	Random inputRng;
+	inputRng.seed(3);
+	const sf::Int64 budgets[2] = {1, 1000000000};
+	bool pass = 1;
+	for ( int phase = 0 ; phase < 2 ; phase++ ) {
+		game.governor.init(budgets[phase]);
+		unsigned int firstTick = game.tick, rendered = 0;
+		sf::Clock clock;
+		for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+			game.frameArena.reset();
+			rendered += game.runTick(benchInput(inputRng, firstTick + t));
+		}
+		int maxBullets = 0;
+		for ( int i = 0 ; i < game.numPlayers ; i++ ) {
+			maxBullets = max(maxBullets, game.bullets[i].size());
+		}
+		cout << "[BENCH] governor " << (phase == 0 ? "overloaded" : "recovered") << ": level=" << game.governor.getLevel()
+			 << " ticks=" << game.tick - firstTick << " rendered=" << rendered << " particles=" << game.particles.size()
+			 << " max bullets of a player=" << maxBullets << ", " << clock.getElapsedTime().asMicroseconds() / CAST_FLOAT(numTicks) << " us/tick" << endl;
+		if ( phase == 0 ) {
+			pass = pass && game.governor.getLevel() == LOAD_BULLET_CAP && rendered < numTicks && game.particles.size() == 0 && maxBullets <= GOVERNOR_BULLET_CAP;
+		} else {
+			pass = pass && game.governor.getLevel() == LOAD_NORMAL;
+		}
+		pass = pass && game.tick - firstTick == numTicks;
 	}
-	for ( int i = 0 ; i < numSandbags ; i++ ) {
-		sandbags[i].paint();
+	for ( int i = LOAD_NORMAL ; i < NUM_LOAD_LEVELS ; i++ ) { //Levels between are entered once in each direction.
+		pass = pass && game.governor.getEntered(i) == ((i == LOAD_NORMAL || i == LOAD_BULLET_CAP) ? 1u : 2u);
 	}
-	for ( int i = 0 ; i < numPlayers ; i++ ) {
-		players[i].paint();
-		bullets[i].update(players, barrels, sandbags, numPlayers, numBarrels, numSandbags);
+	game.governor.print();
+	game.recorder.stop();
+
+	RecordReader reader;
+	bool replayed = reader.open(path);
+	if ( replayed ) {
+		scenario replayConfig = config;
+		reader.getScenario(replayConfig);
+		replayConfig.headless = 1;
+		Game viewer(replayConfig);
+		viewer.initGameEnv();
+		unsigned int position = 0;
+		while ( viewer.stepReplay(reader, position) ) {}
+		worldSnapshot *ends = new worldSnapshot[2];
+		game.captureSnapshot(ends[0]);
+		viewer.captureSnapshot(ends[1]);
+		replayed = position == 2 * numTicks && equalSnapshots(ends[0], ends[1]);
+		delete [] ends;
 	}
+	remove(path.c_str());
+	cout << "[BENCH] governor: degraded and recovered in order=" << (pass ? "yes" : "no") << ", capped match replays the same="
+		 << (replayed ? "yes" : "no") << endl;
+	return (pass && replayed) ? 0 : 1;
 }
+//---
 
-inline void Game::drawBackground(void) //Clear and draw.
+//-> Same headless match without and with telemetry, files are rotated in every
+//   1000 records. The match should be the same and the files should have all
+//   written records. Then a burst larger than the ring is pushed, the records
+//   which do not fit should be dropped and counted, without waiting.
+static unsigned long long countLines(const string &path)
 {
-	window->clear(sf::Color::Black);
-	window->draw(bgSprite);
+	ifstream file(path.c_str());
+	string line;
+	unsigned long long lines = 0;
+	while ( getline(file, line) ) {
+		lines++;
+	}
+	return lines;
 }
 
-inline void Game::drawText(void)
+int benchTelemetry(void)
 {
-	window->draw(*text);
-}
+	const unsigned int numTicks = 20000;
+	const string path = "/tmp/shooter-telemetry.ndjson";
+	scenario config = benchScenario(1600, 1200, 10, 10, 0);
+	config.numBots = 8;
+	config.headless = 1;
+	config.duration = numTicks;
+	const tickInput idle = {{-1, -1}, {0, 0}, 0};
+	worldSnapshot snaps[2];
+	float tickUs[2];
+	unsigned long long written = 0, lines = 0;
+	unsigned int files = 0, dropped = 0;
+	for ( int mode = 0 ; mode < 2 ; mode++ ) {
+		Game game(config);
+		game.initGameEnv();
+		if ( mode == 1 ) {
+			game.telemetry.start(path, 1000);
+			for ( int i = 0 ; i < game.numPlayers ; i++ ) {
+				game.players[i].setTelemetry(&game.telemetry, i);
+				game.bullets[i].setTelemetry(&game.telemetry);
+			}
+		}
+		sf::Clock clock;
+		for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+			game.frameArena.reset();
+			game.step(idle);
+		}
+		tickUs[mode] = clock.getElapsedTime().asMicroseconds() / CAST_FLOAT(numTicks);
+		game.captureSnapshot(snaps[mode]);
+		if ( mode == 1 ) {
+			game.telemetry.stop();
+			written = game.telemetry.getWritten();
+			files = game.telemetry.getNumFiles();
+			dropped = game.telemetry.getDropped();
+			for ( unsigned int i = 0 ; i < files ; i++ ) {
+				lines += countLines(game.telemetry.getPath(i));
+				remove(game.telemetry.getPath(i).c_str());
+			}
+		}
+	}
+	bool same = equalSnapshots(snaps[0], snaps[1]);
+	cout << "[BENCH] telemetry match: " << tickUs[0] << " us/tick without, " << tickUs[1] << " us/tick with, "
+		 << written << " records in " << files << " files, " << lines << " lines, " << dropped << " dropped, same match=" << (same ? "yes" : "no") << endl;
 
-inline void Game::update(void)
-{
-	drawBackground();
-	drawEntities();
-	drawText();
-	window->display();
+	const unsigned int burst = 4 * TELEMETRY_QUEUE_SIZE;
+	TelemetrySink sink;
+	sink.start("/tmp/shooter-burst.csv");
+	sf::Int64 slowest = 0;
+	sf::Clock burstClock;
+	for ( unsigned int i = 0 ; i < burst ; i++ ) {
+		sf::Int64 before = burstClock.getElapsedTime().asMicroseconds();
+		sink.record(TEL_SHOT, i % SNAP_MAX_PLAYERS, 0, 0, 0);
+		slowest = max(slowest, burstClock.getElapsedTime().asMicroseconds() - before);
+	}
+	float burstUs = burstClock.getElapsedTime().asMicroseconds();
+	sink.stop();
+	unsigned long long burstLines = countLines(sink.getPath(0));
+	remove(sink.getPath(0).c_str());
+	unsigned long long dropRecords = sink.getDropped() > 0; //At least one dropped record is written.
+	bool counted = sink.getWritten() >= burst - sink.getDropped() + dropRecords && burstLines == sink.getWritten() + 1;
+	cout << "[BENCH] telemetry burst: " << burst << " records in " << burstUs << " us, slowest push " << slowest << " us, "
+		 << sink.getDropped() << " dropped, " << sink.getWritten() << " written, counted=" << (counted ? "yes" : "no") << endl;
+	return (same && lines == written && dropped == 0 && counted) ? 0 : 1;
 }
+//---
 
-void Game::run2player(void)
+//-> Bots play a recorded match which is reset in the middle. Ticks of the
+//   recording are visited in a random order, the states should be the ones of
+//   the recorded match. Seeks are timed against playing from the first tick.
+//   Then slow bullets of 16 bots are recorded, so the keyframes hold hundreds
+//   of bullets, and the whole recording is played and checked again.
+int benchReplay(void)
 {
-	if ( numPlayers != 2 ) {
-		cout << "[ERROR] This method should be run for 2 player games." << endl;
-		return;
+	const unsigned int numTicks = 24000;
+	const unsigned int denseTicks = 3000;
+	const unsigned int denseStride = RECORD_KEYFRAME_TICKS / 2; //Every other state is a keyframe.
+	const int denseBullets = 1024; //Bullets of the largest state should be above it.
+	const unsigned int resetTick = 10000;
+	const unsigned int stride = 599; //States of the ticks at every stride are kept.
+	const unsigned int numSamples = numTicks / stride + 1;
+	const unsigned int numSeeks = 200;
+	const string path = "/tmp/shooter-bench.rec";
+	scenario config = benchScenario(1600, 1200, 10, 10, 0);
+	config.numBots = 8;
+	config.seed = 5;
+	config.headless = 1;
+	config.recordPath = path;
+	const tickInput idle = {{-1, -1}, {0, 0}, 0};
+	vector<worldSnapshot> samples(numSamples + 1); //Last one is the end of the match.
+
+	sf::Clock recordClock;
+	{
+		Game game(config);
+		game.initGameEnv();
+		for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+			if ( t == resetTick ) {
+				game.reset(config.seed + 1);
+			}
+			if ( t % stride == 0 ) {
+				game.captureSnapshot(samples[t / stride]);
+			}
+			game.frameArena.reset();
+			game.recordTick(idle);
+			game.step(idle);
+		}
+		game.captureSnapshot(samples[numSamples]);
+		game.recorder.stop();
 	}
+	float recordUs = recordClock.getElapsedTime().asMicroseconds() / CAST_FLOAT(numTicks);
 
-	initGameEnv();
+	RecordReader reader;
+	if ( !reader.open(path) ) {
+		return 1;
+	}
+	struct stat info;
+	unsigned long long bytes = (stat(path.c_str(), &info) == 0) ? info.st_size : 0;
+	scenario replayConfig = config;
+	reader.getScenario(replayConfig);
+	replayConfig.headless = 1;
+	Game viewer(replayConfig);
+	viewer.initGameEnv();
+	worldSnapshot state;
+	unsigned int position = 0;
+	bool same = (reader.getNumTicks() == numTicks);
+	sf::Int64 slowest = 0, total = 0;
+	Random seekRng;
+	seekRng.seed(9);
+	for ( unsigned int i = 0 ; i < numSeeks ; i++ ) {
+		unsigned int sample = seekRng.next() % numSamples;
+		sf::Clock seekClock;
+		bool found = viewer.seekReplay(reader, position, sample * stride);
+		sf::Int64 time = seekClock.getElapsedTime().asMicroseconds();
+		slowest = max(slowest, time);
+		total += time;
+		viewer.captureSnapshot(state);
+		same = same && found && equalSnapshots(state, samples[sample]);
+	}
+	sf::Clock playClock;
+	same = same && viewer.seekReplay(reader, position, 0);
+	while ( viewer.stepReplay(reader, position) ) {}
+	sf::Int64 playUs = playClock.getElapsedTime().asMicroseconds();
+	viewer.captureSnapshot(state);
+	same = same && position == numTicks && equalSnapshots(state, samples[numSamples]);
+	remove(path.c_str());
 
-	sf::Event event;
-	int pl1move = -1, pl2move = -1; //Holds movement dir of players
-	int pl1fire = -1, pl2fire = -1; //Holds fire situation of players
-	int plWait = 0; //Player wait
-	int bulWait = 0; //Bullet wait
-	int fireWait = 0;
+	cout << "[BENCH] replay: " << numTicks << " ticks, " << bytes << " bytes (" << CAST_FLOAT(bytes) / numTicks << " bytes/tick), record "
+		 << recordUs << " us/tick" << endl;
+	cout << "[BENCH] replay: seek avg=" << CAST_FLOAT(total) / numSeeks << " us, max=" << slowest << " us, whole match from tick 0="
+		 << playUs << " us, same=" << (same ? "yes" : "no") << endl;
 
-	while ( window->isOpen() ) {
-		//-> Here waits are increase according to the speed.
-		plWait += speed;
-		bulWait += speed;
-		fireWait += speed;
-		//---
+	scenario dense = benchScenario(3200, 2400, 0, 0, 0);
+	dense.numBots = SNAP_MAX_PLAYERS;
+	dense.bulletSpeed = 2;
+	dense.headless = 1;
+	dense.recordPath = path;
+	vector<worldSnapshot> denseSamples(denseTicks / denseStride + 1);
+	{
+		Game game(dense);
+		game.initGameEnv();
+		for ( unsigned int t = 0 ; t < denseTicks ; t++ ) {
+			if ( t % denseStride == 0 ) {
+				game.captureSnapshot(denseSamples[t / denseStride]);
+			}
+			game.frameArena.reset();
+			game.recordTick(idle);
+			game.step(idle);
+		}
+		game.captureSnapshot(denseSamples.back());
+		game.recorder.stop();
+	}
+	RecordReader denseReader;
+	if ( !denseReader.open(path) ) {
+		return 1;
+	}
+	scenario denseReplay = dense;
+	denseReader.getScenario(denseReplay);
+	denseReplay.headless = 1;
+	Game denseViewer(denseReplay);
+	denseViewer.initGameEnv();
+	position = 0;
+	bool denseSame = (denseReader.getNumTicks() == denseTicks);
+	int maxBullets = 0;
+	for ( size_t i = denseSamples.size() - 1 ; i-- > 0 ; ) { //Backward, so every state is reached from its keyframe.
+		denseSame = denseSame && denseViewer.seekReplay(denseReader, position, i * denseStride);
+		denseViewer.captureSnapshot(state);
+		denseSame = denseSame && equalSnapshots(state, denseSamples[i]);
+		maxBullets = max(maxBullets, denseSamples[i].nbul);
+	}
+	denseSame = denseSame && denseViewer.seekReplay(denseReader, position, 0);
+	while ( denseViewer.stepReplay(denseReader, position) ) {}
+	denseViewer.captureSnapshot(state);
+	denseSame = denseSame && position == denseTicks && equalSnapshots(state, denseSamples.back());
+	remove(path.c_str());
+	cout << "[BENCH] replay dense: " << denseTicks << " ticks, " << maxBullets << " bullets in the largest saved state, same="
+		 << (denseSame ? "yes" : "no") << endl;
+	return (same && slowest < playUs && denseSame && maxBullets > denseBullets) ? 0 : 1;
+}
+//---
 
-		//-> Scoreboard
-		text->setString(to_string(players[1].getScore()) + " - " + to_string(players[0].getScore()));
-		text->setPosition((width - text->getLocalBounds().width)/2, height - 2*text->getLocalBounds().height);
-		//---
+//-> Script of the scheduler load, it counts its rounds.
+static Script benchWaiter(unsigned int *const counter, const unsigned int period, const unsigned int rounds)
+{
+	for ( unsigned int i = 0 ; i < rounds ; i++ ) {
+		co_await ScriptWait(period);
+		(*counter)++;
+	}
+}
 
-		while (window->pollEvent(event)) {
-			//-> Players' variables are set according to the key press.
-			if ( event.type == sf::Event::KeyPressed ) { //Takes only keypress event
-				switch (event.key.code) {
-					case sf::Keyboard::Up:
-						pl1move = UP;
-						break;
-					case sf::Keyboard::Down:
-						pl1move = DOWN;
-						break;
-					case sf::Keyboard::Right:
-						pl1move = RIGHT;
-						break;
-					case sf::Keyboard::Left:
-						pl1move = LEFT;
-						break;
-					case sf::Keyboard::W:
-						pl2move = UP;
-						break;
-					case sf::Keyboard::S:
-						pl2move = DOWN;
-						break;
-					case sf::Keyboard::D:
-						pl2move = RIGHT;
-						break;
-					case sf::Keyboard::A:
-						pl2move = LEFT;
-						break;
-					//-> If pl(x)fire is not -1 then new fire are prevented.
-					//   This means user fires just one bullet with the fire key.
-					case sf::Keyboard::Enter:
-						if ( pl1fire == -1 ) pl1fire = 1;
-						break;
-					case sf::Keyboard::Space:
-						if ( pl2fire == -1 ) pl2fire = 1;
-						break;
-					//---
-					default:
-						break;
+//-> Patrolling bots are driven by their scripts in one game and by the same
+//   behavior written as a state machine in the other, the matches should be
+//   the same. Then thousands of scripts are run, finished ones are replaced by
+//   new ones in the same tick, and their frames should come from the pool.
+int benchScripts(void)
+{
+	const unsigned int numTicks = 20000;
+	const unsigned int numScripts = 4096;
+	const unsigned int loadTicks = 2000;
+	scenario config = benchScenario(1600, 1200, 10, 10, 0);
+	config.numBots = 8;
+	config.headless = 1;
+	config.botScript = SCRIPT_PATROL;
+	const tickInput idle = {{-1, -1}, {0, 0}, 0};
+	worldSnapshot end[2];
+	float tickUs[2];
+	size_t patrolFrame = 0;
+	for ( int mode = 0 ; mode < 2 ; mode++ ) {
+		Game game(config);
+		game.initGameEnv();
+		patrolFrame = max(patrolFrame, ScriptPool::getLargestFrame());
+		//-> Same behavior as Game::patrol, a resume is a call.
+		typedef struct _patrolState {
+			Direction dir;
+			int stillWalks;
+			unsigned int wakeTick;
+		} patrolState;
+		const Direction clockwise[4] = {RIGHT, LEFT, UP, DOWN};
+		patrolState states[SNAP_MAX_PLAYERS];
+		if ( mode == 1 ) {
+			game.scripts.clear();
+			for ( int i = 0 ; i < game.numPlayers ; i++ ) {
+				states[i].dir = static_cast<Direction>(i % 4);
+				states[i].stillWalks = 0;
+				states[i].wakeTick = 0;
+			}
+		}
+		//---
+		sf::Clock clock;
+		for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+			game.frameArena.reset();
+			for ( int i = 0 ; i < game.numPlayers && mode == 1 ; i++ ) {
+				patrolState &state = states[i];
+				if ( state.wakeTick > game.tick ) {
+					continue;
 				}
-			//---
-			//-> A keyrelease event wipes out its key press event.
-			} else if ( event.type == sf::Event::KeyReleased ) { //Takes only keyrelease event
-				switch (event.key.code) {
-					//-> One player can press two movement keys, then release the old key,
-					//   so in this situation soldier should not stop. Here multiple key press
-					//   effects are removed with if blocks.
-					case sf::Keyboard::Up:
-						if (pl1move == UP) pl1move = -1;
-						break;
-					case sf::Keyboard::Down:
-						if (pl1move == DOWN) pl1move = -1;
-						break;
-					case sf::Keyboard::Right:
-						if (pl1move == RIGHT) pl1move = -1;
-						break;
-					case sf::Keyboard::Left:
-						if (pl1move == LEFT) pl1move = -1;
-						break;
-					case sf::Keyboard::W:
-						if (pl2move == UP) pl2move = -1;
-						break;
-					case sf::Keyboard::S:
-						if (pl2move == DOWN) pl2move = -1;
-						break;
-					case sf::Keyboard::D:
-						if (pl2move == RIGHT) pl2move = -1;
-						break;
-					case sf::Keyboard::A:
-						if (pl2move == LEFT) pl2move = -1;
-						break;
-					//---
-					//-> Every user fire just one bullet at any keypress because
-					//   if pl(x)fire is not -1 then fire keypress is passed.
-					case sf::Keyboard::Enter:
-						pl1fire = -1;
-						break;
-					case sf::Keyboard::Space:
-						pl2fire = -1;
-						break;
-					//---
-					default:
-						break;
+				if ( state.stillWalks >= SCRIPT_BLOCKED_WALKS ) {
+					state.dir = clockwise[state.dir];
+					if ( game.canFire(i) ) {
+						game.players[i].fire(game.bullets + i, game.bulletSpeed);
+					}
+					state.stillWalks = 0;
 				}
-			} else if ( event.type == sf::Event::Closed ) { //Handle the close event.
-				window->close();
+				state.stillWalks = game.scriptWalk(i, state.dir) ? 0 : state.stillWalks + 1;
+				state.wakeTick = game.tick + WALK_TICKS;
 			}
+			game.step(idle);
 		}
+		tickUs[mode] = clock.getElapsedTime().asMicroseconds() / CAST_FLOAT(numTicks);
+		game.captureSnapshot(end[mode]);
+	}
+	bool same = equalSnapshots(end[0], end[1]);
+	cout << "[BENCH] scripts patrol: " << tickUs[0] << " us/tick with scripts, " << tickUs[1] << " us/tick with a state machine, frame "
+		 << patrolFrame << " bytes, same=" << (same ? "yes" : "no") << endl;
 
-		//-> Wait section
-		if ( bulWait > 2500 ) {
-			update();
-			bulWait = 0;
-		}
-		//Fire block does not include update() method it just fires the bullet.
-		if ( fireWait > 10000 ) {
-			if ( pl1fire == 1 ) {
-				players[0].fire(bullets, 18);
-				pl1fire = 0;
-			}
-			if ( pl2fire == 1 ) {
-				players[1].fire(bullets + 1, 18);
-				pl2fire = 0;
-			}
-			fireWait = 0;
+	//-> Load of the scheduler. Scripts wait 1 to 8 ticks for 1 to 32 rounds.
+	ScriptScheduler scheduler;
+	Random loadRng;
+	loadRng.seed(6);
+	unsigned int rounds = 0, spawned = 0;
+	scheduler.reserve(numScripts);
+	unsigned int growths = ScriptPool::getGrowths();
+	unsigned int heapFrames = ScriptPool::getHeapFrames();
+	unsigned long long allocations = AllocTracker::getAllocations();
+	sf::Clock loadClock;
+	for ( unsigned int t = 0 ; t < loadTicks ; t++ ) {
+		while ( scheduler.size() < numScripts ) {
+			scheduler.spawn(benchWaiter(&rounds, 1 + loadRng.next() % 8, 1 + loadRng.next() % 32), t);
+			spawned++;
 		}
-		if ( plWait > 30000 ) {
-			if ( pl1move != -1 ) {
-				players[0].walk(18, static_cast<Direction>(pl1move), players, barrels, sandbags, numPlayers, numBarrels, numSandbags);
-			}
-			if ( pl2move != -1 ) {
-				players[1].walk(18, static_cast<Direction>(pl2move), players, barrels, sandbags, numPlayers, numBarrels, numSandbags);
+		scheduler.run(t);
+	}
+	float loadUs = loadClock.getElapsedTime().asMicroseconds();
+	growths = ScriptPool::getGrowths() - growths;
+	heapFrames = ScriptPool::getHeapFrames() - heapFrames;
+	allocations = AllocTracker::getAllocations() - allocations;
+	const unsigned long long resumes = scheduler.getResumes();
+	cout << "[BENCH] scripts load: " << numScripts << " scripts, " << spawned << " started, " << resumes << " resumes, "
+		 << (resumes ? loadUs * 1000 / resumes : 0) << " ns/resume, frame " << ScriptPool::getLargestFrame() << " bytes of "
+		 << SCRIPT_FRAME_SIZE << " byte slots, pool growths in ticks=" << growths << ", heap frames=" << heapFrames << ", allocations in ticks="
+		 << (AllocTracker::enabled() ? to_string(allocations) : string("not tracked")) << endl;
+	//---
+	return (same && growths == 0 && heapFrames == 0 && (!AllocTracker::enabled() || allocations == 0)) ? 0 : 1;
+}
+//---
+
+//-> Server side of the replication. Snapshots of 16 bots in a large arena are
+//   captured, then for 2 to 256 clients every snapshot is filtered for every
+//   client, encoded against the last snapshot of the client, sent over loopback
+//   UDP and decoded by the client. Clients follow the soldiers. Filtering with
+//   the grid is checked and timed against testing every entity.
+int benchInterest(void)
+{
+	const unsigned int warmupTicks = 600;
+	const unsigned int numTicks = 300;
+	const float viewRadius = 600;
+	const float radius = viewRadius + INTEREST_MARGIN;
+	scenario config = benchScenario(4096, 4096, 20, 20, 0);
+	config.numBots = SNAP_MAX_PLAYERS;
+	config.headless = 1;
+	const tickInput idle = {{-1, -1}, {0, 0}, 0};
+	vector<worldSnapshot> worlds(numTicks);
+	unsigned long long numEntities = 0;
+	{
+		Game game(config);
+		game.initGameEnv();
+		for ( unsigned int t = 0 ; t < warmupTicks + numTicks ; t++ ) {
+			game.frameArena.reset();
+			game.step(idle);
+			if ( t >= warmupTicks ) {
+				game.captureSnapshot(worlds[t - warmupTicks]);
+				numEntities += worlds[t - warmupTicks].np + worlds[t - warmupTicks].nbul;
 			}
-			update();
-			plWait = 0;
 		}
-		//---
+	}
+	unsigned char packet[16384];
+	unsigned char buffer[16384];
+	unsigned long long worldBytes = 0;
+	for ( unsigned int t = 1 ; t < numTicks ; t++ ) {
+		worldBytes += SnapshotCodec::encode(worlds[t], &worlds[t - 1], packet, sizeof(packet));
+	}
+	cout << "[BENCH] interest world: " << CAST_FLOAT(numEntities) / numTicks << " soldiers and bullets, whole world delta "
+		 << CAST_FLOAT(worldBytes) / (numTicks - 1) << " bytes/tick" << endl;
 
-		//-> Score check, to decide whether a player is won or not.
-		if ( players[0].getScore() >= 10 || players[1].getScore() >= 10 ) {
-			//-> Winner text
-			if ( players[0].getScore() >= 10 ) {
-				text->setString("Player 1 wins,\nstart over? (Y/N)");
-			} else if ( players[1].getScore() >= 10 ) {
-				text->setString("Player 2 wins,\nstart over? (Y/N)");
+	sockaddr_in address;
+	socklen_t length = sizeof(address);
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	int server = socket(AF_INET, SOCK_DGRAM, 0);
+	if ( server < 0 || bind(server, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ) {
+		cout << "[ERROR] Loopback socket can not be opened." << endl;
+		return 1;
+	}
+	InterestGrid grid;
+	grid.init(sf::Vector2u(config.width, config.height));
+	worldSnapshot filtered, decoded;
+	bool same = 1;
+	unsigned int errors = 0, lost = 0;
+	for ( unsigned int numClients = 2 ; numClients <= 256 ; numClients *= 2 ) {
+		vector<int> sockets(numClients, -1);
+		vector<sockaddr_in> addresses(numClients);
+		vector<InterestClient> clients(numClients);
+		vector<worldSnapshot> received(numClients);
+		for ( unsigned int c = 0 ; c < numClients ; c++ ) {
+			sockets[c] = socket(AF_INET, SOCK_DGRAM, 0);
+			address.sin_port = 0;
+			if ( sockets[c] < 0 || bind(sockets[c], reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+				 getsockname(sockets[c], reinterpret_cast<sockaddr *>(&addresses[c]), &length) != 0 ) {
+				cout << "[ERROR] Loopback socket can not be opened." << endl;
+				return 1;
 			}
-			text->setPosition((width - text->getLocalBounds().width)/2, (height - 2*text->getLocalBounds().height)/2);
-			//---
-
-			//-> Until a player press y or n keys or until window is closed.
-			while ( window->isOpen() ) {
-				update();
-				window->pollEvent(event);
-				//-> If y is pressed, then all entities are reconstructed and reinitialized.
-				//   And also default variables are assigned to player variables and wait variables.
-				if ( event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Y ) {
-					pl1move = -1;
-					pl2move = -1;
-					pl1fire = -1;
-					pl2fire = -1;
-					plWait = 0;
-					bulWait = 0;
-					fireWait = 0;
-					//-> Old entities are removed.
-					delete [] sandbags;
-					delete [] barrels;
-					delete [] bullets;
-					delete [] players;
-					//---
-					initEntities();
-					break;
+			clients[c].init(viewRadius);
+		}
+		unsigned long long gridNs = 0, filterNs = 0, bruteNs = 0, encodeNs = 0, bytes = 0, events = 0, interested = 0;
+		for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+			const worldSnapshot &world = worlds[t];
+			auto start = chrono::steady_clock::now();
+			grid.build(world);
+			gridNs += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+			for ( unsigned int c = 0 ; c < numClients ; c++ ) {
+				const sf::Vector2f center = world.players[c % world.np].pos;
+				clients[c].setCenter(center);
+				start = chrono::steady_clock::now();
+				clients[c].update(world, grid, filtered);
+				auto filterEnd = chrono::steady_clock::now();
+				//-> Same interest by testing every entity.
+				unsigned int mask = 0;
+				int numBullets = 0;
+				for ( int i = 0 ; i < world.np + world.nbul ; i++ ) {
+					sf::Vector2f d = ((i < world.np) ? world.players[i].pos : SnapshotCodec::bulletPosition(world.bullets[i - world.np])) - center;
+					if ( d.x * d.x + d.y * d.y <= radius * radius ) {
+						if ( i < world.np ) {
+							mask |= 1u << i;
+						} else {
+							numBullets++;
+						}
+					}
+				}
+				auto bruteEnd = chrono::steady_clock::now();
+				same = same && mask == clients[c].getPlayerMask() && numBullets == filtered.nbul;
 				//---
-				//-> Else close the window.
-				} else if ( (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::N) ||
-							(event.type == sf::Event::Closed) ) {
-					window->close();
-					break;
+				unsigned int size = SnapshotCodec::encode(filtered, clients[c].getBaseline(), packet, sizeof(packet));
+				auto encodeEnd = chrono::steady_clock::now();
+				filterNs += chrono::duration_cast<chrono::nanoseconds>(filterEnd - start).count();
+				bruteNs += chrono::duration_cast<chrono::nanoseconds>(bruteEnd - filterEnd).count();
+				encodeNs += chrono::duration_cast<chrono::nanoseconds>(encodeEnd - bruteEnd).count();
+				bytes += size;
+				events += clients[c].getEvents().size();
+				interested += __builtin_popcount(mask) + numBullets;
+				//-> Client side, the decoded world should be the filtered one.
+				sendto(server, packet, size, 0, reinterpret_cast<sockaddr *>(&addresses[c]), sizeof(addresses[c]));
+				ssize_t got = recv(sockets[c], buffer, sizeof(buffer), MSG_DONTWAIT);
+				if ( got != static_cast<ssize_t>(size) ) {
+					lost++;
+					continue;
+				}
+				if ( !SnapshotCodec::decode(buffer, got, (t == 0) ? NULL : &received[c], decoded) || decoded.nbul != filtered.nbul ) {
+					errors++;
+					continue;
+				}
+				for ( int i = 0 ; i < decoded.np ; i++ ) {
+					if ( fabs(decoded.players[i].pos.x - filtered.players[i].pos.x) > 0.5f / SNAP_POS_SCALE ||
+						 fabs(decoded.players[i].pos.y - filtered.players[i].pos.y) > 0.5f / SNAP_POS_SCALE ||
+						 decoded.players[i].state != filtered.players[i].state || decoded.players[i].score != filtered.players[i].score ) {
+						errors++;
+					}
 				}
+				for ( int i = 0 ; i < decoded.nbul ; i++ ) {
+					if ( decoded.bullets[i].id != filtered.bullets[i].id || decoded.bullets[i].age != filtered.bullets[i].age ) {
+						errors++;
+					}
+				}
+				received[c] = decoded;
+				clients[c].acknowledge(filtered);
 				//---
 			}
-			//---
 		}
-		//---
+		for ( unsigned int c = 0 ; c < numClients ; c++ ) {
+			close(sockets[c]);
+		}
+		const float perClient = CAST_FLOAT(numClients) * numTicks;
+		cout << "[BENCH] interest clients=" << numClients << ": grid build=" << gridNs / 1000.0f / numTicks << " us/tick, filter="
+			 << filterNs / perClient / 1000 << " us/client (all entities " << bruteNs / perClient / 1000 << " us), encode="
+			 << encodeNs / perClient / 1000 << " us/client, " << interested / perClient << " entities/client, "
+			 << bytes / perClient << " bytes/client/tick, " << events / perClient << " events/client/tick" << endl;
 	}
+	close(server);
+	cout << "[BENCH] interest: same as all entities=" << (same ? "yes" : "no") << ", decode errors=" << errors << ", lost packets=" << lost << endl;
+	return (same && errors == 0 && lost == 0) ? 0 : 1;
 }
+//---
 
-int main(void)
+//-> World hash of every tick against the tick and against hashing a captured
+//   snapshot, the incremental hash should be the hash of the snapshot. Then a
+//   game which casts its sight rays on the worker pool runs beside a serial copy,
+//   a soldier of the copy is moved a quarter pixel and it should be caught in
+//   that tick and not before.
+int benchHash(void)
 {
-	Game shooter(3, 1024, 746, 5,5,2);
-	shooter.run2player();
-	return 0;
+	const unsigned int numTicks = 20000;
+	const unsigned int desyncTick = 15000;
+	scenario config = benchScenario(1600, 1200, 12, 12, 0);
+	config.numBots = SNAP_MAX_PLAYERS;
+	config.headless = 1;
+	const tickInput idle = {{-1, -1}, {0, 0}, 0};
+	worldSnapshot snap;
+	unsigned long long stepNs = 0, hashNs = 0, snapshotNs = 0, numBullets = 0;
+	bool same = 1;
+	{
+		Game game(config);
+		game.initGameEnv();
+		for ( unsigned int t = 0 ; t < numTicks ; t++ ) {
+			game.frameArena.reset();
+			auto start = chrono::steady_clock::now();
+			game.step(idle);
+			auto stepEnd = chrono::steady_clock::now();
+			sf::Uint64 hash = game.getHash();
+			auto hashEnd = chrono::steady_clock::now();
+			game.captureSnapshot(snap);
+			sf::Uint64 full = StateHash::world(snap);
+			auto snapshotEnd = chrono::steady_clock::now();
+			stepNs += chrono::duration_cast<chrono::nanoseconds>(stepEnd - start).count();
+			hashNs += chrono::duration_cast<chrono::nanoseconds>(hashEnd - stepEnd).count();
+			snapshotNs += chrono::duration_cast<chrono::nanoseconds>(snapshotEnd - hashEnd).count();
+			numBullets += snap.nbul;
+			same = same && hash == full;
+		}
+	}
+	cout << "[BENCH] hash: tick=" << stepNs / 1000.0f / numTicks << " us, hash=" << CAST_FLOAT(hashNs) / numTicks << " ns ("
+		 << 100.0f * hashNs / stepNs << "% of the tick), snapshot and its hash=" << CAST_FLOAT(snapshotNs) / numTicks << " ns, "
+		 << CAST_FLOAT(numBullets) / numTicks << " bullets, same as the snapshot hash=" << (same ? "yes" : "no") << endl;
+
+	Game parallel(config), serial(config);
+	parallel.initGameEnv();
+	serial.initGameEnv();
+	parallel.workers.start(max(2u, thread::hardware_concurrency()));
+	parallel.sightParallelMin = 1;
+	unsigned int caught = numTicks;
+	for ( unsigned int t = 0 ; t < numTicks && caught == numTicks ; t++ ) {
+		if ( t == desyncTick ) {
+			serial.players[3].setPosition(serial.players[3].getPosition() + sf::Vector2f(0.25f, 0));
+		}
+		parallel.frameArena.reset();
+		if ( !parallel.stepChecked(serial, idle) ) {
+			caught = t;
+		}
+	}
+	cout << "[BENCH] hash: " << parallel.workers.size() << " workers, serial and parallel games are the same for "
+		 << caught << " ticks, moved soldier at tick " << desyncTick << " is caught at tick " << caught << endl;
+	return (same && caught == desyncTick) ? 0 : 1;
+}
+//---
+
+//-> A fixed match whose world hash should be the same in every build, compilers
+//   and optimization levels can be compared with it. Every 1000 ticks the world
+//   is saved and applied again, the fixed point positions should not change.
+int benchFixed(void)
+{
+	const unsigned int numTicks = 20000;
+	scenario config = benchScenario(1600, 1200, 12, 12, 0);
+	config.numBots = SNAP_MAX_PLAYERS;
+	config.headless = 1;
+	const tickInput idle = {{-1, -1}, {0, 0}, 0};
+	worldSnapshot saved, applied;
+	Game game(config);
+	game.initGameEnv();
+	bool same = 1;
+	sf::Clock clock;
+	for ( unsigned int t = 1 ; t <= numTicks ; t++ ) {
+		game.frameArena.reset();
+		game.step(idle);
+		if ( t % 1000 == 0 ) {
+			const sf::Uint64 hash = game.getHash();
+			game.captureSnapshot(saved);
+			game.applySnapshot(saved);
+			game.captureSnapshot(applied);
+			same = same && equalSnapshots(saved, applied) && game.getHash() == hash;
+		}
+	}
+	sf::Int64 time = clock.getElapsedTime().asMicroseconds();
+	cout << "[BENCH] fixed: " << numTicks << " ticks in " << time / 1000.0 << " ms, world hash " << hex << game.getHash() << dec
+		 << ", scores:";
+	for ( int i = 0 ; i < game.numPlayers ; i++ ) {
+		cout << " " << game.players[i].getScore();
+	}
+	cout << ", saved and applied worlds same=" << (same ? "yes" : "no") << endl;
+	return same ? 0 : 1;
 }
+//---
+
+int main(int argc, char **argv)
+{
+	//-> Benchmarks do not start the game.
+	if ( argc > 2 && string(argv[1]) == "--bench" ) {
+		return runBenchmark(argv[2]);
+	}
+	//---
+	//-> Offline asset packer.
+	if ( argc > 2 && string(argv[1]) == "--pack" ) {
+		return AssetStore::pack("textures/", "./font.ttf", argv[2]) ? 0 : 1;
+	}
+	//---
+	//-> Scenario of the game, from the config file and the other options.
+	sf::Clock clock;
+	scenario config;
+	if ( !ScenarioLoader::load(config, argc, argv) ) {
+		return 1;
+	}
+	cout << "[INFO] Scenario is loaded in " << clock.getElapsedTime().asMicroseconds() << " us." << endl;
+	ScenarioLoader::print(config);
+	//---
 
+	//-> Game is destroyed before the leak summary. Maps are exported without a window.
+	if ( !config.exportPath.empty() ) {
+		config.headless = 1;
+		Game shooter(config);
+		return shooter.exportMap() ? 0 : 1;
+	}
+	{
+		Game shooter(config);
+		if ( !config.replayPath.empty() ) {
+			shooter.runReplay();
+		} else if ( config.checkParallel ) {
+			scenario serialConfig = config; //Serial copy does not write the files of the game.
+			serialConfig.telemetryPath = "";
+			serialConfig.recordPath = "";
+			Game serial(serialConfig);
+			shooter.runHeadless(&serial);
+		} else if ( config.headless ) {
+			shooter.runHeadless();
+		} else {
+			shooter.run2player();
+		}
+	}
+	AllocTracker::report(1);
+	//---
+	return 0;
+}